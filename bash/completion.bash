@@ -5,8 +5,8 @@ _retrolire(){
     getter=
     poss=
     suff=' '
-    opts='--last --tag --var --search --quote --show-tags --id --move'
-    commands="edit open print quote refer add file list json cite update delete init"
+    opts='--last --tag --var --search --fts --quote --show-tags --live --match --top --id --move'
+    commands="edit open print quote refer add file list json cite update delete daemon catalog init"
     fileopts=
 
     prev="${COMP_WORDS[COMP_CWORD-1]}"
@@ -39,14 +39,14 @@ _retrolire(){
         -i | --id)
             poss=''
             ;;
-        -s | --search | -q | --quote | -c | --concept)
+        -s | --search | -f | --fts | -q | --quote | -c | --concept)
             # TODO: -c completion concepts
             poss=""
             ;;
         -l | --last | -e | --exact)
             poss="$opts"
             ;;
-        f | fi | fil | file | json | bibtex)
+        f | fi | fil | file | json | bibtex | ca | cat | cata | catal | catalo | catalog)
             fileopts='-o filenames -A file'
             poss=""
             ;;
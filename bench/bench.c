@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+static const char* ascii_words[] = { "the", "sociology", "of",
+  "deviance", "outsiders", "art", "worlds", "becker", "howard",
+  "tricks", "trade", "writing", "for", "social", "scientists",
+  "theory", "method", "history", "labour", "culture", "stigma",
+  "asylums", "frame", "analysis", "Goffman", "Chicago" };
+
+static const char* utf8_words[] = { "déviance", "étiquetage",
+  "sociétés", "œuvre", "Ἀριστοτέλης", "πολιτεία", "社会学",
+  "言語", "straße", "über", "naïveté", "Рассказы", "жизнь",
+  "été", "à", "ça", "ellipse…", "«citation»", "l’art", "φύσις" };
+
+#define N_ASCII (sizeof(ascii_words) / sizeof(*ascii_words))
+#define N_UTF8 (sizeof(utf8_words) / sizeof(*utf8_words))
+
+/* the state of the generator (xorshift32). */
+static unsigned state = 2463534242u;
+
+PGresult*
+bench_result(int n_fields, const char* const* names)
+{
+  PGresult* res = PQmakeEmptyPGresult(NULL, PGRES_TUPLES_OK);
+  if (res == NULL)
+    return NULL;
+  PGresAttDesc attrs[n_fields];
+  memset(attrs, 0, sizeof(attrs));
+  for (int j = 0; j < n_fields; j++) {
+    attrs[j].name = (char*)names[j];
+    /* the oid of text. */
+    attrs[j].typid = 25;
+    attrs[j].typlen = -1;
+  }
+  if (!PQsetResultAttrs(res, n_fields, attrs)) {
+    PQclear(res);
+    return NULL;
+  }
+  return res;
+}
+
+int
+bench_set(PGresult* res, int row, int field, const char* s)
+{
+  return PQsetvalue(res, row, field, (char*)s, (int)strlen(s));
+}
+
+unsigned
+bench_rand(unsigned n)
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state % n;
+}
+
+size_t
+bench_words(char* s, size_t size, int n_words, int multibyte)
+{
+  size_t len = 0;
+  s[0] = '\0';
+  for (int i = 0; i < n_words; i++) {
+    /* one word out of two is multibyte. */
+    const char* w = (multibyte && bench_rand(2))
+                      ? utf8_words[bench_rand(N_UTF8)]
+                      : ascii_words[bench_rand(N_ASCII)];
+    size_t n = strlen(w);
+    if (len + n + 2 > size)
+      break;
+    if (i > 0)
+      s[len++] = ' ';
+    memcpy(s + len, w, n + 1);
+    len += n;
+  }
+  return len;
+}
+
+double
+bench_now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec * 1e3 + (double)t.tv_nsec / 1e6;
+}
+
+void
+bench_report(const char* name, double ms, double ref)
+{
+  if (ref > 0)
+    printf("  %-40s %9.2f ms  (x%.2f)\n", name, ms, ref / ms);
+  else
+    printf("  %-40s %9.2f ms\n", name, ms);
+}
+
+int
+bench_same(FILE* a, FILE* b)
+{
+  rewind(a);
+  rewind(b);
+  char x[4096], y[4096];
+  for (;;) {
+    size_t n = fread(x, 1, sizeof(x), a);
+    size_t m = fread(y, 1, sizeof(y), b);
+    if (n != m || memcmp(x, y, n) != 0)
+      return 0;
+    if (n == 0)
+      return 1;
+  }
+}
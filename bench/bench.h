@@ -0,0 +1,48 @@
+/* bench
+ * -----
+ *
+ * what the benchmarks (make bench) share: results built without a
+ * database, filled with random words, and a clock. the words are
+ * drawn from a fixed seed, so that two runs time the same input.
+ *
+ * */
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <postgresql/libpq-fe.h>
+#include <stddef.h>
+
+/* an empty result, with text fields of these names. returns NULL on
+ * error. */
+PGresult*
+bench_result(int n_fields, const char* const* names);
+
+/* set a value of a result (it's copied). returns 0 on error. */
+int
+bench_set(PGresult* res, int row, int field, const char* s);
+
+/* a random number in [0, n). */
+unsigned
+bench_rand(unsigned n);
+
+/* write n_words random words, separated by spaces, to s (of the
+ * given size). the words have accented, greek or cjk chars if
+ * multibyte is set. returns the length written. */
+size_t
+bench_words(char* s, size_t size, int n_words, int multibyte);
+
+/* the time, in milliseconds. */
+double
+bench_now();
+
+/* print the time of a benchmark, and the ratio to a reference time
+ * (0 for none). */
+void
+bench_report(const char* name, double ms, double ref);
+
+/* compare two files from their start. returns 0 if they differ. */
+int
+bench_same(FILE* a, FILE* b);
+
+#endif
@@ -0,0 +1,202 @@
+/* the ranking of --match: fuzzy_match and the heap of the top rows,
+ * on 100k synthetic entries (id, title, someone), for a few queries.
+ * the top rows are checked against a sort of all the matching rows.
+ * if fzf is installed, `fzf --filter` (what scripts used before
+ * --match) is timed on the same rows. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/fuzzy.h"
+#include "bench.h"
+
+#define N_ROWS 100000
+#define RUNS 5
+#define TOP 10
+
+struct Query
+{
+  const char* query;
+  int exact;
+};
+
+static const struct Query queries[] = {
+  { "becker outsiders", 0 },
+  { "sociology", 0 },
+  { "soc dev", 0 },
+  { "Goffman asylums", 0 },
+  { "art worlds", 1 },
+  { "zzz", 0 },
+};
+
+/* rank the rows as match_rows does (the values of a row kept are
+ * copied). returns the number of matching rows, or -1 on error. */
+static int
+rank(PGresult* res, const struct Fuzzy* fz, struct Top* top)
+{
+  char row[1024];
+  int n = 0;
+  for (int i = 0; i < N_ROWS; i++) {
+    struct FuzzyScore sc;
+    if (!fuzzy_match(fz, res, i, &sc))
+      continue;
+    n++;
+    sc.n = i;
+    if (!top_enters(top, &sc))
+      continue;
+    int len = snprintf(row,
+      sizeof(row),
+      "%s\n\t%s\n\t%s",
+      PQgetvalue(res, i, 0),
+      PQgetvalue(res, i, 1),
+      PQgetvalue(res, i, 2));
+    if (!top_add(top, &sc, row, (size_t)len))
+      return -1;
+  }
+  top_sort(top);
+  return n;
+}
+
+/* the order of the ranking (see ranks_after in fuzzy.c). */
+static int
+compare_scores(const void* a, const void* b)
+{
+  const struct FuzzyScore* x = a;
+  const struct FuzzyScore* y = b;
+  if (x->score != y->score)
+    return x->score > y->score ? -1 : 1;
+  if (x->start != y->start)
+    return x->start < y->start ? -1 : 1;
+  if (x->len != y->len)
+    return x->len < y->len ? -1 : 1;
+  return x->n < y->n ? -1 : x->n > y->n;
+}
+
+/* check the top rows against a sort of all the matching rows.
+ * returns 0 if they differ. */
+static int
+check_top(PGresult* res, const struct Fuzzy* fz, const struct Top* top)
+{
+  struct FuzzyScore* all = malloc(N_ROWS * sizeof(*all));
+  if (all == NULL)
+    return 0;
+  int n = 0;
+  for (int i = 0; i < N_ROWS; i++) {
+    if (fuzzy_match(fz, res, i, &all[n])) {
+      all[n].n = i;
+      n++;
+    }
+  }
+  qsort(all, (size_t)n, sizeof(*all), compare_scores);
+  int ok = top->n == (n < TOP ? n : TOP);
+  for (int i = 0; ok && i < top->n; i++)
+    ok = top->m[i].sc.n == all[i].n;
+  free(all);
+  return ok;
+}
+
+/* the time of fzf --filter on the rows, written as with -O. returns
+ * a negative time if fzf isn't there. */
+static double
+time_fzf(const char* path, const struct Query* q)
+{
+  char cmd[512];
+  snprintf(cmd,
+    sizeof(cmd),
+    "fzf --read0 --print0 --filter '%s'%s < %s > /dev/null",
+    q->query,
+    q->exact ? " --exact" : "",
+    path);
+  double best = -1;
+  for (int r = 0; r < RUNS; r++) {
+    double start = bench_now();
+    if (system(cmd) == -1)
+      return -1;
+    double ms = bench_now() - start;
+    if (r == 0 || ms < best)
+      best = ms;
+  }
+  return best;
+}
+
+int
+main()
+{
+  const char* names[] = { "id", "title", "someone" };
+  PGresult* res = bench_result(3, names);
+  if (res == NULL)
+    return 1;
+  char s[512];
+  for (int i = 0; i < N_ROWS; i++) {
+    snprintf(s, sizeof(s), "key%d", i);
+    int ok = bench_set(res, i, 0, s);
+    bench_words(s, sizeof(s), 3 + (int)bench_rand(8), 0);
+    ok = ok && bench_set(res, i, 1, s);
+    bench_words(s, sizeof(s), 2, 0);
+    if (!ok || !bench_set(res, i, 2, s)) {
+      fputs("error making the result.\n", stderr);
+      return 1;
+    }
+  }
+
+  /* the rows for fzf, if it's there. */
+  char path[] = "/tmp/retrolire-bench-XXXXXX";
+  FILE* rows = NULL;
+  int fzf = system("command -v fzf > /dev/null") == 0;
+  if (fzf) {
+    int fd = mkstemp(path);
+    rows = fd == -1 ? NULL : fdopen(fd, "w");
+    for (int i = 0; rows != NULL && i < N_ROWS; i++)
+      fprintf(rows,
+        "%s\n\t%s\n\t%s%c",
+        PQgetvalue(res, i, 0),
+        PQgetvalue(res, i, 1),
+        PQgetvalue(res, i, 2),
+        '\0');
+    fzf = rows != NULL && fclose(rows) == 0;
+  }
+
+  int ok = 1;
+  for (size_t k = 0; ok && k < sizeof(queries) / sizeof(*queries);
+       k++) {
+    const struct Query* q = &queries[k];
+    struct Fuzzy fz;
+    if (!fuzzy_init(&fz, q->query, q->exact))
+      return 1;
+    double best = 0;
+    int n = 0;
+    for (int r = 0; ok && r < RUNS; r++) {
+      struct Top top;
+      if (!top_init(&top, TOP))
+        return 1;
+      double start = bench_now();
+      n = rank(res, &fz, &top);
+      double ms = bench_now() - start;
+      if (r == 0 || ms < best)
+        best = ms;
+      ok = n >= 0 && check_top(res, &fz, &top);
+      top_free(&top);
+    }
+    fuzzy_free(&fz);
+    if (!ok) {
+      fprintf(
+        stderr, "'%s': the top rows are not the best.\n", q->query);
+      break;
+    }
+    printf("'%s'%s: %d of %d rows match\n",
+      q->query,
+      q->exact ? " (exact)" : "",
+      n,
+      N_ROWS);
+    double ref = fzf ? time_fzf(path, q) : -1;
+    if (ref >= 0)
+      bench_report("fzf --filter", ref, 0);
+    bench_report("--match", best, ref >= 0 ? ref : 0);
+  }
+  if (fzf)
+    unlink(path);
+  PQclear(res);
+  return !ok;
+}
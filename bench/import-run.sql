@@ -0,0 +1,31 @@
+-- one import of an entry into a library of :n entries, with the
+-- trigger :trigger (see import.sql).
+
+-- the library, vacuumed so that it has no dead tuples.
+truncate entry cascade;
+insert into entry (id, title)
+select 'bench' || i, 'a title ' || i
+from generate_series(1, :n) i;
+vacuum (analyze) entry, reading, tag, file;
+
+-- the dead tuples, from the statistics once they are up to date.
+select pg_stat_force_next_flush() as flush \gset
+select pg_stat_clear_snapshot() as snapshot \gset
+select coalesce(sum(n_dead_tup), 0) as dead_before
+from pg_stat_user_tables
+where relname in ('entry', 'reading', 'tag', 'file') \gset
+
+-- the import, with all the fields that the trigger moves.
+select clock_timestamp() as start \gset
+insert into entry (id, title, keyword, abstract, annote, file)
+values ('imported', 'an imported entry', 'poetry, recording',
+    'an abstract', 'some notes', '/tmp/imported.pdf');
+select round(extract(epoch from
+    clock_timestamp() - :'start'::timestamptz) * 1000, 2) as ms \gset
+
+select pg_stat_force_next_flush() as flush \gset
+select pg_stat_clear_snapshot() as snapshot \gset
+insert into bench_import
+select :'trigger', :n, :ms, coalesce(sum(n_dead_tup), 0) - :dead_before
+from pg_stat_user_tables
+where relname in ('entry', 'reading', 'tag', 'file');
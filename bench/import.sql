@@ -0,0 +1,93 @@
+-- the import of one entry into libraries of 1k, 10k and 100k
+-- entries, with the trigger move_fields as it is (the function
+-- move_reading_fields reads the transition table new_entries) and as
+-- it was before (move_things read and rewrote the whole table
+-- entry). for each one, the time of the insert and the dead tuples
+-- it left in entry, reading, tag and file.
+--
+-- it empties the tables: run it in a scratch database, made from the
+-- schema (postgresql 15 or newer, for pg_stat_force_next_flush).
+--
+--     createdb retrolire_bench
+--     retrolire _schema | psql -d retrolire_bench
+--     psql -d retrolire_bench -f bench/import.sql
+
+\set ON_ERROR_STOP on
+\set QUIET on
+
+create temporary table bench_import (
+    trigger text,
+    entries int,
+    ms numeric,
+    dead_tuples bigint
+);
+
+-- the functions of the trigger before the transition table.
+create function bench_move_things() returns void
+    language sql
+    as $$
+insert into reading (id) select id from entry on conflict do nothing;
+insert into tag (entry, tag)
+    select e.id,
+    unnest(string_to_array(
+            regexp_replace(e.keyword, '\s+', '', 'g'), ','
+    ))
+from entry e
+where e.keyword is not null
+on conflict do nothing;
+update reading r set notes = e.annote
+from entry e where e.id = r.id
+and e.annote is not null;
+update reading r set abstract = e.abstract
+from entry e where e.id = r.id
+and e.abstract is not null;
+insert into file (entry, filepath)
+select id, file from entry
+where file is not null
+on conflict do nothing;
+update entry set keyword = null;
+update entry set abstract = null;
+update entry set annote = null;
+update entry set file = null;
+$$;
+
+create function bench_move_reading_fields() returns trigger
+    language plpgsql
+    as $$
+begin
+perform bench_move_things();
+return new;
+end;
+$$;
+
+\set trigger 'transition table'
+\set n 1000
+\ir import-run.sql
+\set n 10000
+\ir import-run.sql
+\set n 100000
+\ir import-run.sql
+
+drop trigger move_fields on entry;
+create trigger move_fields after insert on entry
+    for each statement execute function bench_move_reading_fields();
+
+\set trigger 'whole table'
+\set n 1000
+\ir import-run.sql
+\set n 10000
+\ir import-run.sql
+\set n 100000
+\ir import-run.sql
+
+-- the trigger of the schema, back.
+drop trigger move_fields on entry;
+create trigger move_fields after insert on entry
+    referencing new table as new_entries
+    for each statement execute function public.move_reading_fields();
+drop function bench_move_reading_fields();
+drop function bench_move_things();
+truncate entry cascade;
+
+\set QUIET off
+select * from bench_import order by trigger, entries;
@@ -0,0 +1,246 @@
+/* the parsing of the notes: parse_notes (in the client) against the
+ * SQL functions get_quotes and get_concepts that the trigger
+ * parse_note runs. the items of both are checked to be the same, on
+ * many small random notes and on large ones (10k, 100k and 1M
+ * bytes), which are then timed.
+ *
+ * it needs a database with the schema (the functions are only read,
+ * nothing is written), the one of config.h unless another one is
+ * given:
+ *
+ *     make bench-db DB='dbname=retrolire_bench'
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/notes.h"
+#include "../src/util.h"
+#include "bench.h"
+
+#define N_SMALL 500
+#define RUNS 3
+
+/* the items of the SQL functions, in the order of the struct Notes,
+ * as the trigger gets them. */
+#define SQL_ITEMS \
+  "with q as (select array_agg(quote) as quotes,\n" \
+  "    array_agg(page_number) as pages from get_quotes($1)),\n" \
+  "c as (select array_agg(concept) as concepts,\n" \
+  "    array_agg(definition) as definitions,\n" \
+  "    array_agg(page) as pages from get_concepts($1))\n" \
+  "select coalesce(q.quotes, '{}'), coalesce(q.pages, '{}'),\n" \
+  "    coalesce(c.concepts, '{}'), coalesce(c.definitions, '{}'),\n" \
+  "    coalesce(c.pages, '{}')\n" \
+  "from q, c"
+
+/* the first element which differs between two arrays. */
+#define SQL_DIFF \
+  "select i, a[i], b[i]\n" \
+  "from (select $1::text[] as a, $2::text[] as b) x,\n" \
+  "generate_series(1, greatest(cardinality(a), cardinality(b))) i\n" \
+  "where a[i] is distinct from b[i] limit 1"
+
+static const char* item_names[] = { "quotes", "quote pages",
+  "concepts", "definitions", "concept pages" };
+
+static int
+cat(struct Buf* b, const char* s)
+{
+  return buf_cat(b, s, strlen(s));
+}
+
+static int
+cat_words(struct Buf* b, int n_words)
+{
+  char s[2048];
+  size_t len = bench_words(s, sizeof(s), n_words, 1);
+  return buf_cat(b, s, len);
+}
+
+/* a page number, in one of the forms of split_quote_page_number, or
+ * nothing. */
+static int
+cat_page(struct Buf* b)
+{
+  static const char* forms[] = { " [p. %u]", " (p. %u)", " [%u]",
+    " (pp. %u-%u)", " [pages %u-%u]", " (page %u)", "(p%u)", "" };
+  char s[64];
+  unsigned n_forms = sizeof(forms) / sizeof(*forms);
+  const char* form = forms[bench_rand(n_forms)];
+  unsigned p = 1 + bench_rand(400);
+  snprintf(s, sizeof(s), form, p, p + bench_rand(20));
+  return cat(b, s);
+}
+
+/* append a random paragraph to some notes: quotes (maybe on several
+ * lines, or with double quotes and backslashes), concepts (maybe
+ * after an empty line), or text. */
+static int
+cat_paragraph(struct Buf* b)
+{
+  int n = 3 + (int)bench_rand(25);
+  switch (bench_rand(8)) {
+    case 0:
+      return cat(b, "> ") && cat_words(b, n) && cat_page(b);
+    case 1:
+      return cat(b, "> ") && cat_words(b, n) && cat(b, "\n> ")
+             && cat_words(b, n) && cat(b, "\n") && cat_words(b, 3)
+             && cat_page(b);
+    case 2:
+      return cat(b, "> a \"quoted\" word, a back\\slash ")
+             && cat_words(b, n) && cat_page(b);
+    case 3:
+      return cat_words(b, 1 + n % 4) && cat(b, "\n: ")
+             && cat_words(b, n) && cat_page(b);
+    case 4:
+      return cat_words(b, 1 + n % 4) && cat(b, "\n\n:")
+             && cat_words(b, n) && cat_page(b);
+    case 5:
+      /* a quote right before a concept. */
+      return cat(b, ">") && cat_words(b, n) && cat(b, "\n")
+             && cat_words(b, 2) && cat(b, "\n: ") && cat_words(b, n);
+    default:
+      return cat_words(b, n) && cat(b, (n % 3) ? "\n" : "")
+             && cat_words(b, n);
+  }
+}
+
+/* random notes of about size bytes, trimmed as they are stored. */
+static char*
+make_notes(size_t size)
+{
+  struct Buf b = { NULL, 0, 0 };
+  while (b.len < size) {
+    const char* sep = bench_rand(6) ? "\n\n" : "\n";
+    if (!cat_paragraph(&b) || !cat(&b, sep)) {
+      free(b.s);
+      return NULL;
+    }
+  }
+  char* notes = trim_notes(b.s);
+  free(b.s);
+  return notes;
+}
+
+/* the items of the notes parsed by the SQL functions. returns NULL
+ * if the query failed. */
+static PGresult*
+sql_items(PGconn* conn, const char* notes)
+{
+  const char* params[] = { notes };
+  PGresult* res =
+    PQexecParams(conn, SQL_ITEMS, 1, NULL, params, NULL, NULL, 0);
+  if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+    fprintf(
+      stderr, "query failed:\n %s\n", PQresultErrorMessage(res));
+    PQclear(res);
+    return NULL;
+  }
+  return res;
+}
+
+/* check that parse_notes gives the items of the SQL functions.
+ * returns 0 if it doesn't, after printing the first difference. */
+static int
+check_notes(PGconn* conn, const char* notes, int n)
+{
+  struct Notes c;
+  if (!parse_notes(&c, notes))
+    return 0;
+  PGresult* res = sql_items(conn, notes);
+  if (res == NULL) {
+    free_notes(&c);
+    return 0;
+  }
+  const char* arrays[] = { c.quotes.s, c.quote_pages.s, c.concepts.s,
+    c.definitions.s, c.concept_pages.s };
+  int ok = 1;
+  for (int j = 0; ok && j < 5; j++) {
+    const char* params[] = { arrays[j], PQgetvalue(res, 0, j) };
+    PGresult* diff =
+      PQexecParams(conn, SQL_DIFF, 2, NULL, params, NULL, NULL, 0);
+    if (PQresultStatus(diff) != PGRES_TUPLES_OK) {
+      fprintf(
+        stderr, "query failed:\n %s\n", PQresultErrorMessage(diff));
+      ok = 0;
+    } else if (PQntuples(diff) > 0) {
+      fprintf(stderr,
+        "notes %d, %s %s: '%s' (parse_notes) and '%s' (sql).\n",
+        n,
+        item_names[j],
+        PQgetvalue(diff, 0, 0),
+        PQgetisnull(diff, 0, 1) ? "NULL" : PQgetvalue(diff, 0, 1),
+        PQgetisnull(diff, 0, 2) ? "NULL" : PQgetvalue(diff, 0, 2));
+      ok = 0;
+    }
+    PQclear(diff);
+  }
+  PQclear(res);
+  free_notes(&c);
+  return ok;
+}
+
+/* time both parsers on notes of some size. returns 0 if the items
+ * differ or a query failed. */
+static int
+time_notes(PGconn* conn, size_t size)
+{
+  char* notes = make_notes(size);
+  if (notes == NULL)
+    return 0;
+  if (!check_notes(conn, notes, -1)) {
+    free(notes);
+    return 0;
+  }
+  double sql = 0, client = 0;
+  for (int r = 0; r < RUNS; r++) {
+    double start = bench_now();
+    PGresult* res = sql_items(conn, notes);
+    double ms = bench_now() - start;
+    if (res == NULL) {
+      free(notes);
+      return 0;
+    }
+    PQclear(res);
+    if (r == 0 || ms < sql)
+      sql = ms;
+    struct Notes c;
+    start = bench_now();
+    int parsed = parse_notes(&c, notes);
+    ms = bench_now() - start;
+    if (parsed)
+      free_notes(&c);
+    if (r == 0 || ms < client)
+      client = ms;
+  }
+  printf("notes of %zu bytes\n", strlen(notes));
+  bench_report("get_quotes, get_concepts (sql)", sql, 0);
+  bench_report("parse_notes", client, sql);
+  free(notes);
+  return 1;
+}
+
+int
+main(int argc, char** argv)
+{
+  PGconn* conn = PQconnectdb(argc > 1 ? argv[1] : connectioninfo);
+  if (PQstatus(conn) != CONNECTION_OK) {
+    fprintf(stderr, "connection failed:\n %s", PQerrorMessage(conn));
+    PQfinish(conn);
+    return 1;
+  }
+  int ok = 1;
+  for (int i = 0; ok && i < N_SMALL; i++) {
+    char* notes = make_notes(200 + bench_rand(4000));
+    ok = notes != NULL && check_notes(conn, notes, i);
+    free(notes);
+  }
+  if (ok)
+    printf("same items for %d random notes\n", N_SMALL);
+  ok = ok && time_notes(conn, 10000) && time_notes(conn, 100000)
+       && time_notes(conn, 1000000);
+  PQfinish(conn);
+  return !ok;
+}
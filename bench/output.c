@@ -0,0 +1,249 @@
+/* the writing of query results: write_res (the rows sent to fzf)
+ * and print_result (the expanded rows of print), with the buffered
+ * writer of output.h, against the per-value fputs and putc they
+ * used before it. the results have 100k rows, and the old and new
+ * outputs are checked to be the same. */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/pgpopen2.h"
+#include "../src/print.h"
+#include "../src/sizes.h"
+#include "bench.h"
+
+#define N_ROWS 100000
+#define RUNS 5
+#define TERM_WIDTH 200
+
+/* write_res, before output.h. */
+static void
+old_write_row(PGresult* res,
+  int i,
+  char* field_sep,
+  char record_sep,
+  FILE* f)
+{
+  int n_fields = PQnfields(res) - 1;
+  int j;
+  for (j = 0; j < n_fields; j++) {
+    fputs(PQgetvalue(res, i, j), f);
+    fputs(field_sep, f);
+  }
+  fputs(PQgetvalue(res, i, j), f);
+  fputc(record_sep, f);
+}
+
+static void
+old_write_res(PGresult* res,
+  char* field_sep,
+  char record_sep,
+  FILE* f)
+{
+  int n_rows = PQntuples(res);
+  for (int i = 0; i < n_rows; i++)
+    old_write_row(res, i, field_sep, record_sep, f);
+}
+
+/* print_result, before output.h (the values of the benchmark are
+ * shorter than a line: the wrapping, which has changed since, is
+ * not used). */
+static int
+old_print_result(PGresult* res, FILE* f, int term_width)
+{
+  int n_rows = PQntuples(res);
+  int n_fields = PQnfields(res);
+  char fields_names[n_fields][100];
+  int field_names_lens[n_fields];
+  int max_f_len = 0;
+  int curlen = 0;
+  int i, s, j;
+  for (int i = 0; i < n_fields; i++) {
+    char* x = memccpy(fields_names[i],
+      PQfname(res, i),
+      '\0',
+      sizeof(char*) * ((size_t)term_width));
+    if (!x)
+      return 0;
+    curlen = (int)strnlen(fields_names[i], FIELD_SIZE);
+    if (curlen == FIELD_SIZE)
+      return 0;
+    field_names_lens[i] = curlen;
+    if (curlen > max_f_len)
+      max_f_len = curlen;
+  }
+  for (i = 0; i < n_fields; i++) {
+    for (s = field_names_lens[i]; s < max_f_len; s++)
+      fields_names[i][s] = ' ';
+    fields_names[i][s] = '|';
+    fields_names[i][s + 1] = ' ';
+    fields_names[i][s + 2] = '\0';
+  }
+  char margin[100];
+  margin[0] = '\n';
+  for (s = 1; s <= max_f_len; s++)
+    margin[s] = ' ';
+  memccpy(margin + s, "\\  ", '\0', 100 - (size_t)s);
+  char record_sep[term_width];
+  term_width -= 4;
+  for (i = 0; i < term_width; i++)
+    record_sep[i] = '-';
+  record_sep[i] = '\0';
+  int limit = term_width - (max_f_len + 1);
+  fputs(record_sep, f);
+  putc('\n', f);
+  for (i = 0; i < n_rows; i++) {
+    for (j = 0; j < n_fields; j++) {
+      if (PQgetisnull(res, i, j) == 0) {
+        fputs(fields_names[j], f);
+        char* data = PQgetvalue(res, i, j);
+        int len = PQgetlength(res, i, j);
+        if (len < limit) {
+          fputs(data, f);
+        } else {
+          putc(data[0], f);
+          for (int c = 1; c < len; ++c) {
+            if (c % limit == 0) {
+              if (isascii(data[c])) {
+                fputs(margin, f);
+              } else {
+                while (1) {
+                  putc(data[c], f);
+                  c++;
+                  if (isascii(data[c])) {
+                    fputs(margin, f);
+                    break;
+                  }
+                }
+              }
+            }
+            putc(data[c], f);
+          }
+        }
+        putc('\n', f);
+      }
+    }
+    fputs(record_sep, f);
+    putc('\n', f);
+  }
+  return 1;
+}
+
+/* rows of entries, as listed for the picker. */
+static PGresult*
+make_entries()
+{
+  const char* names[] = { "id", "title", "author", "date", "tags" };
+  PGresult* res = bench_result(5, names);
+  if (res == NULL)
+    return NULL;
+  char s[256];
+  for (int i = 0; i < N_ROWS; i++) {
+    snprintf(s, sizeof(s), "key%d", i);
+    int ok = bench_set(res, i, 0, s);
+    bench_words(s, sizeof(s), 3 + (int)bench_rand(10), 0);
+    ok = ok && bench_set(res, i, 1, s);
+    bench_words(s, sizeof(s), 2, 0);
+    ok = ok && bench_set(res, i, 2, s);
+    snprintf(s, sizeof(s), "%u", 1900 + bench_rand(125));
+    ok = ok && bench_set(res, i, 3, s);
+    bench_words(s, sizeof(s), (int)bench_rand(4), 0);
+    ok = ok && bench_set(res, i, 4, s);
+    if (!ok) {
+      PQclear(res);
+      return NULL;
+    }
+  }
+  return res;
+}
+
+static void
+new_write(PGresult* res, FILE* f)
+{
+  write_res(res, "\n\t", '\0', f);
+}
+
+static void
+old_write(PGresult* res, FILE* f)
+{
+  old_write_res(res, "\n\t", '\0', f);
+}
+
+static void
+new_print(PGresult* res, FILE* f)
+{
+  print_result(res, f, TERM_WIDTH);
+}
+
+static void
+old_print(PGresult* res, FILE* f)
+{
+  old_print_result(res, f, TERM_WIDTH);
+}
+
+/* the best time of some runs, writing to f. */
+static double
+best_time(void (*write)(PGresult*, FILE*), PGresult* res, FILE* f)
+{
+  double best = 0;
+  for (int r = 0; r < RUNS; r++) {
+    double start = bench_now();
+    write(res, f);
+    fflush(f);
+    double ms = bench_now() - start;
+    if (r == 0 || ms < best)
+      best = ms;
+  }
+  return best;
+}
+
+/* time the old and the new way to write the result, to /dev/null,
+ * after checking that they write the same. returns 0 if they
+ * don't. */
+static int
+compare(const char* name,
+  void (*old)(PGresult*, FILE*),
+  void (*new)(PGresult*, FILE*),
+  PGresult* res,
+  FILE* null)
+{
+  FILE* a = tmpfile();
+  FILE* b = tmpfile();
+  if (a == NULL || b == NULL) {
+    perror("tmpfile");
+    return 0;
+  }
+  old(res, a);
+  new(res, b);
+  fflush(a);
+  fflush(b);
+  int same = bench_same(a, b);
+  fclose(a);
+  fclose(b);
+  if (!same) {
+    fprintf(stderr, "%s: the outputs differ.\n", name);
+    return 0;
+  }
+  printf("%s (%d rows)\n", name, N_ROWS);
+  double ref = best_time(old, res, null);
+  bench_report("fputs, putc", ref, 0);
+  bench_report("output.h", best_time(new, res, null), ref);
+  return 1;
+}
+
+int
+main()
+{
+  PGresult* res = make_entries();
+  FILE* null = fopen("/dev/null", "w");
+  if (res == NULL || null == NULL) {
+    fputs("error making the result.\n", stderr);
+    return 1;
+  }
+  int ok = compare("write_res", old_write, new_write, res, null)
+           && compare("print_result", old_print, new_print, res, null);
+  fclose(null);
+  PQclear(res);
+  return !ok;
+}
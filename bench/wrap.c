@@ -0,0 +1,288 @@
+/* the wrapping of long values in print_result: write_wrapped and
+ * utf8_offset, against the putc loop that wrapped values every
+ * 'limit' bytes before them. the values are multibyte-heavy (one
+ * word out of two has accented, greek or cjk chars). the widths of
+ * the lines written are checked (in chars, never more than the
+ * limit), and so is the text (the same words, in the same order). */
+
+/* the static functions of print.c are used: it's included, so its
+ * object isn't taken from the archive. */
+#include "../src/print.c"
+
+#include <ctype.h>
+
+#include "bench.h"
+
+#define N_VALUES 100000
+#define RUNS 5
+#define LIMIT 72
+#define MARGIN "\n\\  "
+
+static const char* values[N_VALUES];
+static size_t lens[N_VALUES];
+
+/* the loop of print_result before write_wrapped. */
+static void
+old_wrapped(FILE* f, const char* data, int len, int limit)
+{
+  if (len < limit) {
+    fputs(data, f);
+    return;
+  }
+  putc(data[0], f);
+  for (int c = 1; c < len; ++c) {
+    if (c % limit == 0) {
+      if (isascii(data[c])) {
+        fputs(MARGIN, f);
+      } else {
+        while (1) {
+          putc(data[c], f);
+          c++;
+          if (isascii(data[c])) {
+            fputs(MARGIN, f);
+            break;
+          }
+        }
+      }
+    }
+    putc(data[c], f);
+  }
+}
+
+static void
+old_write(FILE* f)
+{
+  for (int i = 0; i < N_VALUES; i++) {
+    old_wrapped(f, values[i], (int)lens[i], LIMIT);
+    putc('\n', f);
+  }
+}
+
+static void
+new_write(FILE* f)
+{
+  struct Output o;
+  if (!output_open(&o, f))
+    return;
+  size_t margin_len = strlen(MARGIN);
+  for (int i = 0; i < N_VALUES; i++) {
+    write_wrapped(
+      &o, values[i], lens[i], LIMIT, MARGIN, margin_len);
+    output_char(&o, '\n');
+  }
+  output_close(&o);
+}
+
+/* the offset of the n-th char, a byte at a time. */
+static size_t
+bytewise_offset(const char* s, size_t len, size_t n)
+{
+  for (size_t i = 0; i < len; i++) {
+    if (((unsigned char)s[i] & 0xC0) != 0x80) {
+      if (n == 0)
+        return i;
+      n--;
+    }
+  }
+  return len;
+}
+
+/* cut every value in lines of LIMIT chars, with a function giving
+ * the offset of a char. returns a hash of the offsets, to compare
+ * the functions (and so that the calls aren't optimized out). */
+static size_t
+cut_values(size_t (*offset)(const char*, size_t, size_t))
+{
+  size_t sum = 0;
+  for (int i = 0; i < N_VALUES; i++) {
+    const char* p = values[i];
+    size_t rest = lens[i];
+    while (rest > 0) {
+      size_t cut = offset(p, rest, LIMIT);
+      sum = sum * 31 + cut;
+      p += cut;
+      rest -= cut;
+    }
+  }
+  return sum;
+}
+
+static double
+time_cut(size_t (*offset)(const char*, size_t, size_t), size_t* sum)
+{
+  double best = 0;
+  for (int r = 0; r < RUNS; r++) {
+    double start = bench_now();
+    *sum = cut_values(offset);
+    double ms = bench_now() - start;
+    if (r == 0 || ms < best)
+      best = ms;
+  }
+  return best;
+}
+
+static double
+time_write(void (*write)(FILE*), FILE* f)
+{
+  double best = 0;
+  for (int r = 0; r < RUNS; r++) {
+    double start = bench_now();
+    write(f);
+    fflush(f);
+    double ms = bench_now() - start;
+    if (r == 0 || ms < best)
+      best = ms;
+  }
+  return best;
+}
+
+/* the widths of the lines of a wrapped output. */
+struct Widths
+{
+  /* the lines which are not the last of a value. */
+  long n_full;
+  long sum_full;
+  long max;
+};
+
+/* the number of chars of a line. */
+static long
+line_width(const char* s, size_t len)
+{
+  long n = 0;
+  for (size_t i = 0; i < len; i++)
+    if (((unsigned char)s[i] & 0xC0) != 0x80)
+      n++;
+  return n;
+}
+
+/* read a wrapped output and measure its lines. if words is set,
+ * check that its words are those of the values. returns 0 if they
+ * aren't. */
+static int
+check_output(FILE* f, struct Widths* w, int words)
+{
+  memset(w, 0, sizeof(*w));
+  rewind(f);
+  char* line = NULL;
+  size_t size = 0;
+  ssize_t n;
+  int value = 0;
+  const char* in = values[0];
+  long prev = -1;
+  int ok = 1;
+  while (ok && (n = getline(&line, &size, f)) != -1) {
+    char* s = line;
+    size_t len = (size_t)n - 1;
+    /* a line after a margin. */
+    if (len >= 3 && memcmp(s, "\\  ", 3) == 0) {
+      s += 3;
+      len -= 3;
+      if (prev != -1) {
+        w->n_full++;
+        w->sum_full += prev;
+      }
+    } else if (prev != -1) {
+      /* the first line of the next value. */
+      in = values[++value];
+    }
+    prev = line_width(s, len);
+    if (prev > w->max)
+      w->max = prev;
+    if (!words)
+      continue;
+    /* the words of the line must follow in the value. */
+    for (char* tok = strtok(s, " \n"); tok != NULL;
+         tok = strtok(NULL, " \n")) {
+      in += strspn(in, " ");
+      size_t k = strlen(tok);
+      if (strncmp(in, tok, k) != 0) {
+        fprintf(
+          stderr, "value %d: '%s' is not in the value.\n", value, tok);
+        ok = 0;
+        break;
+      }
+      in += k;
+    }
+  }
+  free(line);
+  if (ok && value != N_VALUES - 1) {
+    fprintf(stderr,
+      "%d values read (%d written).\n",
+      value + 1,
+      N_VALUES);
+    ok = 0;
+  }
+  return ok;
+}
+
+static void
+report_widths(const char* name, const struct Widths* w)
+{
+  printf("  %-40s %9.1f avg, %ld max (limit %d)\n",
+    name,
+    w->n_full ? (double)w->sum_full / (double)w->n_full : 0,
+    w->max,
+    LIMIT);
+}
+
+int
+main()
+{
+  char s[4096];
+  for (int i = 0; i < N_VALUES; i++) {
+    int n_words = 20 + (int)bench_rand(80);
+    lens[i] = bench_words(s, sizeof(s), n_words, 1);
+    values[i] = strdup(s);
+    if (values[i] == NULL) {
+      fputs("error allocating memory.\n", stderr);
+      return 1;
+    }
+  }
+  FILE* a = tmpfile();
+  FILE* b = tmpfile();
+  FILE* null = fopen("/dev/null", "w");
+  if (a == NULL || b == NULL || null == NULL) {
+    perror("tmpfile");
+    return 1;
+  }
+
+  /* the widths of the lines. */
+  struct Widths old_w, new_w;
+  old_write(a);
+  fflush(a);
+  new_write(b);
+  if (!check_output(b, &new_w, 1))
+    return 1;
+  /* the old loop cuts words: only the widths are read. */
+  check_output(a, &old_w, 0);
+  printf("line widths in chars (%d values)\n", N_VALUES);
+  report_widths("putc every 'limit' bytes", &old_w);
+  report_widths("write_wrapped", &new_w);
+  if (new_w.max > LIMIT) {
+    fprintf(stderr, "a line is longer than the limit.\n");
+    return 1;
+  }
+
+  size_t sum_a, sum_b;
+  printf("offset of the char at the limit (%d values)\n", N_VALUES);
+  double ref = time_cut(bytewise_offset, &sum_a);
+  bench_report("a byte at a time", ref, 0);
+  bench_report("utf8_offset", time_cut(utf8_offset, &sum_b), ref);
+  if (sum_a != sum_b) {
+    fputs("utf8_offset doesn't cut where expected.\n", stderr);
+    return 1;
+  }
+
+  printf("wrapped values (%d values)\n", N_VALUES);
+  ref = time_write(old_write, null);
+  bench_report("putc every 'limit' bytes", ref, 0);
+  bench_report("write_wrapped", time_write(new_write, null), ref);
+
+  fclose(a);
+  fclose(b);
+  fclose(null);
+  for (int i = 0; i < N_VALUES; i++)
+    free((char*)values[i]);
+  return 0;
+}
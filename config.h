@@ -17,3 +17,25 @@ static char isbn_services[] = "openl wiki goob";
 
 // fzf options
 static char preview_pos[] = "right,45%,hidden";
+
+// the rows shown by the picker in live mode (option -L), where each
+// change of the query runs a new search in the database.
+static const int live_limit = 200;
+
+// the rows printed by --match, unless --top is used.
+static const int match_top = 10;
+
+// name of the socket of `retrolire daemon` (in $XDG_RUNTIME_DIR).
+static const char daemon_socket[] = "retrolire.sock";
+
+// send the rows of the picker with COPY, which is faster with big
+// libraries (0 to get them one by one).
+static const int copy_rows = 1;
+
+// keep the previews of the picker in a store (in $XDG_CACHE_HOME),
+// refreshed in the background (0 to always query the database).
+static const int preview_store = 1;
+
+// parse the quotes and concepts of the notes in retrolire, and send
+// them with the notes (0 to let the database parse them).
+static const int parse_in_client = 1;
@@ -1,51 +1,371 @@
-from isbnlib import meta, doi2tex, registry
+from isbnlib import meta, registry
+from concurrent.futures import ThreadPoolExecutor
+from urllib.parse import urlsplit, urljoin, quote
+import http.client
+import threading
+import hashlib
+import tempfile
+import re
+import queue
+import json
+import time
+import os
 import isbnlib
 import argparse
 import sys
 
+# the connections of each thread, kept alive between the requests
+# (one by scheme and host).
+_local = threading.local()
 
-def from_isbn(isbn, services) -> str:
+# the directory of the cache of fetchref.
+CACHE_DIR = os.path.join(
+    os.environ.get("XDG_CACHE_HOME")
+    or os.path.expanduser("~/.cache"),
+    "retrolire",
+)
+# the mean latency of the isbn services, kept between the runs.
+STATS_PATH = os.path.join(CACHE_DIR, "isbn_services.json")
+# the references fetched, by the hash of their identifier.
+REFS_DIR = os.path.join(CACHE_DIR, "refs")
+# the latency counted for a service that failed (in seconds).
+FAILURE_LATENCY = 10.0
+# the weight of the last lookup in the mean latency.
+ALPHA = 0.3
+
+
+class ServiceStats:
+    """the mean latency of each isbn service (a moving average)."""
+
+    def __init__(self, path):
+        self.path = path
+        self.lock = threading.Lock()
+        self.changed = False
+        try:
+            with open(path) as f:
+                self.latency = {
+                    k: float(v) for k, v in json.load(f).items()
+                }
+        except (OSError, ValueError, AttributeError):
+            self.latency = {}
+
+    def order(self, services) -> list:
+        """the services, the fastest first (the unknown ones even
+        before, so that they get measured)."""
+
+        return sorted(services, key=lambda s: self.latency.get(s, 0.0))
+
+    def expected(self, service) -> float:
+        """the expected latency of a service (0 if it's unknown)."""
+
+        return self.latency.get(service, 0.0)
+
+    def record(self, service, seconds, ok):
+        """record the latency of a lookup (a failure counts as a slow
+        one)."""
+
+        if not ok:
+            seconds = max(seconds, FAILURE_LATENCY)
+        with self.lock:
+            old = self.latency.get(service)
+            if old is not None:
+                seconds = old + ALPHA * (seconds - old)
+            self.latency[service] = seconds
+            self.changed = True
+
+    def save(self):
+        """write the statistics (if they changed)."""
+
+        if not self.changed:
+            return
+        try:
+            os.makedirs(os.path.dirname(self.path), exist_ok=True)
+            tmp = self.path + ".tmp"
+            with open(tmp, "w") as f:
+                with self.lock:
+                    json.dump(self.latency, f)
+            os.replace(tmp, self.path)
+        except OSError as e:
+            print("cannot save", self.path, e, file=sys.stderr)
+
+
+def normalize(method, identifier) -> str:
+    """normalize an identifier, to get the key of its reference.
+
+    a DOI is lowercased, without its prefix (doi:, https://doi.org/).
+    an ISBN keeps only its digits (and X), and an ISBN-10 becomes an
+    ISBN-13.
+
+    args:
+        method (str):  doi or isbn.
+        identifier (str):  the identifier.
+
+    returns (str):  the key (e.g. "isbn:9782070360024").
+    """
+
+    i = identifier.strip()
+    if method == "doi":
+        prefix = r"^(doi:|https?://(dx\.)?doi\.org/)"
+        i = re.sub(prefix, "", i, flags=re.I)
+        return "doi:" + i.lower()
+    i = re.sub(r"[^0-9X]", "", i.upper())
+    if len(i) == 10:
+        i = "978" + i[:9]
+        check = sum(
+            int(d) * (3 if k % 2 else 1) for k, d in enumerate(i)
+        )
+        i += str((10 - check % 10) % 10)
+    return "isbn:" + i
+
+
+class RefCache:
+    """a cache of the references, on disk: each one is a file named
+    by the hash of its key (see normalize), and is used as long as
+    it's younger than the ttl. the oldest files are removed when the
+    cache is bigger than its maximum size."""
+
+    def __init__(self, path, ttl_days, max_mb):
+        self.path = path
+        self.ttl = ttl_days * 86400
+        self.max_size = max_mb * 1024 * 1024
+        self.written = False
+
+    def file(self, key) -> str:
+        """the file of a key."""
+
+        h = hashlib.sha256(key.encode()).hexdigest()
+        return os.path.join(self.path, h[:2], h[2:] + ".bib")
+
+    def get(self, key) -> str:
+        """get a reference (None if it's not cached, or too old)."""
+
+        f = self.file(key)
+        try:
+            if time.time() - os.stat(f).st_mtime > self.ttl:
+                return None
+            with open(f) as r:
+                return r.read()
+        except OSError:
+            return None
+
+    def put(self, key, ref):
+        """cache a reference (written atomically)."""
+
+        f = self.file(key)
+        try:
+            os.makedirs(os.path.dirname(f), exist_ok=True)
+            fd, tmp = tempfile.mkstemp(dir=os.path.dirname(f))
+            with os.fdopen(fd, "w") as w:
+                w.write(ref)
+            os.replace(tmp, f)
+            self.written = True
+        except OSError as e:
+            print("cannot cache", key, e, file=sys.stderr)
+
+    def prune(self):
+        """remove the expired files, then the oldest ones until the
+        cache fits in its maximum size."""
+
+        if not self.written:
+            return
+        files = []
+        now = time.time()
+        for root, _, names in os.walk(self.path):
+            for name in names:
+                f = os.path.join(root, name)
+                try:
+                    st = os.stat(f)
+                except OSError:
+                    continue
+                if now - st.st_mtime > self.ttl:
+                    # it can have been removed by another run.
+                    try:
+                        os.remove(f)
+                    except OSError:
+                        pass
+                else:
+                    files.append((st.st_mtime, st.st_size, f))
+        total = sum(size for _, size, _ in files)
+        for _, size, f in sorted(files):
+            if total <= self.max_size:
+                break
+            try:
+                os.remove(f)
+            except OSError:
+                pass
+            total -= size
+
+
+def get_connection(scheme, host):
+    """get the keep-alive connection of the thread to a host.
+
+    args:
+        scheme (str):  http or https.
+        host (str):  the host (with its port, if any).
+
+    returns (http.client.HTTPConnection):  the connection.
+    """
+
+    if not hasattr(_local, "connections"):
+        _local.connections = {}
+    key = (scheme, host)
+    if key not in _local.connections:
+        if scheme == "https":
+            conn = http.client.HTTPSConnection(host, timeout=30)
+        else:
+            conn = http.client.HTTPConnection(host, timeout=30)
+        _local.connections[key] = conn
+    return _local.connections[key]
+
+
+def http_get(url, accept, redirects=5) -> str:
+    """get a url, following the redirections.
+
+    args:
+        url (str):  the url.
+        accept (str):  the Accept header.
+        redirects (int):  the maximum number of redirections.
+
+    returns (str, None):  the body of the response (or None).
+    """
+
+    for _ in range(redirects + 1):
+        parts = urlsplit(url)
+        path = parts.path or "/"
+        if parts.query:
+            path += "?" + parts.query
+        headers = {"Accept": accept, "User-Agent": "fetchref"}
+        conn = get_connection(parts.scheme, parts.netloc)
+        # a connection closed by the server is opened again, once.
+        for retry in (True, False):
+            try:
+                conn.request("GET", path, headers=headers)
+                response = conn.getresponse()
+                body = response.read()
+                break
+            except (http.client.HTTPException, OSError):
+                conn.close()
+                if not retry:
+                    return None
+        if response.status in (301, 302, 303, 307, 308):
+            url = urljoin(url, response.getheader("Location", ""))
+            continue
+        if response.status != 200:
+            return None
+        return body.decode("utf-8", errors="replace")
+    return None
+
+
+def from_doi(doi, resolver) -> str:
+    """fetch a reference from a DOI.
+
+    args:
+        doi (str):  the DOI.
+        resolver (str):  the url of the DOI resolver.
+
+    returns (str, None):  bibtex describing the reference (or None).
+    """
+
+    url = resolver.rstrip("/") + "/" + quote(doi, safe="/:;()")
+    ref = http_get(url, "application/x-bibtex")
+    if ref and ref.lstrip().startswith("@"):
+        return ref
+    return None
+
+
+def from_isbn(isbn, services, stats) -> str:
     """fetch a reference from an ISBN.
 
+    the services are hedged: the fastest one is queried first, and the
+    next one is queried too if it doesn't answer within its expected
+    latency (or at once if it fails). the first reference found wins;
+    the lookups still running are abandoned (their threads are daemon
+    threads, so they don't delay the exit).
+
     args:
         isbn (str):  the ISBN.
         services (list[str]):  list of services to use.
+        stats (ServiceStats):  the latency of the services.
 
     returns (str, None):  bibtex describing the reference (or None).
     """
 
     bibtex = registry.bibformatters["bibtex"]
-    ref = None
-    for s in services:
+    results = queue.Queue()
+    # the services whose latency is recorded: each one only once,
+    # either when its lookup ends or when it's abandoned.
+    recorded = set()
+    lock = threading.Lock()
+
+    def lookup(service):
+        start = time.monotonic()
+        ref, invalid = None, False
         try:
-            ref = meta(isbn, s)
-            if len(ref) > 0:
-                return bibtex(ref)
+            ref = meta(isbn, service)
         except isbnlib.NotValidISBNError:
+            invalid = True
+        except (isbnlib.ISBNLibException, OSError):
+            pass
+        except Exception as e:
+            # a service can fail in unexpected ways (e.g. a response
+            # it can't parse): it's then a failed lookup.
+            print(service, "failed:", repr(e), file=sys.stderr)
+        finally:
+            # the lookup is always answered: from_isbn waits for it.
+            with lock:
+                if not invalid and service not in recorded:
+                    recorded.add(service)
+                    latency = time.monotonic() - start
+                    stats.record(service, latency, bool(ref))
+            results.put((service, ref, invalid))
+
+    pending = stats.order(services)
+    # the start of the lookups still running.
+    running = {}
+    while pending or running:
+        timeout = None
+        if pending:
+            service = pending.pop(0)
+            running[service] = time.monotonic()
+            threading.Thread(
+                target=lookup, args=(service,), daemon=True
+            ).start()
+            timeout = stats.expected(service) if pending else None
+        try:
+            service, ref, invalid = results.get(timeout=timeout)
+        except queue.Empty:
+            # too slow: the next service is queried too.
+            continue
+        del running[service]
+        if invalid:
             print("not a valid ISBN:", isbn, file=sys.stderr)
-            exit(1)
+            return None
+        if ref:
+            # the services abandoned were at least that slow.
+            now = time.monotonic()
+            with lock:
+                for other, start in running.items():
+                    if other not in recorded:
+                        recorded.add(other)
+                        stats.record(other, now - start, True)
+            return bibtex(ref)
     return None
 
 
-def fetch_bibtex(method, identifier, isbn_services=None) -> str:
-    """fetch a reference from a DOI or an ISBN.
+def read_identifiers(filepath) -> list:
+    """read a list of identifiers, one by line.
 
     args:
-        doi (str): the DOI.
-        isbn (str): the isbn.
-        isbn_services (list[str]): list of isbn services.
+        filepath (str):  the file ("-" for stdin).
 
-    returns (str, None): the reference in bibtex format.
-
-    only one parameter in `doi` and `isbn` must be set.
+    returns (list[str]):  the identifiers (empty lines and lines
+    starting with "#" are ignored).
     """
 
-    if method == "doi":
-        ref = doi2tex(identifier)
-        return ref
-
-    elif method == "isbn":
-        return from_isbn(identifier, isbn_services)
+    f = sys.stdin if filepath == "-" else open(filepath)
+    with f:
+        lines = [line.strip() for line in f]
+    return [i for i in lines if i and not i.startswith("#")]
 
 
 def parse_args():
@@ -59,9 +379,24 @@ def parse_args():
         help="the method to get the reference.",
     )
     parser.add_argument(
-        "identifier",
+        "identifiers",
+        type=str,
+        nargs="*",
+        help="the identifiers of the references.",
+    )
+    parser.add_argument(
+        "-f",
+        "--file",
         type=str,
-        help="the identifier of the reference.",
+        help="file with one identifier by line (- for stdin).",
+        default=None,
+    )
+    parser.add_argument(
+        "-j",
+        "--jobs",
+        type=int,
+        default=8,
+        help="number of references fetched at the same time.",
     )
     parser.add_argument(
         "--services",
@@ -69,6 +404,29 @@ def parse_args():
         default="openl wiki goob",
         help="list of services to use for the `isbn` method (separated by space).",
     )
+    parser.add_argument(
+        "--resolver",
+        type=str,
+        default="https://doi.org",
+        help="url of the DOI resolver.",
+    )
+    parser.add_argument(
+        "--cache-ttl",
+        type=float,
+        default=30,
+        help="days during which a fetched reference is reused.",
+    )
+    parser.add_argument(
+        "--cache-size",
+        type=float,
+        default=20,
+        help="maximum size of the cache of references (MB).",
+    )
+    parser.add_argument(
+        "--no-cache",
+        action="store_true",
+        help="fetch the references again, even if they are cached.",
+    )
     parser.add_argument(
         "-o",
         "--output",
@@ -85,33 +443,50 @@ def main():
 
     args = parse_args()
     method = args.method
-    id = args.identifier
-    output = args.output
-    services = args.services.split(" ")
-    ref = None
-    if method == "doi":
-        try:
-            ref = doi2tex(id)
-        except isbnlib.dev._exceptions.ISBNLibHTTPError:
-            print(
-                "no reference found for ",
-                method,
-                id,
-                "\nmaybe it's not a doi..?",
-                file=sys.stderr,
-            )
-            exit(1)
-    else:
-        ref = from_isbn(id, services)
-    if not ref:
-        print("no reference found for ", method, id, file=sys.stderr)
+    ids = list(args.identifiers)
+    if args.file:
+        ids += read_identifiers(args.file)
+    if not ids:
+        print("no identifier.", file=sys.stderr)
         exit(1)
-    if not output:
-        print(ref)
-    else:
-        with open(output, "w") as f:
-            f.write(ref)
-    exit(0)
+    services = args.services.split()
+    stats = ServiceStats(STATS_PATH)
+    cache = RefCache(REFS_DIR, args.cache_ttl, args.cache_size)
+
+    def fetch(id):
+        key = normalize(method, id)
+        ref = None if args.no_cache else cache.get(key)
+        if ref:
+            return ref
+        if method == "doi":
+            ref = from_doi(id, args.resolver)
+        else:
+            ref = from_isbn(id, services, stats)
+        if ref:
+            cache.put(key, ref)
+        return ref
+
+    # the references are fetched by a pool of threads, each one
+    # keeping its connections alive, and written in the same order.
+    jobs = max(1, min(args.jobs, len(ids)))
+    with ThreadPoolExecutor(max_workers=jobs) as pool:
+        refs = list(pool.map(fetch, ids))
+    stats.save()
+    found = []
+    for id, ref in zip(ids, refs):
+        if ref:
+            found.append(ref.strip() + "\n")
+        else:
+            print("no reference found for ", method, id, file=sys.stderr)
+    if found and not args.output:
+        print("\n".join(found), end="", flush=True)
+    elif found:
+        with open(args.output, "w") as f:
+            f.write("\n".join(found))
+    # the cache is pruned once the references are written, so that
+    # they don't wait for it (nor get lost if it fails).
+    cache.prune()
+    exit(0 if found else 1)
 
 
 if __name__ == "__main__":
@@ -0,0 +1,13 @@
+-- full-text search on reading notes (option --fts).
+--
+-- the text search configuration ('simple') must be the same than
+-- the one used by retrolire in its queries.
+
+alter table public.reading
+    add column if not exists notes_tsv tsvector
+    generated always as (
+        to_tsvector('simple'::regconfig, coalesce(notes, ''::text))
+    ) stored;
+
+create index if not exists reading_notes_tsv_idx
+    on public.reading using gin (notes_tsv);
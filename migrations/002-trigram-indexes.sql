@@ -0,0 +1,21 @@
+-- trigram indexes for the regex filters (options -v, -q and -c):
+-- the filters use the operator ~*, which these indexes can serve.
+
+create extension if not exists pg_trgm with schema public;
+
+create index if not exists entry_title_trgm_idx
+    on public.entry using gin (title public.gin_trgm_ops);
+create index if not exists entry_container_title_trgm_idx
+    on public.entry using gin ("container-title" public.gin_trgm_ops);
+create index if not exists entry_publisher_trgm_idx
+    on public.entry using gin (publisher public.gin_trgm_ops);
+create index if not exists entry_author_trgm_idx
+    on public.entry using gin ((author::text) public.gin_trgm_ops);
+create index if not exists entry_editor_trgm_idx
+    on public.entry using gin ((editor::text) public.gin_trgm_ops);
+create index if not exists entry_translator_trgm_idx
+    on public.entry using gin ((translator::text) public.gin_trgm_ops);
+create index if not exists quote_quote_trgm_idx
+    on public.quote using gin (quote public.gin_trgm_ops);
+create index if not exists concept_name_trgm_idx
+    on public.concept using gin (name public.gin_trgm_ops);
@@ -0,0 +1,58 @@
+-- the trigger move_fields reads the rows inserted by the statement
+-- (transition table new_entries) instead of the whole table entry.
+
+begin;
+
+drop trigger if exists move_fields on public.entry;
+
+CREATE OR REPLACE FUNCTION public.move_reading_fields() RETURNS trigger
+    LANGUAGE plpgsql
+    AS $$
+begin
+-- only the rows inserted by the statement (the transition table
+-- new_entries) are read and updated, so that an import does not
+-- touch the rest of the library.
+-- insert a reading for every new entry.
+insert into reading (id) select id from new_entries
+on conflict do nothing;
+-- move keyword to table tag
+insert into tag (entry, tag)
+    select n.id,
+    unnest(string_to_array(
+            regexp_replace(n.keyword, '\s+', '', 'g'), ','
+    ))
+from new_entries n
+where n.keyword is not null
+on conflict do nothing;
+-- move reading notes (annote)
+update reading r set notes = n.annote
+from new_entries n where n.id = r.id
+and n.annote is not null;
+-- move abstract
+update reading r set abstract = n.abstract
+from new_entries n where n.id = r.id
+and n.abstract is not null;
+-- move filepath
+insert into file (entry, filepath)
+select id, file from new_entries
+where file is not null
+on conflict do nothing;
+-- delete values from entry (in one update, only for the new rows
+-- that had one).
+update entry e
+set keyword = null, abstract = null, annote = null, file = null
+from new_entries n
+where n.id = e.id
+and (n.keyword is not null or n.abstract is not null
+    or n.annote is not null or n.file is not null);
+return null;
+end;
+$$;
+
+create trigger move_fields after insert on public.entry
+    referencing new table as new_entries
+    for each statement execute function public.move_reading_fields();
+
+drop function if exists public.move_things();
+
+commit;
@@ -0,0 +1,78 @@
+-- parse_note() diffs the quotes and concepts parsed from the notes
+-- against the existing rows by content hash (column hash), instead
+-- of deleting and inserting them all on each save.
+
+begin;
+
+CREATE FUNCTION public.note_hash(VARIADIC text[]) RETURNS uuid
+    LANGUAGE sql IMMUTABLE
+    AS $_$
+-- content hash of an item parsed from the notes (a quote or a
+-- concept), used by parse_note() to find the items that changed.
+select md5(array_to_string($1, E'\x1f', ''))::uuid;
+$_$;
+
+alter table public.quote add column if not exists hash uuid
+    generated always as (public.note_hash(variadic array[quote, page]))
+    stored;
+alter table public.concept add column if not exists hash uuid
+    generated always as
+    (public.note_hash(variadic array[name, definition, page]))
+    stored;
+
+create index if not exists quote_entry_hash_idx
+    on public.quote using btree (entry, hash);
+create index if not exists concept_entry_hash_idx
+    on public.concept using btree (entry, hash);
+
+CREATE OR REPLACE FUNCTION public.parse_note() RETURNS trigger
+    LANGUAGE plpgsql
+    AS $$
+begin
+if tg_op = 'UPDATE' and new.notes is not distinct from old.notes then
+    return new;
+end if;
+-- the items parsed from the notes are compared by content hash
+-- with the existing rows: only the ones that are gone are deleted,
+-- and only the new ones are inserted (so that the others keep their
+-- id, note and context).
+    -- quotes
+with parsed as (
+    select distinct q.quote, q.page_number as page,
+        note_hash(q.quote, q.page_number) as hash
+    from get_quotes(new.notes) q
+), gone as (
+    delete from quote x
+    where x.entry = new.id
+    and not exists (select 1 from parsed p where p.hash = x.hash)
+)
+insert into quote (entry, quote, page)
+select new.id, p.quote, p.page
+from parsed p
+where not exists (
+    select 1 from quote x
+    where x.entry = new.id and x.hash = p.hash
+);
+    -- concepts
+with parsed as (
+    select distinct c.concept, c.definition, c.page,
+        note_hash(c.concept, c.definition, c.page) as hash
+    from get_concepts(new.notes) c
+), gone as (
+    delete from concept x
+    where x.entry = new.id
+    and not exists (select 1 from parsed p where p.hash = x.hash)
+)
+insert into concept (entry, name, definition, page)
+select new.id, p.concept, p.definition, p.page
+from parsed p
+where not exists (
+    select 1 from concept x
+    where x.entry = new.id and x.hash = p.hash
+);
+    -- returns row
+return new;
+end;
+$$;
+
+commit;
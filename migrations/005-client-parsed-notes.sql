@@ -0,0 +1,79 @@
+-- the client can parse the quotes and concepts of the notes itself
+-- and send them to set_note_items(), in the transaction where it
+-- sets retrolire.parsed (then, parse_note doesn't parse the notes).
+
+begin;
+
+CREATE OR REPLACE FUNCTION public.set_note_items(text, text[], text[], text[], text[], text[]) RETURNS void
+    LANGUAGE sql
+    AS $_$
+-- set the quotes ($2, with their pages $3) and the concepts ($4,
+-- with their definitions $5 and pages $6) parsed from the notes of
+-- the entry $1. the items are compared by content hash with the
+-- existing rows: only the ones that are gone are deleted, and only
+-- the new ones are inserted (so that the others keep their id, note
+-- and context).
+with parsed as (
+    select distinct p.quote, p.page,
+        note_hash(p.quote, p.page) as hash
+    from unnest($2, $3) as p(quote, page)
+), gone as (
+    delete from quote x
+    where x.entry = $1
+    and not exists (select 1 from parsed p where p.hash = x.hash)
+)
+insert into quote (entry, quote, page)
+select $1, p.quote, p.page
+from parsed p
+where not exists (
+    select 1 from quote x
+    where x.entry = $1 and x.hash = p.hash
+);
+with parsed as (
+    select distinct p.concept, p.definition, p.page,
+        note_hash(p.concept, p.definition, p.page) as hash
+    from unnest($4, $5, $6) as p(concept, definition, page)
+), gone as (
+    delete from concept x
+    where x.entry = $1
+    and not exists (select 1 from parsed p where p.hash = x.hash)
+)
+insert into concept (entry, name, definition, page)
+select $1, p.concept, p.definition, p.page
+from parsed p
+where not exists (
+    select 1 from concept x
+    where x.entry = $1 and x.hash = p.hash
+);
+$_$;
+
+CREATE OR REPLACE FUNCTION public.parse_note() RETURNS trigger
+    LANGUAGE plpgsql
+    AS $$
+begin
+if tg_op = 'UPDATE' and new.notes is not distinct from old.notes then
+    return new;
+end if;
+-- the client may have parsed the notes itself (see src/notes.c), and
+-- sent the items with set_note_items() in the same transaction.
+if current_setting('retrolire.parsed', true) = 'on' then
+    return new;
+end if;
+perform set_note_items(new.id,
+    q.quotes, q.pages, c.concepts, c.definitions, c.pages)
+from (
+    select array_agg(x.quote) as quotes,
+        array_agg(x.page_number) as pages
+    from get_quotes(new.notes) x
+) q, (
+    select array_agg(x.concept) as concepts,
+        array_agg(x.definition) as definitions,
+        array_agg(x.page) as pages
+    from get_concepts(new.notes) x
+) c;
+    -- returns row
+return new;
+end;
+$$;
+
+commit;
@@ -0,0 +1,126 @@
+-- retrolire imports csl-json files by itself (add json): it copies
+-- the entries into a temporary table, and import_entries() inserts
+-- them into entry.
+
+begin;
+
+CREATE OR REPLACE FUNCTION public.citekey_base(jsonb) RETURNS text
+    LANGUAGE sql IMMUTABLE
+    AS $_$
+-- the citation key of a csl-json entry, without its suffix: a name
+-- (of the first person, or else the publisher, the collection or the
+-- title), only made of lowercase word characters (15 at most), and
+-- a year. an entry with neither name nor year gets 'entry'.
+select coalesce(nullif(
+    coalesce(left(lower(regexp_replace(coalesce(
+        (select coalesce(x.p->>'family', x.p->>'literal', x.p->>'given')
+        from (select coalesce(
+            nullif($1->'author', '[]'),
+            nullif($1->'editor', '[]'),
+            nullif($1->'translator', '[]')
+        )->0 as p) x),
+        nullif($1->>'publisher', ''),
+        nullif($1->>'collection-title', ''),
+        nullif($1->>'title', '')
+    ), '\W+', '', 'g')), 15), '')
+    || coalesce(
+        $1->'issued'->'date-parts'->0->>0,
+        $1->'accessed'->'date-parts'->0->>0,
+        ''
+    ), ''), 'entry');
+$_$;
+
+CREATE OR REPLACE FUNCTION public.citekey_suffix(integer) RETURNS text
+    LANGUAGE plpgsql IMMUTABLE
+    AS $_$
+-- the suffix number $1 of a citation key, to make it unique: '' (0),
+-- then 'a' to 'z', 'aa' to 'zz', 'aaa'...
+declare
+    j integer := $1 - 1;
+    len integer := 1;
+    s text := '';
+begin
+if $1 <= 0 then
+    return '';
+end if;
+while j >= 26 ^ len loop
+    j := j - (26 ^ len)::integer;
+    len := len + 1;
+end loop;
+for i in 1..len loop
+    s := chr(97 + j % 26) || s;
+    j := j / 26;
+end loop;
+return s;
+end;
+$_$;
+
+CREATE OR REPLACE FUNCTION public.import_entries() RETURNS integer
+    LANGUAGE plpgsql
+    AS $_$
+-- insert the csl-json entries copied into the temporary table
+-- _import (n, obj) by the client (see src/csljson.c): the fields
+-- that are not yet columns of entry are added, and every entry gets
+-- a unique citation key. returns the number of entries inserted.
+declare
+    field record;
+    inserted integer;
+begin
+for field in
+    select distinct on (x.key) x.key, x.value
+    from _import i, jsonb_each(jsonb_strip_nulls(i.obj)) x
+    where x.key <> 'ID'
+    and not exists (
+        select 1 from information_schema.columns c
+        where c.table_schema = 'public'
+        and c.table_name = 'entry'
+        and c.column_name = x.key
+    )
+    order by x.key, i.n
+loop
+    execute format('alter table public.entry add column %I %s',
+        field.key,
+        case jsonb_typeof(field.value)
+            when 'string' then 'text'
+            when 'number' then
+                case when field.value::text ~ '^-?\d+$' then 'int'
+                else 'float' end
+            when 'boolean' then 'boolean'
+            else 'jsonb'
+        end);
+end loop;
+-- the k-th entry with a given base takes the k-th suffix that no
+-- existing entry uses.
+with named as (
+    select i.n, citekey_base(i.obj) as base from _import i
+), ranked as (
+    select x.n, x.base,
+        row_number() over (partition by x.base order by x.n) as k
+    from named x
+), bases as (
+    select base, count(*) as c from named group by base
+), free as (
+    select b.base, b.base || citekey_suffix(s.i) as id,
+        row_number() over (partition by b.base order by s.i) as k
+    from bases b, generate_series(0, b.c + (
+        select count(*) from public.entry e
+        where starts_with(e.id, b.base)
+    )::integer) as s(i)
+    where not exists (
+        select 1 from public.entry e
+        where e.id = b.base || citekey_suffix(s.i)
+    )
+)
+insert into public.entry
+select (jsonb_populate_record(null::public.entry,
+    (i.obj - 'ID') || jsonb_build_object('id', f.id))).*
+from _import i
+join ranked r on r.n = i.n
+join free f on f.base = r.base and f.k = r.k
+order by i.n;
+get diagnostics inserted = row_count;
+return inserted;
+end;
+$_$;
+
+commit;
@@ -0,0 +1,102 @@
+-- the citation keys are given from a counter for each base (name and
+-- year), locked during an import.
+
+begin;
+
+create table if not exists public.citekey_counter (
+    base text primary key,
+    next integer default 0 not null
+);
+
+create index if not exists entry_id_c_idx
+    on public.entry using btree (id collate "C");
+
+CREATE OR REPLACE FUNCTION public.import_entries() RETURNS integer
+    LANGUAGE plpgsql
+    AS $_$
+-- insert the csl-json entries copied into the temporary table
+-- _import (n, obj) by the client (see src/csljson.c): the fields
+-- that are not yet columns of entry are added, and every entry gets
+-- a unique citation key. returns the number of entries inserted.
+declare
+    field record;
+    inserted integer;
+begin
+for field in
+    select distinct on (x.key) x.key, x.value
+    from _import i, jsonb_each(jsonb_strip_nulls(i.obj)) x
+    where x.key <> 'ID'
+    and not exists (
+        select 1 from information_schema.columns c
+        where c.table_schema = 'public'
+        and c.table_name = 'entry'
+        and c.column_name = x.key
+    )
+    order by x.key, i.n
+loop
+    execute format('alter table public.entry add column %I %s',
+        field.key,
+        case jsonb_typeof(field.value)
+            when 'string' then 'text'
+            when 'number' then
+                case when field.value::text ~ '^-?\d+$' then 'int'
+                else 'float' end
+            when 'boolean' then 'boolean'
+            else 'jsonb'
+        end);
+end loop;
+-- the citation keys: the counter of each base (name and year) of
+-- the batch is locked (or created), so that concurrent imports
+-- can't give the same key. the k-th entry with a given base then
+-- takes the k-th free suffix from that counter (the keys are only
+-- looked up in the index, never loaded).
+insert into public.citekey_counter as c (base)
+select distinct citekey_base(i.obj) from _import i
+order by 1
+on conflict (base) do update set next = c.next;
+with named as (
+    select i.n, citekey_base(i.obj) as base from _import i
+), ranked as (
+    select x.n, x.base,
+        row_number() over (partition by x.base order by x.n) as k
+    from named x
+), bases as (
+    select x.base, count(*) as batch, c.next,
+        -- the keys that may already use a suffix of that base.
+        (select count(*) from public.entry e
+        where e.id collate "C" >= x.base
+        and e.id collate "C" < x.base || '{') as taken
+    from named x
+    join public.citekey_counter c on c.base = x.base
+    group by x.base, c.next
+), free as (
+    select b.base, s.i, b.base || citekey_suffix(s.i) as id,
+        row_number() over (partition by b.base order by s.i) as k
+    from bases b,
+    generate_series(b.next, b.next + (b.batch + b.taken)::integer)
+        as s(i)
+    where not exists (
+        select 1 from public.entry e
+        where e.id = b.base || citekey_suffix(s.i)
+    )
+), keys as (
+    select r.n, f.base, f.i, f.id
+    from ranked r
+    join free f on f.base = r.base and f.k = r.k
+), counted as (
+    update public.citekey_counter c set next = k.next
+    from (select base, max(i) + 1 as next from keys group by base) k
+    where c.base = k.base
+)
+insert into public.entry
+select (jsonb_populate_record(null::public.entry,
+    (i.obj - 'ID') || jsonb_build_object('id', k.id))).*
+from _import i
+join keys k on k.n = i.n
+order by i.n;
+get diagnostics inserted = row_count;
+return inserted;
+end;
+$_$;
+
+commit;
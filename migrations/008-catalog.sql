@@ -0,0 +1,114 @@
+-- a local catalog (e.g. a dump of open library), loaded with
+-- `retrolire catalog FILE`, where the isbns and dois are looked up
+-- before fetching them.
+
+begin;
+
+create table if not exists public.catalog (
+    key text primary key,
+    obj jsonb not null
+);
+
+CREATE OR REPLACE FUNCTION public.normalize_isbn(text) RETURNS text
+    LANGUAGE sql IMMUTABLE
+    AS $_$
+-- an isbn with only its digits (and X), as an isbn-13 (an isbn-10
+-- gets the prefix 978 and a new check digit). null if it's not an
+-- isbn.
+select case
+    when d ~ '^\d{13}$' then d
+    when d ~ '^\d{9}[\dX]$' then '978' || left(d, 9) || ((10 - (
+        select sum(substr('978' || left(d, 9), i, 1)::integer
+            * case when i % 2 = 0 then 3 else 1 end)
+        from generate_series(1, 12) i
+    ) % 10) % 10)::text
+end
+from (select regexp_replace(upper($1), '[^0-9X]', '', 'g') as d) x;
+$_$;
+
+CREATE OR REPLACE FUNCTION public.catalog_key(method text, identifier text) RETURNS text
+    LANGUAGE sql IMMUTABLE
+    AS $_$
+-- the key of an identifier in the catalog (as fetchref normalizes
+-- it for its cache): 'doi:' and the lowercased doi, without its
+-- prefix, or 'isbn:' and the isbn-13. null if it's not valid.
+select case $1
+    when 'doi' then 'doi:' || nullif(lower(regexp_replace(trim($2),
+        '^(doi:|https?://(dx\.)?doi\.org/)', '', 'i')), '')
+    when 'isbn' then 'isbn:' || public.normalize_isbn($2)
+end;
+$_$;
+
+CREATE OR REPLACE FUNCTION public.catalog_keys(jsonb) RETURNS SETOF text
+    LANGUAGE sql IMMUTABLE
+    AS $_$
+-- the keys of a record of a catalog dump: its isbns (isbn_10 and
+-- isbn_13 of open library, or ISBN of csl-json, maybe a list) and
+-- its doi.
+select distinct k from (
+    select public.catalog_key('isbn', i) as k
+    from jsonb_array_elements_text(
+        case when jsonb_typeof($1->'isbn_13') = 'array'
+        then $1->'isbn_13' else '[]' end
+        || case when jsonb_typeof($1->'isbn_10') = 'array'
+        then $1->'isbn_10' else '[]' end
+    ) i
+    union all
+    select public.catalog_key('isbn', i)
+    from regexp_split_to_table(coalesce($1->>'ISBN', ''), '[,;]') i
+    union all
+    select public.catalog_key('doi', $1->>'DOI')
+) x
+where k is not null;
+$_$;
+
+CREATE OR REPLACE FUNCTION public.catalog_csl(jsonb) RETURNS jsonb
+    LANGUAGE sql IMMUTABLE
+    AS $_$
+-- a record of a catalog dump as a csl-json object: a csl-json record
+-- (its type is a string) is kept as it is, and an open library
+-- edition (its type is {"key": "/type/edition"}) is converted.
+select case when jsonb_typeof($1->'type') = 'string' then $1
+else jsonb_strip_nulls(jsonb_build_object(
+    'type', 'book',
+    'title', nullif(concat_ws(': ', $1->>'title', $1->>'subtitle'), ''),
+    'author', case when $1 ? 'by_statement' then jsonb_build_array(
+        jsonb_build_object('literal', $1->>'by_statement')) end,
+    'publisher', $1->'publishers'->>0,
+    'publisher-place', $1->'publish_places'->>0,
+    'collection-title', $1->'series'->>0,
+    'edition', $1->>'edition_name',
+    'number-of-pages', $1->>'number_of_pages',
+    'ISBN', coalesce($1->'isbn_13'->>0, $1->'isbn_10'->>0),
+    'issued', (
+        select jsonb_build_object('date-parts',
+            jsonb_build_array(jsonb_build_array(y::integer)))
+        from substring($1->>'publish_date' from '\d{4}') y
+        where y is not null
+    )
+)) end;
+$_$;
+
+CREATE OR REPLACE FUNCTION public.load_catalog() RETURNS integer
+    LANGUAGE plpgsql
+    AS $$
+-- load the records of a catalog dump, copied into the temporary
+-- table _catalog (n, obj) by the client (see src/catalog.c), into
+-- the table catalog: a record is stored once for each of its keys,
+-- and replaces the one that had the same key (as does a later line
+-- of the dump). returns the number of keys loaded.
+declare
+    loaded integer;
+begin
+insert into public.catalog (key, obj)
+select distinct on (k.key) k.key, public.catalog_csl(c.obj)
+from _catalog c, public.catalog_keys(c.obj) k(key)
+where jsonb_typeof(c.obj) = 'object'
+order by k.key, c.n desc
+on conflict (key) do update set obj = excluded.obj;
+get diagnostics loaded = row_count;
+return loaded;
+end;
+$$;
+
+commit;
@@ -16,6 +16,98 @@ SET xmloption = content;
 SET client_min_messages = warning;
 SET row_security = off;
 
+--
+-- Name: pg_trgm; Type: EXTENSION; Schema: -; Owner: -
+--
+
+CREATE EXTENSION IF NOT EXISTS pg_trgm WITH SCHEMA public;
+
+
+--
+-- Name: EXTENSION pg_trgm; Type: COMMENT; Schema: -; Owner: -
+--
+
+COMMENT ON EXTENSION pg_trgm IS 'text similarity measurement and index searching based on trigrams';
+
+
+--
+-- Name: catalog_csl(jsonb); Type: FUNCTION; Schema: public; Owner: -
+--
+
+CREATE FUNCTION public.catalog_csl(jsonb) RETURNS jsonb
+    LANGUAGE sql IMMUTABLE
+    AS $_$
+-- a record of a catalog dump as a csl-json object: a csl-json record
+-- (its type is a string) is kept as it is, and an open library
+-- edition (its type is {"key": "/type/edition"}) is converted.
+select case when jsonb_typeof($1->'type') = 'string' then $1
+else jsonb_strip_nulls(jsonb_build_object(
+    'type', 'book',
+    'title', nullif(concat_ws(': ', $1->>'title', $1->>'subtitle'), ''),
+    'author', case when $1 ? 'by_statement' then jsonb_build_array(
+        jsonb_build_object('literal', $1->>'by_statement')) end,
+    'publisher', $1->'publishers'->>0,
+    'publisher-place', $1->'publish_places'->>0,
+    'collection-title', $1->'series'->>0,
+    'edition', $1->>'edition_name',
+    'number-of-pages', $1->>'number_of_pages',
+    'ISBN', coalesce($1->'isbn_13'->>0, $1->'isbn_10'->>0),
+    'issued', (
+        select jsonb_build_object('date-parts',
+            jsonb_build_array(jsonb_build_array(y::integer)))
+        from substring($1->>'publish_date' from '\d{4}') y
+        where y is not null
+    )
+)) end;
+$_$;
+
+
+--
+-- Name: catalog_key(text, text); Type: FUNCTION; Schema: public; Owner: -
+--
+
+CREATE FUNCTION public.catalog_key(method text, identifier text) RETURNS text
+    LANGUAGE sql IMMUTABLE
+    AS $_$
+-- the key of an identifier in the catalog (as fetchref normalizes
+-- it for its cache): 'doi:' and the lowercased doi, without its
+-- prefix, or 'isbn:' and the isbn-13. null if it's not valid.
+select case $1
+    when 'doi' then 'doi:' || nullif(lower(regexp_replace(trim($2),
+        '^(doi:|https?://(dx\.)?doi\.org/)', '', 'i')), '')
+    when 'isbn' then 'isbn:' || public.normalize_isbn($2)
+end;
+$_$;
+
+
+--
+-- Name: catalog_keys(jsonb); Type: FUNCTION; Schema: public; Owner: -
+--
+
+CREATE FUNCTION public.catalog_keys(jsonb) RETURNS SETOF text
+    LANGUAGE sql IMMUTABLE
+    AS $_$
+-- the keys of a record of a catalog dump: its isbns (isbn_10 and
+-- isbn_13 of open library, or ISBN of csl-json, maybe a list) and
+-- its doi.
+select distinct k from (
+    select public.catalog_key('isbn', i) as k
+    from jsonb_array_elements_text(
+        case when jsonb_typeof($1->'isbn_13') = 'array'
+        then $1->'isbn_13' else '[]' end
+        || case when jsonb_typeof($1->'isbn_10') = 'array'
+        then $1->'isbn_10' else '[]' end
+    ) i
+    union all
+    select public.catalog_key('isbn', i)
+    from regexp_split_to_table(coalesce($1->>'ISBN', ''), '[,;]') i
+    union all
+    select public.catalog_key('doi', $1->>'DOI')
+) x
+where k is not null;
+$_$;
+
+
 --
 -- Name: cite_concept(integer); Type: FUNCTION; Schema: public; Owner: -
 --
@@ -33,6 +125,67 @@ from concept where id = $1
 $_$;
 
 
+--
+-- Name: citekey_base(jsonb); Type: FUNCTION; Schema: public; Owner: -
+--
+
+CREATE FUNCTION public.citekey_base(jsonb) RETURNS text
+    LANGUAGE sql IMMUTABLE
+    AS $_$
+-- the citation key of a csl-json entry, without its suffix: a name
+-- (of the first person, or else the publisher, the collection or the
+-- title), only made of lowercase word characters (15 at most), and
+-- a year. an entry with neither name nor year gets 'entry'.
+select coalesce(nullif(
+    coalesce(left(lower(regexp_replace(coalesce(
+        (select coalesce(x.p->>'family', x.p->>'literal', x.p->>'given')
+        from (select coalesce(
+            nullif($1->'author', '[]'),
+            nullif($1->'editor', '[]'),
+            nullif($1->'translator', '[]')
+        )->0 as p) x),
+        nullif($1->>'publisher', ''),
+        nullif($1->>'collection-title', ''),
+        nullif($1->>'title', '')
+    ), '\W+', '', 'g')), 15), '')
+    || coalesce(
+        $1->'issued'->'date-parts'->0->>0,
+        $1->'accessed'->'date-parts'->0->>0,
+        ''
+    ), ''), 'entry');
+$_$;
+
+
+--
+-- Name: citekey_suffix(integer); Type: FUNCTION; Schema: public; Owner: -
+--
+
+CREATE FUNCTION public.citekey_suffix(integer) RETURNS text
+    LANGUAGE plpgsql IMMUTABLE
+    AS $_$
+-- the suffix number $1 of a citation key, to make it unique: '' (0),
+-- then 'a' to 'z', 'aa' to 'zz', 'aaa'...
+declare
+    j integer := $1 - 1;
+    len integer := 1;
+    s text := '';
+begin
+if $1 <= 0 then
+    return '';
+end if;
+while j >= 26 ^ len loop
+    j := j - (26 ^ len)::integer;
+    len := len + 1;
+end loop;
+for i in 1..len loop
+    s := chr(97 + j % 26) || s;
+    j := j / 26;
+end loop;
+return s;
+end;
+$_$;
+
+
 --
 -- Name: field_exists(text); Type: FUNCTION; Schema: public; Owner: -
 --
@@ -170,6 +323,99 @@ from tag t where t.entry = $1.id;
 $_$;
 
 
+--
+-- Name: import_entries(); Type: FUNCTION; Schema: public; Owner: -
+--
+
+CREATE FUNCTION public.import_entries() RETURNS integer
+    LANGUAGE plpgsql
+    AS $_$
+-- insert the csl-json entries copied into the temporary table
+-- _import (n, obj) by the client (see src/csljson.c): the fields
+-- that are not yet columns of entry are added, and every entry gets
+-- a unique citation key. returns the number of entries inserted.
+declare
+    field record;
+    inserted integer;
+begin
+for field in
+    select distinct on (x.key) x.key, x.value
+    from _import i, jsonb_each(jsonb_strip_nulls(i.obj)) x
+    where x.key <> 'ID'
+    and not exists (
+        select 1 from information_schema.columns c
+        where c.table_schema = 'public'
+        and c.table_name = 'entry'
+        and c.column_name = x.key
+    )
+    order by x.key, i.n
+loop
+    execute format('alter table public.entry add column %I %s',
+        field.key,
+        case jsonb_typeof(field.value)
+            when 'string' then 'text'
+            when 'number' then
+                case when field.value::text ~ '^-?\d+$' then 'int'
+                else 'float' end
+            when 'boolean' then 'boolean'
+            else 'jsonb'
+        end);
+end loop;
+-- the citation keys: the counter of each base (name and year) of
+-- the batch is locked (or created), so that concurrent imports
+-- can't give the same key. the k-th entry with a given base then
+-- takes the k-th free suffix from that counter (the keys are only
+-- looked up in the index, never loaded).
+insert into public.citekey_counter as c (base)
+select distinct citekey_base(i.obj) from _import i
+order by 1
+on conflict (base) do update set next = c.next;
+with named as (
+    select i.n, citekey_base(i.obj) as base from _import i
+), ranked as (
+    select x.n, x.base,
+        row_number() over (partition by x.base order by x.n) as k
+    from named x
+), bases as (
+    select x.base, count(*) as batch, c.next,
+        -- the keys that may already use a suffix of that base.
+        (select count(*) from public.entry e
+        where e.id collate "C" >= x.base
+        and e.id collate "C" < x.base || '{') as taken
+    from named x
+    join public.citekey_counter c on c.base = x.base
+    group by x.base, c.next
+), free as (
+    select b.base, s.i, b.base || citekey_suffix(s.i) as id,
+        row_number() over (partition by b.base order by s.i) as k
+    from bases b,
+    generate_series(b.next, b.next + (b.batch + b.taken)::integer)
+        as s(i)
+    where not exists (
+        select 1 from public.entry e
+        where e.id = b.base || citekey_suffix(s.i)
+    )
+), keys as (
+    select r.n, f.base, f.i, f.id
+    from ranked r
+    join free f on f.base = r.base and f.k = r.k
+), counted as (
+    update public.citekey_counter c set next = k.next
+    from (select base, max(i) + 1 as next from keys group by base) k
+    where c.base = k.base
+)
+insert into public.entry
+select (jsonb_populate_record(null::public.entry,
+    (i.obj - 'ID') || jsonb_build_object('id', k.id))).*
+from _import i
+join keys k on k.n = i.n
+order by i.n;
+get diagnostics inserted = row_count;
+return inserted;
+end;
+$_$;
+
+
 --
 -- Name: jsonb_array_concat(jsonb, text); Type: FUNCTION; Schema: public; Owner: -
 --
@@ -213,58 +459,116 @@ $$;
 
 
 --
--- Name: move_reading_fields(); Type: FUNCTION; Schema: public; Owner: -
+-- Name: load_catalog(); Type: FUNCTION; Schema: public; Owner: -
 --
 
-CREATE FUNCTION public.move_reading_fields() RETURNS trigger
+CREATE FUNCTION public.load_catalog() RETURNS integer
     LANGUAGE plpgsql
     AS $$
+-- load the records of a catalog dump, copied into the temporary
+-- table _catalog (n, obj) by the client (see src/catalog.c), into
+-- the table catalog: a record is stored once for each of its keys,
+-- and replaces the one that had the same key (as does a later line
+-- of the dump). returns the number of keys loaded.
+declare
+    loaded integer;
 begin
-perform move_things();
-return new;
+insert into public.catalog (key, obj)
+select distinct on (k.key) k.key, public.catalog_csl(c.obj)
+from _catalog c, public.catalog_keys(c.obj) k(key)
+where jsonb_typeof(c.obj) = 'object'
+order by k.key, c.n desc
+on conflict (key) do update set obj = excluded.obj;
+get diagnostics loaded = row_count;
+return loaded;
 end;
 $$;
 
 
 --
--- Name: move_things(); Type: FUNCTION; Schema: public; Owner: -
+-- Name: move_reading_fields(); Type: FUNCTION; Schema: public; Owner: -
 --
 
-CREATE FUNCTION public.move_things() RETURNS void
-    LANGUAGE sql
-    AS $$;
--- insert a reading for every entry.
-insert into reading (id) select id from entry on conflict do nothing;;
+CREATE FUNCTION public.move_reading_fields() RETURNS trigger
+    LANGUAGE plpgsql
+    AS $$
+begin
+-- only the rows inserted by the statement (the transition table
+-- new_entries) are read and updated, so that an import does not
+-- touch the rest of the library.
+-- insert a reading for every new entry.
+insert into reading (id) select id from new_entries
+on conflict do nothing;
 -- move keyword to table tag
 insert into tag (entry, tag)
-    select e.id,
+    select n.id,
     unnest(string_to_array(
-            regexp_replace(e.keyword, '\s+', '', 'g'), ','
+            regexp_replace(n.keyword, '\s+', '', 'g'), ','
     ))
-from entry e
-where e.keyword is not null
-on conflict do nothing;;
+from new_entries n
+where n.keyword is not null
+on conflict do nothing;
 -- move reading notes (annote)
-update reading r set notes = e.annote
-from entry e where e.id = r.id
-and e.annote is not null;;
--- mote abstract
-update reading r set abstract = e.abstract
-from entry e where e.id = r.id
-and e.abstract is not null;;
+update reading r set notes = n.annote
+from new_entries n where n.id = r.id
+and n.annote is not null;
+-- move abstract
+update reading r set abstract = n.abstract
+from new_entries n where n.id = r.id
+and n.abstract is not null;
 -- move filepath
 insert into file (entry, filepath)
-select id, file from entry
+select id, file from new_entries
 where file is not null
 on conflict do nothing;
--- delete values from entry:
-update entry set keyword = null;;
-update entry set abstract = null;;
-update entry set annote = null;;
-update entry set file = null;;
+-- delete values from entry (in one update, only for the new rows
+-- that had one).
+update entry e
+set keyword = null, abstract = null, annote = null, file = null
+from new_entries n
+where n.id = e.id
+and (n.keyword is not null or n.abstract is not null
+    or n.annote is not null or n.file is not null);
+return null;
+end;
 $$;
 
 
+--
+-- Name: normalize_isbn(text); Type: FUNCTION; Schema: public; Owner: -
+--
+
+CREATE FUNCTION public.normalize_isbn(text) RETURNS text
+    LANGUAGE sql IMMUTABLE
+    AS $_$
+-- an isbn with only its digits (and X), as an isbn-13 (an isbn-10
+-- gets the prefix 978 and a new check digit). null if it's not an
+-- isbn.
+select case
+    when d ~ '^\d{13}$' then d
+    when d ~ '^\d{9}[\dX]$' then '978' || left(d, 9) || ((10 - (
+        select sum(substr('978' || left(d, 9), i, 1)::integer
+            * case when i % 2 = 0 then 3 else 1 end)
+        from generate_series(1, 12) i
+    ) % 10) % 10)::text
+end
+from (select regexp_replace(upper($1), '[^0-9X]', '', 'g') as d) x;
+$_$;
+
+
+--
+-- Name: note_hash(text[]); Type: FUNCTION; Schema: public; Owner: -
+--
+
+CREATE FUNCTION public.note_hash(VARIADIC text[]) RETURNS uuid
+    LANGUAGE sql IMMUTABLE
+    AS $_$
+-- content hash of an item parsed from the notes (a quote or a
+-- concept), used by parse_note() to find the items that changed.
+select md5(array_to_string($1, E'\x1f', ''))::uuid;
+$_$;
+
+
 --
 -- Name: parse_note(); Type: FUNCTION; Schema: public; Owner: -
 --
@@ -273,19 +577,26 @@ CREATE FUNCTION public.parse_note() RETURNS trigger
     LANGUAGE plpgsql
     AS $$
 begin
-    -- quotes
-delete from quote
-where entry = new.id;
-insert into quote (entry, quote, page)
-select new.id, (get_quotes(new.notes)).*
-except
-select entry, quote, page from quote
-where quote.entry = new.id
-on conflict do nothing;
-    -- concepts
-delete from concept where entry = new.id;
-insert into concept (entry, name, definition, page)
-select new.id, (get_concepts(new.notes)).*;
+if tg_op = 'UPDATE' and new.notes is not distinct from old.notes then
+    return new;
+end if;
+-- the client may have parsed the notes itself (see src/notes.c), and
+-- sent the items with set_note_items() in the same transaction.
+if current_setting('retrolire.parsed', true) = 'on' then
+    return new;
+end if;
+perform set_note_items(new.id,
+    q.quotes, q.pages, c.concepts, c.definitions, c.pages)
+from (
+    select array_agg(x.quote) as quotes,
+        array_agg(x.page_number) as pages
+    from get_quotes(new.notes) x
+) q, (
+    select array_agg(x.concept) as concepts,
+        array_agg(x.definition) as definitions,
+        array_agg(x.page) as pages
+    from get_concepts(new.notes) x
+) c;
     -- returns row
 return new;
 end;
@@ -302,7 +613,8 @@ CREATE TABLE public.quote (
     quote text NOT NULL,
     page text,
     note text,
-    context text
+    context text,
+    hash uuid GENERATED ALWAYS AS (public.note_hash(VARIADIC ARRAY[quote, page])) STORED
 );
 
 
@@ -371,6 +683,54 @@ from entry e where e.id = $1
 $_$;
 
 
+--
+-- Name: set_note_items(text, text[], text[], text[], text[], text[]); Type: FUNCTION; Schema: public; Owner: -
+--
+
+CREATE FUNCTION public.set_note_items(text, text[], text[], text[], text[], text[]) RETURNS void
+    LANGUAGE sql
+    AS $_$
+-- set the quotes ($2, with their pages $3) and the concepts ($4,
+-- with their definitions $5 and pages $6) parsed from the notes of
+-- the entry $1. the items are compared by content hash with the
+-- existing rows: only the ones that are gone are deleted, and only
+-- the new ones are inserted (so that the others keep their id, note
+-- and context).
+with parsed as (
+    select distinct p.quote, p.page,
+        note_hash(p.quote, p.page) as hash
+    from unnest($2, $3) as p(quote, page)
+), gone as (
+    delete from quote x
+    where x.entry = $1
+    and not exists (select 1 from parsed p where p.hash = x.hash)
+)
+insert into quote (entry, quote, page)
+select $1, p.quote, p.page
+from parsed p
+where not exists (
+    select 1 from quote x
+    where x.entry = $1 and x.hash = p.hash
+);
+with parsed as (
+    select distinct p.concept, p.definition, p.page,
+        note_hash(p.concept, p.definition, p.page) as hash
+    from unnest($4, $5, $6) as p(concept, definition, page)
+), gone as (
+    delete from concept x
+    where x.entry = $1
+    and not exists (select 1 from parsed p where p.hash = x.hash)
+)
+insert into concept (entry, name, definition, page)
+select $1, p.concept, p.definition, p.page
+from parsed p
+where not exists (
+    select 1 from concept x
+    where x.entry = $1 and x.hash = p.hash
+);
+$_$;
+
+
 --
 -- Name: split_quote_page_number(text); Type: FUNCTION; Schema: public; Owner: -
 --
@@ -450,6 +810,26 @@ CREATE VIEW public._quote AS
    FROM public.quote q;
 
 
+--
+-- Name: catalog; Type: TABLE; Schema: public; Owner: -
+--
+
+CREATE TABLE public.catalog (
+    key text NOT NULL,
+    obj jsonb NOT NULL
+);
+
+
+--
+-- Name: citekey_counter; Type: TABLE; Schema: public; Owner: -
+--
+
+CREATE TABLE public.citekey_counter (
+    base text NOT NULL,
+    next integer DEFAULT 0 NOT NULL
+);
+
+
 --
 -- Name: concept; Type: TABLE; Schema: public; Owner: -
 --
@@ -459,7 +839,8 @@ CREATE TABLE public.concept (
     entry text NOT NULL,
     name text NOT NULL,
     definition text,
-    page text
+    page text,
+    hash uuid GENERATED ALWAYS AS (public.note_hash(VARIADIC ARRAY[name, definition, page])) STORED
 );
 
 
@@ -526,7 +907,8 @@ CREATE TABLE public.reading (
     id text NOT NULL,
     notes text,
     abstract text,
-    lastedit timestamp without time zone DEFAULT now() NOT NULL
+    lastedit timestamp without time zone DEFAULT now() NOT NULL,
+    notes_tsv tsvector GENERATED ALWAYS AS (to_tsvector('simple'::regconfig, COALESCE(notes, ''::text))) STORED
 );
 
 
@@ -576,6 +958,22 @@ ALTER TABLE ONLY public._cache
     ADD CONSTRAINT _cache_id_key UNIQUE (id);
 
 
+--
+-- Name: catalog catalog_pkey; Type: CONSTRAINT; Schema: public; Owner: -
+--
+
+ALTER TABLE ONLY public.catalog
+    ADD CONSTRAINT catalog_pkey PRIMARY KEY (key);
+
+
+--
+-- Name: citekey_counter citekey_counter_pkey; Type: CONSTRAINT; Schema: public; Owner: -
+--
+
+ALTER TABLE ONLY public.citekey_counter
+    ADD CONSTRAINT citekey_counter_pkey PRIMARY KEY (base);
+
+
 --
 -- Name: concept concept_pkey; Type: CONSTRAINT; Schema: public; Owner: -
 --
@@ -648,6 +1046,48 @@ ALTER TABLE ONLY public.tag
     ADD CONSTRAINT tag_entry_tag_key UNIQUE (entry, tag);
 
 
+--
+-- Name: concept_entry_hash_idx; Type: INDEX; Schema: public; Owner: -
+--
+
+CREATE INDEX concept_entry_hash_idx ON public.concept USING btree (entry, hash);
+
+
+--
+-- Name: concept_name_trgm_idx; Type: INDEX; Schema: public; Owner: -
+--
+
+CREATE INDEX concept_name_trgm_idx ON public.concept USING gin (name public.gin_trgm_ops);
+
+
+--
+-- Name: entry_author_trgm_idx; Type: INDEX; Schema: public; Owner: -
+--
+
+CREATE INDEX entry_author_trgm_idx ON public.entry USING gin (((author)::text) public.gin_trgm_ops);
+
+
+--
+-- Name: entry_container_title_trgm_idx; Type: INDEX; Schema: public; Owner: -
+--
+
+CREATE INDEX entry_container_title_trgm_idx ON public.entry USING gin ("container-title" public.gin_trgm_ops);
+
+
+--
+-- Name: entry_editor_trgm_idx; Type: INDEX; Schema: public; Owner: -
+--
+
+CREATE INDEX entry_editor_trgm_idx ON public.entry USING gin (((editor)::text) public.gin_trgm_ops);
+
+
+--
+-- Name: entry_id_c_idx; Type: INDEX; Schema: public; Owner: -
+--
+
+CREATE INDEX entry_id_c_idx ON public.entry USING btree (id COLLATE "C");
+
+
 --
 -- Name: entry_publisher_idx; Type: INDEX; Schema: public; Owner: -
 --
@@ -655,6 +1095,13 @@ ALTER TABLE ONLY public.tag
 CREATE INDEX entry_publisher_idx ON public.entry USING btree (publisher);
 
 
+--
+-- Name: entry_publisher_trgm_idx; Type: INDEX; Schema: public; Owner: -
+--
+
+CREATE INDEX entry_publisher_trgm_idx ON public.entry USING gin (publisher public.gin_trgm_ops);
+
+
 --
 -- Name: entry_title_idx; Type: INDEX; Schema: public; Owner: -
 --
@@ -662,6 +1109,20 @@ CREATE INDEX entry_publisher_idx ON public.entry USING btree (publisher);
 CREATE INDEX entry_title_idx ON public.entry USING btree (title);
 
 
+--
+-- Name: entry_title_trgm_idx; Type: INDEX; Schema: public; Owner: -
+--
+
+CREATE INDEX entry_title_trgm_idx ON public.entry USING gin (title public.gin_trgm_ops);
+
+
+--
+-- Name: entry_translator_trgm_idx; Type: INDEX; Schema: public; Owner: -
+--
+
+CREATE INDEX entry_translator_trgm_idx ON public.entry USING gin (((translator)::text) public.gin_trgm_ops);
+
+
 --
 -- Name: file_entry_idx; Type: INDEX; Schema: public; Owner: -
 --
@@ -676,6 +1137,13 @@ CREATE INDEX file_entry_idx ON public.file USING btree (entry);
 CREATE INDEX file_filepath_idx ON public.file USING btree (filepath);
 
 
+--
+-- Name: quote_entry_hash_idx; Type: INDEX; Schema: public; Owner: -
+--
+
+CREATE INDEX quote_entry_hash_idx ON public.quote USING btree (entry, hash);
+
+
 --
 -- Name: quote_entry_idx; Type: INDEX; Schema: public; Owner: -
 --
@@ -683,6 +1151,13 @@ CREATE INDEX file_filepath_idx ON public.file USING btree (filepath);
 CREATE INDEX quote_entry_idx ON public.quote USING btree (entry);
 
 
+--
+-- Name: quote_quote_trgm_idx; Type: INDEX; Schema: public; Owner: -
+--
+
+CREATE INDEX quote_quote_trgm_idx ON public.quote USING gin (quote public.gin_trgm_ops);
+
+
 --
 -- Name: reading_id_idx; Type: INDEX; Schema: public; Owner: -
 --
@@ -697,6 +1172,13 @@ CREATE INDEX reading_id_idx ON public.reading USING btree (id);
 CREATE INDEX reading_lastedit_idx ON public.reading USING btree (lastedit);
 
 
+--
+-- Name: reading_notes_tsv_idx; Type: INDEX; Schema: public; Owner: -
+--
+
+CREATE INDEX reading_notes_tsv_idx ON public.reading USING gin (notes_tsv);
+
+
 --
 -- Name: relation_objet_idx; Type: INDEX; Schema: public; Owner: -
 --
@@ -736,7 +1218,7 @@ CREATE INDEX tag_tag_idx ON public.tag USING btree (tag);
 -- Name: entry move_fields; Type: TRIGGER; Schema: public; Owner: -
 --
 
-CREATE TRIGGER move_fields AFTER INSERT ON public.entry FOR EACH STATEMENT EXECUTE FUNCTION public.move_reading_fields();
+CREATE TRIGGER move_fields AFTER INSERT ON public.entry REFERENCING NEW TABLE AS new_entries FOR EACH STATEMENT EXECUTE FUNCTION public.move_reading_fields();
 
 
 --
@@ -4,53 +4,27 @@
 #include <unistd.h>
 #include <wait.h>
 
-#include "../config.h"
+#include "bibtex.h"
+#include "catalog.h"
+#include "csljson.h"
 #include "edit.h"
+#include "util.h"
 
 #include "add_entries.h"
 
 int
 command_add_json(char* filepath, int remove_file)
 {
+  // import the file with a COPY into a temporary table (see
+  // csljson.h)
+  int ok = import_csljson(filepath);
 
-  // the subprocess command
-  char* csl2psql[] = { "csl2psql",
-    filepath,
-    (char*)connectioninfo,
-    "-t",
-    "entry",
-    "-T",
-    "_entry",
-    NULL };
-
-  // fork
-  pid_t pid = fork();
-
-  // error if fork fails
-  if (pid == -1) {
-    perror("fork");
-    if (remove_file) {
-      remove(filepath);
-    }
-    return 0;
-  }
-
-  // subprocess
-  if (pid == 0) {
-    execvp(csl2psql[0], csl2psql);
+  // remove the file
+  if (remove_file) {
+    remove(filepath);
   }
 
-  else {
-    // wait for the subprocess to end
-    wait(NULL);
-
-    // remove the file
-    if (remove_file) {
-      remove(filepath);
-    }
-  }
-
-  return 1;
+  return ok;
 }
 
 int
@@ -63,95 +37,72 @@ command_add_bibtex(char* filepath, int remove_file)
     return 0;
   }
 
-  // the pandoc command to convert the bibtex into a csl-json
-  char* bibtex2json[] = { "pandoc",
-    "-i",
-    filepath,
-    "-o",
-    tmp_filepath,
-    "-f",
-    "bibtex",
-    "-t",
-    "csljson",
-    NULL };
-
-  // fork
-  pid_t pid = fork();
-
-  // error if fork fails
-  if (pid == -1) {
+  // convert the bibtex into a csl-json (see bibtex.h)
+  if (!bibtex_to_csljson(filepath, tmp_filepath)) {
     // remove both files on error
     remove(tmp_filepath);
     if (remove_file) {
       remove(filepath);
     }
-    perror("fork");
     return 0;
   }
 
-  // subprocess
-  if (pid == 0) {
-    execvp(bibtex2json[0], bibtex2json);
-    exit(EXIT_SUCCESS);
-  }
-
-  else {
-
-    // wait for the subprocess to check its status
-    int status;
-    if (waitpid(pid, &status, 0) < 0) {
-      remove(tmp_filepath);
-      perror("wait");
-      exit(254);
-    }
-
-    // check the exit status from the previous command.
-    if (WIFEXITED(status)) {
-      // get the status of the subprocess.
-      int sub_status = WEXITSTATUS(status);
-      if (sub_status == 1) {
-        // if the exit status is 1 (fail), exit the program.
-        fputs("error: cancelled.\n", stderr);
-        remove(tmp_filepath);
-        exit(EXIT_FAILURE);
-      }
-    }
-
-    // edit the JSON file
-    edit_file(tmp_filepath);
+  // edit the JSON file
+  edit_file(tmp_filepath);
 
-    // add the CSL-JSON file in the database, using csl2psql
-    command_add_json(tmp_filepath, 1);
+  // add the CSL-JSON file in the database (see csljson.h)
+  int ok = command_add_json(tmp_filepath, 1);
 
-    // remove the file
-    if (remove_file) {
-      remove(filepath);
-    }
+  // remove the file
+  if (remove_file) {
+    remove(filepath);
   }
 
-  return 1;
+  return ok;
 }
 
-int
-command_add_isbn(char* isbn)
+/* read the identifiers: a single one, or a file listing them ("-"
+ * for stdin). */
+static int
+read_ids(char* identifier, int is_list, struct Buf* ids)
 {
-
-  // create a temporary file
-  char tmp_filepath[] = "/tmp/retrolire.XXXXXX.json";
-  if (mkstemps(tmp_filepath, 5) == -1) {
-    fputs("error creating temporary file.\n", stderr);
+  if (!is_list)
+    return buf_cat(ids, identifier, strlen(identifier))
+           && buf_cat(ids, "\n", 1);
+  FILE* f =
+    strcmp(identifier, "-") == 0 ? stdin : fopen(identifier, "r");
+  if (!f) {
+    fprintf(stderr, "error opening file: %s\n", identifier);
     return 0;
   }
+  char chunk[4096];
+  size_t n;
+  int ok = buf_cat(ids, "", 0);
+  while (ok && (n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    ok = buf_cat(ids, chunk, n);
+  if (f != stdin)
+    fclose(f);
+  return ok;
+}
 
-  // get the metadata using the ISBN and the list of isbn services
-  // defined in config.h. write the result in the temporary file.
+/* fetch the references of the identifiers listed in list_path with
+ * fetchref, all at the same time, into the bibtex file bib_path.
+ * returns 0 if none was found. */
+static int
+run_fetchref(char* method, char* list_path, char* bib_path)
+{
+
+  // get the metadata using the identifiers (and the list of isbn
+  // services defined in config.h). write the result in the bibtex
+  // file.
   char* cmd[] = { "fetchref",
-    "isbn",
-    isbn,
+    method,
+    "--file",
+    list_path,
     "--services",
     isbn_services,
     "-o",
-    tmp_filepath,
+    bib_path,
     NULL };
 
   // fork
@@ -166,97 +117,110 @@ command_add_isbn(char* isbn)
   // subprocess
   if (pid == 0) {
     execvp(cmd[0], cmd);
-    exit(EXIT_SUCCESS);
+    perror("fetchref");
+    exit(EXIT_FAILURE);
   }
 
-  else {
-
-    // wait for the subprocess to check its status
-    int status;
-    if (waitpid(pid, &status, 0) < 0) {
-      remove(tmp_filepath);
-      perror("wait");
-      exit(254);
-    }
-
-    // check the exit status from the previous command.
-    if (WIFEXITED(status)) {
-      // get the status of the subprocess.
-      int sub_status = WEXITSTATUS(status);
-      if (sub_status == 1) {
-        // if the exit status is 1 (fail), exit the program.
-        fputs("error: cancelled.\n", stderr);
-        remove(tmp_filepath);
-        exit(EXIT_FAILURE);
-      }
-    }
-
-    // add the generated bibtex file to the database.
-    command_add_bibtex(tmp_filepath, 1);
+  // wait for the subprocess to check its status
+  int status;
+  if (waitpid(pid, &status, 0) < 0) {
+    perror("wait");
+    return 0;
   }
 
-  return 1;
+  // the exit status is 1 if no reference was found.
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
 }
 
-int
-command_add_doi(char* doi)
+/* get the references from identifiers (doi or isbn) and add them.
+ * the identifier may also be a file listing them, one by line ("-"
+ * for stdin). they are looked up in the local catalog (see
+ * catalog.h) first, and the others are fetched by fetchref, all at
+ * the same time. the references are then added in one transaction.
+ * */
+static int
+fetch_refs(char* method, char* identifier)
 {
-
-  // create a temporary file
-  char tmp_filepath[] = "/tmp/retrolire.XXXXXX.json";
-  if (mkstemps(tmp_filepath, 5) == -1) {
-    fputs("error creating temporary file.\n", stderr);
+  // a list of identifiers, or a single one.
+  int is_list = strcmp(identifier, "-") == 0
+                || access(identifier, R_OK) == 0;
+  struct Buf ids = { 0 };
+  if (!read_ids(identifier, is_list, &ids)) {
+    free(ids.s);
     return 0;
   }
 
-  // get the metadata using the ISBN and the list of isbn services
-  // defined in config.h. write the result in the temporary file.
-  char* cmd[] = {
-    "fetchref", "doi", doi, "-o", tmp_filepath, NULL
-  };
-
-  // fork
-  pid_t pid = fork();
-
-  // error if fork fails
-  if (pid == -1) {
-    remove(tmp_filepath);
-    perror("fork");
-    return 0;
+  // create the temporary files: the csl-json to add, and the list
+  // and the bibtex of fetchref.
+  char json_path[] = "/tmp/retrolire.XXXXXX.json";
+  char list_path[] = "/tmp/retrolire.XXXXXX.txt";
+  char bib_path[] = "/tmp/retrolire.XXXXXX.bib";
+  int fd_json = mkstemps(json_path, 5);
+  int fd_list = mkstemps(list_path, 4);
+  int fd_bib = mkstemps(bib_path, 4);
+  FILE* json = fd_json == -1 ? NULL : fdopen(fd_json, "w");
+  FILE* list = fd_list == -1 ? NULL : fdopen(fd_list, "w");
+  if (fd_bib != -1)
+    close(fd_bib);
+  int found = -1;
+  if (!json || !list || fd_bib == -1) {
+    fputs("error creating temporary file.\n", stderr);
+  } else {
+
+    // look them up in the catalog.
+    struct Buf missing = { 0 };
+    fputs("[\n", json);
+    found = catalog_lookup(method, ids.s, json, &missing);
+
+    // and fetch the others.
+    if (found != -1 && missing.len > 0) {
+      fwrite(missing.s, 1, missing.len, list);
+      fflush(list);
+      if (run_fetchref(method, list_path, bib_path)) {
+        if (found > 0)
+          fputs(",\n", json);
+        int fetched = bibtex_write_objects(bib_path, json);
+        found = fetched == -1 ? -1 : found + fetched;
+      }
+    }
+    fputs("\n]\n", json);
+    free(missing.s);
   }
-
-  // subprocess
-  if (pid == 0) {
-    execvp(cmd[0], cmd);
+  free(ids.s);
+  if (json)
+    fclose(json);
+  if (list)
+    fclose(list);
+  remove(list_path);
+  remove(bib_path);
+
+  if (found <= 0) {
+    if (found == 0)
+      fputs("error: cancelled.\n", stderr);
+    remove(json_path);
+    return 0;
   }
 
-  else {
+  // the list was read from stdin: the editor gets the terminal.
+  if (strcmp(identifier, "-") == 0
+      && !freopen("/dev/tty", "r", stdin))
+    perror("/dev/tty");
 
-    // wait for the subprocess to check its status
-    int status;
-    if (waitpid(pid, &status, 0) < 0) {
-      remove(tmp_filepath);
-      perror("wait");
-      exit(254);
-    }
-
-    // check the exit status from the previous command.
-    if (WIFEXITED(status)) {
-      // get the status of the subprocess.
-      int sub_status = WEXITSTATUS(status);
-      if (sub_status == 1) {
-        // if the exit status is 1 (fail), exit the program.
-        fputs("error: cancelled.\n", stderr);
-        remove(tmp_filepath);
-        exit(EXIT_FAILURE);
-      }
-    }
+  // edit the JSON file, and add it to the database (see csljson.h)
+  edit_file(json_path);
+  return command_add_json(json_path, 1);
+}
 
-    // add the bibtex to the database.
-    command_add_bibtex(tmp_filepath, 1);
-  }
+int
+command_add_isbn(char* isbn)
+{
+  return fetch_refs("isbn", isbn);
+}
 
-  return 1;
+int
+command_add_doi(char* doi)
+{
+  return fetch_refs("doi", doi);
 }
 
 int
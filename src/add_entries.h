@@ -9,11 +9,11 @@
 int
 command_add_bibtex(char* filepath, int remove_file);
 
-// from a DOI
+// from a DOI, or a file listing DOIs ("-" for stdin)
 int
 command_add_doi(char* doi);
 
-// from an ISBN
+// from an ISBN, or a file listing ISBNs ("-" for stdin)
 int
 command_add_isbn(char* isbn);
 
@@ -0,0 +1,1185 @@
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bibtex.h"
+#include "util.h"
+
+/* the threads converting the entries: at most MAX_THREADS, with at
+ * least MIN_ENTRIES entries each. */
+#define MAX_THREADS 8
+#define MIN_ENTRIES 256
+/* the fields of an entry that are kept (the next ones are ignored).
+ * */
+#define MAX_FIELDS 64
+#define FIELD_NAME_SIZE 32
+
+/* a part of the mapped file. */
+struct Span
+{
+  const char* s;
+  size_t n;
+};
+
+/* a top-level entry: its type (article, book...) and its body (what
+ * is between its delimiters). */
+struct Piece
+{
+  struct Span type;
+  struct Span body;
+};
+
+/* the @string macros, with their values (already resolved). */
+struct Macro
+{
+  struct Span name;
+  struct Buf value;
+};
+
+struct Macros
+{
+  struct Macro* m;
+  size_t n;
+};
+
+/* a field of an entry: its name (lowercase) and its raw value (the
+ * parts of the value concatenated, with the braces they contain). */
+struct Field
+{
+  char name[FIELD_NAME_SIZE];
+  struct Buf raw;
+};
+
+/* the state of a thread: its entries, and its output. */
+struct Worker
+{
+  const struct Piece* pieces;
+  size_t n;
+  const struct Macros* macros;
+  struct Field fields[MAX_FIELDS];
+  int n_fields;
+  /* a buffer for the decoded values. */
+  struct Buf text;
+  struct Buf out;
+  int ok;
+  pthread_t thread;
+};
+
+/* the accents written with a command (\'e, \c{c}...), and the
+ * letters that have a precomposed character with it. */
+static const struct
+{
+  char accent;
+  char base;
+  const char* composed;
+} accents[] = {
+  { '\'', 'a', "á" }, { '\'', 'c', "ć" }, { '\'', 'e', "é" },
+  { '\'', 'i', "í" }, { '\'', 'l', "ĺ" }, { '\'', 'n', "ń" },
+  { '\'', 'o', "ó" }, { '\'', 'r', "ŕ" }, { '\'', 's', "ś" },
+  { '\'', 'u', "ú" }, { '\'', 'y', "ý" }, { '\'', 'z', "ź" },
+  { '\'', 'A', "Á" }, { '\'', 'C', "Ć" }, { '\'', 'E', "É" },
+  { '\'', 'I', "Í" }, { '\'', 'L', "Ĺ" }, { '\'', 'N', "Ń" },
+  { '\'', 'O', "Ó" }, { '\'', 'R', "Ŕ" }, { '\'', 'S', "Ś" },
+  { '\'', 'U', "Ú" }, { '\'', 'Y', "Ý" }, { '\'', 'Z', "Ź" },
+  { '`', 'a', "à" }, { '`', 'e', "è" }, { '`', 'i', "ì" },
+  { '`', 'o', "ò" }, { '`', 'u', "ù" }, { '`', 'A', "À" },
+  { '`', 'E', "È" }, { '`', 'I', "Ì" }, { '`', 'O', "Ò" },
+  { '`', 'U', "Ù" }, { '^', 'a', "â" }, { '^', 'c', "ĉ" },
+  { '^', 'e', "ê" }, { '^', 'g', "ĝ" }, { '^', 'h', "ĥ" },
+  { '^', 'i', "î" }, { '^', 'j', "ĵ" }, { '^', 'o', "ô" },
+  { '^', 's', "ŝ" }, { '^', 'u', "û" }, { '^', 'w', "ŵ" },
+  { '^', 'y', "ŷ" }, { '^', 'A', "Â" }, { '^', 'C', "Ĉ" },
+  { '^', 'E', "Ê" }, { '^', 'G', "Ĝ" }, { '^', 'H', "Ĥ" },
+  { '^', 'I', "Î" }, { '^', 'J', "Ĵ" }, { '^', 'O', "Ô" },
+  { '^', 'S', "Ŝ" }, { '^', 'U', "Û" }, { '^', 'W', "Ŵ" },
+  { '^', 'Y', "Ŷ" }, { '"', 'a', "ä" }, { '"', 'e', "ë" },
+  { '"', 'i', "ï" }, { '"', 'o', "ö" }, { '"', 'u', "ü" },
+  { '"', 'y', "ÿ" }, { '"', 'A', "Ä" }, { '"', 'E', "Ë" },
+  { '"', 'I', "Ï" }, { '"', 'O', "Ö" }, { '"', 'U', "Ü" },
+  { '"', 'Y', "Ÿ" }, { '~', 'a', "ã" }, { '~', 'i', "ĩ" },
+  { '~', 'n', "ñ" }, { '~', 'o', "õ" }, { '~', 'u', "ũ" },
+  { '~', 'A', "Ã" }, { '~', 'I', "Ĩ" }, { '~', 'N', "Ñ" },
+  { '~', 'O', "Õ" }, { '~', 'U', "Ũ" }, { '=', 'a', "ā" },
+  { '=', 'e', "ē" }, { '=', 'i', "ī" }, { '=', 'o', "ō" },
+  { '=', 'u', "ū" }, { '=', 'A', "Ā" }, { '=', 'E', "Ē" },
+  { '=', 'I', "Ī" }, { '=', 'O', "Ō" }, { '=', 'U', "Ū" },
+  { '.', 'c', "ċ" }, { '.', 'e', "ė" }, { '.', 'g', "ġ" },
+  { '.', 'z', "ż" }, { '.', 'C', "Ċ" }, { '.', 'E', "Ė" },
+  { '.', 'G', "Ġ" }, { '.', 'I', "İ" }, { '.', 'Z', "Ż" },
+  { 'u', 'a', "ă" }, { 'u', 'e', "ĕ" }, { 'u', 'g', "ğ" },
+  { 'u', 'i', "ĭ" }, { 'u', 'o', "ŏ" }, { 'u', 'u', "ŭ" },
+  { 'u', 'A', "Ă" }, { 'u', 'E', "Ĕ" }, { 'u', 'G', "Ğ" },
+  { 'u', 'I', "Ĭ" }, { 'u', 'O', "Ŏ" }, { 'u', 'U', "Ŭ" },
+  { 'v', 'c', "č" }, { 'v', 'd', "ď" }, { 'v', 'e', "ě" },
+  { 'v', 'l', "ľ" }, { 'v', 'n', "ň" }, { 'v', 'r', "ř" },
+  { 'v', 's', "š" }, { 'v', 't', "ť" }, { 'v', 'z', "ž" },
+  { 'v', 'C', "Č" }, { 'v', 'D', "Ď" }, { 'v', 'E', "Ě" },
+  { 'v', 'L', "Ľ" }, { 'v', 'N', "Ň" }, { 'v', 'R', "Ř" },
+  { 'v', 'S', "Š" }, { 'v', 'T', "Ť" }, { 'v', 'Z', "Ž" },
+  { 'H', 'o', "ő" }, { 'H', 'u', "ű" }, { 'H', 'O', "Ő" },
+  { 'H', 'U', "Ű" }, { 'c', 'c', "ç" }, { 'c', 'g', "ģ" },
+  { 'c', 'k', "ķ" }, { 'c', 'l', "ļ" }, { 'c', 'n', "ņ" },
+  { 'c', 'r', "ŗ" }, { 'c', 's', "ş" }, { 'c', 't', "ţ" },
+  { 'c', 'C', "Ç" }, { 'c', 'G', "Ģ" }, { 'c', 'K', "Ķ" },
+  { 'c', 'L', "Ļ" }, { 'c', 'N', "Ņ" }, { 'c', 'R', "Ŗ" },
+  { 'c', 'S', "Ş" }, { 'c', 'T', "Ţ" }, { 'k', 'a', "ą" },
+  { 'k', 'e', "ę" }, { 'k', 'i', "į" }, { 'k', 'u', "ų" },
+  { 'k', 'A', "Ą" }, { 'k', 'E', "Ę" }, { 'k', 'I', "Į" },
+  { 'k', 'U', "Ų" }, { 'r', 'a', "å" }, { 'r', 'u', "ů" },
+  { 'r', 'A', "Å" }, { 'r', 'U', "Ů" }
+};
+
+/* the combining marks, for the other letters. */
+static const struct
+{
+  char accent;
+  const char* mark;
+} marks[] = { { '\'', "\xcc\x81" }, { '`', "\xcc\x80" },
+  { '^', "\xcc\x82" }, { '"', "\xcc\x88" }, { '~', "\xcc\x83" },
+  { '=', "\xcc\x84" }, { '.', "\xcc\x87" }, { 'u', "\xcc\x86" },
+  { 'v', "\xcc\x8c" }, { 'H', "\xcc\x8b" }, { 'c', "\xcc\xa7" },
+  { 'k', "\xcc\xa8" }, { 'r', "\xcc\x8a" }, { 'd', "\xcc\xa3" } };
+
+/* the commands written as a character. */
+static const struct
+{
+  const char* command;
+  const char* text;
+} symbols[] = { { "ss", "ß" }, { "o", "ø" }, { "O", "Ø" },
+  { "ae", "æ" }, { "AE", "Æ" }, { "oe", "œ" }, { "OE", "Œ" },
+  { "aa", "å" }, { "AA", "Å" }, { "l", "ł" }, { "L", "Ł" },
+  { "i", "ı" }, { "j", "ȷ" }, { "ldots", "…" }, { "dots", "…" },
+  { "textendash", "–" }, { "textemdash", "—" },
+  { "guillemotleft", "«" }, { "guillemotright", "»" },
+  { "textquoteleft", "‘" }, { "textquoteright", "’" },
+  { "textquotedblleft", "“" }, { "textquotedblright", "”" },
+  { "S", "§" }, { "P", "¶" }, { "copyright", "©" } };
+
+/* the bibtex types, and their csl types. (the other ones are
+ * 'document'.) */
+static const struct
+{
+  const char* bibtex;
+  const char* csl;
+} types[] = { { "article", "article-journal" }, { "book", "book" },
+  { "mvbook", "book" }, { "collection", "book" },
+  { "mvcollection", "book" }, { "proceedings", "book" },
+  { "mvproceedings", "book" }, { "manual", "book" },
+  { "booklet", "pamphlet" }, { "inbook", "chapter" },
+  { "incollection", "chapter" }, { "bookinbook", "chapter" },
+  { "suppbook", "chapter" }, { "suppcollection", "chapter" },
+  { "inproceedings", "paper-conference" },
+  { "conference", "paper-conference" }, { "thesis", "thesis" },
+  { "phdthesis", "thesis" }, { "mastersthesis", "thesis" },
+  { "techreport", "report" }, { "report", "report" },
+  { "online", "webpage" }, { "electronic", "webpage" },
+  { "www", "webpage" }, { "unpublished", "manuscript" },
+  { "patent", "patent" }, { "periodical", "periodical" } };
+
+/* the fields copied as text: bibtex name, csl name. */
+static const struct
+{
+  const char* bibtex;
+  const char* csl;
+} texts[] = { { "shorttitle", "title-short" },
+  { "series", "collection-title" }, { "volume", "volume" },
+  { "edition", "edition" }, { "isbn", "ISBN" }, { "issn", "ISSN" },
+  { "abstract", "abstract" }, { "keywords", "keyword" },
+  { "note", "note" }, { "chapter", "chapter-number" },
+  { "language", "language" }, { "type", "genre" } };
+
+/* the fields copied as they are (no latex in them). */
+static const struct
+{
+  const char* bibtex;
+  const char* csl;
+} verbatims[] = { { "doi", "DOI" }, { "url", "URL" },
+  { "file", "file" } };
+
+/* the fields that are lists of names. */
+static const struct
+{
+  const char* bibtex;
+  const char* csl;
+} names[] = { { "author", "author" }, { "editor", "editor" },
+  { "translator", "translator" },
+  { "bookauthor", "container-author" } };
+
+static const char* months[] = { "jan", "feb", "mar", "apr", "may",
+  "jun", "jul", "aug", "sep", "oct", "nov", "dec" };
+
+/* how a value is decoded. */
+enum Decode
+{
+  DECODE_TEXT,
+  /* as text, but the dashes are kept (for pages). */
+  DECODE_PAGES,
+  /* only the escaped characters (\_, \%...) and the braces (for the
+   * urls, the dois and the filepaths). */
+  DECODE_VERBATIM
+};
+
+static int
+is_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int
+is_alpha(char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static int
+is_digit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+/* the characters of a macro name (or a number). */
+static int
+is_ident(char c)
+{
+  return is_alpha(c) || is_digit(c)
+         || (c != '\0' && strchr("_-:./+", c));
+}
+
+/* the length of the utf-8 character starting with c. */
+static size_t
+utf8_len(char c)
+{
+  unsigned char u = (unsigned char)c;
+  return u < 0xc0 ? 1 : u < 0xe0 ? 2 : u < 0xf0 ? 3 : 4;
+}
+
+/* compare a span with a string, ignoring the case. */
+static int
+span_is(const char* s, size_t n, const char* name)
+{
+  return strlen(name) == n && strncasecmp(s, name, n) == 0;
+}
+
+/* append to a Buf, unless it's NULL (when a value is skipped). */
+static int
+cat(struct Buf* b, const char* s, size_t n)
+{
+  return b == NULL || buf_cat(b, s, n);
+}
+
+/* write decoded text: a pending space (from the spaces of the value)
+ * is written first, unless nothing has been written yet. */
+static int
+put(struct Buf* out,
+  size_t start,
+  int* space,
+  const char* s,
+  size_t n)
+{
+  if (*space && out->len > start && !buf_cat(out, " ", 1))
+    return 0;
+  *space = 0;
+  return buf_cat(out, s, n);
+}
+
+/* write an accented letter: a precomposed character if there is one,
+ * or else the letter and a combining mark. */
+static int
+put_accent(struct Buf* out,
+  size_t start,
+  int* space,
+  char accent,
+  const char* base,
+  size_t n)
+{
+  size_t i;
+  size_t count = n == 1 ? sizeof(accents) / sizeof(accents[0]) : 0;
+  for (i = 0; i < count; i++) {
+    if (accents[i].accent == accent && accents[i].base == base[0])
+      return put(out,
+        start,
+        space,
+        accents[i].composed,
+        strlen(accents[i].composed));
+  }
+  if (!put(out, start, space, base, n))
+    return 0;
+  for (i = 0; i < sizeof(marks) / sizeof(marks[0]); i++) {
+    if (marks[i].accent == accent)
+      return buf_cat(out, marks[i].mark, strlen(marks[i].mark));
+  }
+  return 1;
+}
+
+/* decode the latex of a raw value (s, n) and append it to out: the
+ * braces are removed, the accents and the symbols become characters,
+ * and the spaces are collapsed (and trimmed). */
+static int
+decode(struct Buf* out, const char* s, size_t n, enum Decode mode)
+{
+  size_t start = out->len;
+  int space = 0;
+  size_t i = 0;
+  while (i < n) {
+    char c = s[i];
+    if (is_space(c)) {
+      space = 1;
+      i++;
+      continue;
+    }
+    if (c == '{' || c == '}') {
+      i++;
+      continue;
+    }
+    if (c == '\\' && i + 1 < n) {
+      char next = s[i + 1];
+      if (strchr("&%$#_{}", next)) {
+        if (!put(out, start, &space, &next, 1))
+          return 0;
+        i += 2;
+        continue;
+      }
+      if (mode == DECODE_VERBATIM) {
+        if (!put(out, start, &space, &c, 1))
+          return 0;
+        i++;
+        continue;
+      }
+      /* a line break. */
+      if (next == '\\') {
+        space = 1;
+        i += 2;
+        continue;
+      }
+      /* a control word (letters), or a control symbol. */
+      const char* cmd = s + i + 1;
+      size_t j = i + 2;
+      if (is_alpha(next)) {
+        while (j < n && is_alpha(s[j]))
+          j++;
+      }
+      size_t cmd_len = j - i - 1;
+      int accent = cmd_len == 1
+                   && (strchr("'`^\"~=.", next)
+                       || (strchr("uvHcrdk", next) && j < n
+                           && (s[j] == '{' || is_space(s[j]))));
+      if (accent) {
+        /* the accented letter: a letter, {letter}, \i or {\i}. */
+        while (j < n && is_space(s[j]))
+          j++;
+        int braced = j < n && s[j] == '{';
+        if (braced)
+          j++;
+        const char* base = s + j;
+        size_t len = 0;
+        if (j + 1 < n && s[j] == '\\'
+            && (s[j + 1] == 'i' || s[j + 1] == 'j')) {
+          base = s + j + 1;
+          len = 1;
+        } else if (j < n && s[j] != '}') {
+          len = utf8_len(s[j]);
+          if (j + len > n)
+            len = n - j;
+        }
+        j += base == s + j ? len : len + 1;
+        if (braced) {
+          while (j < n && s[j] != '}')
+            j++;
+          j += j < n;
+        }
+        if (len > 0
+            && !put_accent(out, start, &space, next, base, len))
+          return 0;
+        i = j;
+        continue;
+      }
+      /* a symbol (or a command ignored, like \emph: only its argument
+       * is kept). the spaces after a control word are ignored. */
+      size_t k;
+      for (k = 0; k < sizeof(symbols) / sizeof(symbols[0]); k++) {
+        if (strlen(symbols[k].command) == cmd_len
+            && memcmp(symbols[k].command, cmd, cmd_len) == 0) {
+          if (!put(out,
+                start,
+                &space,
+                symbols[k].text,
+                strlen(symbols[k].text)))
+            return 0;
+          break;
+        }
+      }
+      i = j;
+      while (is_alpha(next) && i < n && is_space(s[i]))
+        i++;
+      continue;
+    }
+    if (mode == DECODE_VERBATIM) {
+      if (!put(out, start, &space, &c, 1))
+        return 0;
+      i++;
+      continue;
+    }
+    /* the dashes: -- and --- (except for pages), and the quotes. */
+    const char* text = &c;
+    size_t len = 1;
+    size_t j = i + 1;
+    if (c == '-') {
+      while (j < n && s[j] == '-')
+        j++;
+      if (mode == DECODE_PAGES)
+        text = "-";
+      else if (j - i == 2)
+        text = "–", len = strlen("–");
+      else if (j - i == 3)
+        text = "—", len = strlen("—");
+      else
+        text = s + i, len = j - i;
+    } else if (c == '~') {
+      text = "\xc2\xa0", len = 2;
+    } else if (c == '`' && j < n && s[j] == '`') {
+      text = "“", len = strlen("“"), j++;
+    } else if (c == '\'' && j < n && s[j] == '\'') {
+      text = "”", len = strlen("”"), j++;
+    }
+    if (!put(out, start, &space, text, len))
+      return 0;
+    i = j;
+  }
+  return 1;
+}
+
+/* the index of the brace closing the one at s[i] (or n). */
+static size_t
+closing_brace(const char* s, size_t n, size_t i)
+{
+  int depth = 0;
+  for (; i < n; i++) {
+    if (s[i] == '{')
+      depth++;
+    else if (s[i] == '}' && --depth == 0)
+      return i;
+  }
+  return n;
+}
+
+/* find a macro by its name (the case is ignored). */
+static const struct Macro*
+find_macro(const struct Macros* macros, const char* s, size_t n)
+{
+  size_t i;
+  for (i = 0; i < macros->n; i++) {
+    const struct Span* name = &macros->m[i].name;
+    if (name->n == n && strncasecmp(name->s, s, n) == 0)
+      return &macros->m[i];
+  }
+  return NULL;
+}
+
+/* read a value from s[*i], up to the next comma (or the end): its
+ * parts ({...}, "...", a number or a macro) are concatenated (#) and
+ * appended to out (if it's not NULL). */
+static int
+parse_value(const char* s,
+  size_t n,
+  size_t* i,
+  const struct Macros* macros,
+  struct Buf* out)
+{
+  size_t k = *i;
+  while (1) {
+    while (k < n && is_space(s[k]))
+      k++;
+    if (k >= n)
+      break;
+    if (s[k] == '{') {
+      size_t end = closing_brace(s, n, k);
+      if (!cat(out, s + k + 1, end - k - 1))
+        return 0;
+      k = end + 1;
+    } else if (s[k] == '"') {
+      size_t end = k + 1;
+      int depth = 0;
+      for (; end < n && (s[end] != '"' || depth > 0); end++) {
+        if (s[end] == '{')
+          depth++;
+        else if (s[end] == '}')
+          depth--;
+      }
+      if (!cat(out, s + k + 1, end - k - 1))
+        return 0;
+      k = end + 1;
+    } else if (is_ident(s[k])) {
+      size_t end = k;
+      while (end < n && is_ident(s[end]))
+        end++;
+      /* a macro not defined (like a month) is kept as its name. */
+      const struct Macro* m = find_macro(macros, s + k, end - k);
+      if (m ? !cat(out, m->value.s, m->value.len)
+            : !cat(out, s + k, end - k))
+        return 0;
+      k = end;
+    } else {
+      break;
+    }
+    while (k < n && is_space(s[k]))
+      k++;
+    if (k >= n || s[k] != '#')
+      break;
+    k++;
+  }
+  *i = k > n ? n : k;
+  return 1;
+}
+
+/* read the fields of an entry (after its key). */
+static int
+parse_fields(struct Worker* w, const struct Span* body)
+{
+  const char* s = body->s;
+  size_t n = body->n;
+  w->n_fields = 0;
+  const char* comma = memchr(s, ',', n);
+  if (!comma)
+    return 1;
+  size_t i = (size_t)(comma - s) + 1;
+  while (i < n) {
+    while (i < n && (is_space(s[i]) || s[i] == ','))
+      i++;
+    if (i >= n)
+      break;
+    size_t start = i;
+    while (i < n && !is_space(s[i]) && s[i] != '=' && s[i] != ',')
+      i++;
+    size_t len = i - start;
+    while (i < n && is_space(s[i]))
+      i++;
+    /* not a field: skip it. */
+    if (i >= n || s[i] != '=') {
+      while (i < n && s[i] != ',')
+        i = s[i] == '{' ? closing_brace(s, n, i) + 1 : i + 1;
+      continue;
+    }
+    i++;
+    struct Field* f = NULL;
+    if (w->n_fields < MAX_FIELDS && len < FIELD_NAME_SIZE) {
+      f = &w->fields[w->n_fields];
+      size_t k;
+      for (k = 0; k < len; k++)
+        f->name[k] = (char)tolower((unsigned char)s[start + k]);
+      f->name[len] = '\0';
+      f->raw.len = 0;
+    }
+    if (!parse_value(s, n, &i, w->macros, f ? &f->raw : NULL))
+      return 0;
+    if (f)
+      w->n_fields++;
+  }
+  return 1;
+}
+
+/* a field of the entry, or NULL if it's not there (or empty). */
+static const struct Field*
+field(const struct Worker* w, const char* name)
+{
+  int i;
+  for (i = 0; i < w->n_fields; i++) {
+    if (w->fields[i].raw.len > 0
+        && strcmp(w->fields[i].name, name) == 0)
+      return &w->fields[i];
+  }
+  return NULL;
+}
+
+/* write a key of the object (after a comma). */
+static int
+put_key(struct Buf* out, const char* key)
+{
+  return buf_cat(out, ",\"", 2) && buf_cat(out, key, strlen(key))
+         && buf_cat(out, "\":", 2);
+}
+
+/* write a raw value, decoded, as a string (nothing if it's empty).
+ * first is set if the key is the first one of its object. */
+static int
+put_string(struct Worker* w,
+  const char* key,
+  const char* s,
+  size_t n,
+  enum Decode mode,
+  int* first)
+{
+  w->text.len = 0;
+  if (!decode(&w->text, s, n, mode))
+    return 0;
+  if (w->text.len == 0)
+    return 1;
+  size_t skip = first && *first;
+  if (first)
+    *first = 0;
+  return buf_cat(&w->out, ",\"" + skip, 2 - skip)
+         && buf_cat(&w->out, key, strlen(key))
+         && buf_cat(&w->out, "\":", 2)
+         && json_string(&w->out, w->text.s, w->text.len);
+}
+
+/* write a field (if it's there) as a string. */
+static int
+put_field(struct Worker* w,
+  const char* key,
+  const struct Field* f,
+  enum Decode mode)
+{
+  return !f || put_string(w, key, f->raw.s, f->raw.len, mode, NULL);
+}
+
+/* the first of some fields that is there. */
+static const struct Field*
+first_field(const struct Worker* w,
+  const char* a,
+  const char* b,
+  const char* c)
+{
+  const struct Field* f = field(w, a);
+  if (!f && b)
+    f = field(w, b);
+  if (!f && c)
+    f = field(w, c);
+  return f;
+}
+
+/* write a name: {literal} (a name in braces), or family and given
+ * names ("von Last, Jr, First", "Last, First" or "First von Last").
+ * */
+static int
+put_name(struct Worker* w, const char* s, size_t n)
+{
+  int first = 1;
+  if (!buf_cat(&w->out, "{", 1))
+    return 0;
+  if (n >= 2 && s[0] == '{' && closing_brace(s, n, 0) == n - 1)
+    return put_string(w, "literal", s + 1, n - 2, DECODE_TEXT, &first)
+           && buf_cat(&w->out, "}", 1);
+  /* the commas, outside the braces. */
+  size_t commas[2] = { n, n };
+  int n_commas = 0, depth = 0;
+  size_t i;
+  for (i = 0; i < n; i++) {
+    if (s[i] == '{')
+      depth++;
+    else if (s[i] == '}')
+      depth--;
+    else if (s[i] == ',' && depth == 0 && n_commas < 2)
+      commas[n_commas++] = i;
+  }
+  int ok;
+  if (n_commas == 2) {
+    ok = put_string(w, "family", s, commas[0], DECODE_TEXT, &first)
+         && put_string(w,
+           "given",
+           s + commas[1] + 1,
+           n - commas[1] - 1,
+           DECODE_TEXT,
+           &first)
+         && put_string(w,
+           "suffix",
+           s + commas[0] + 1,
+           commas[1] - commas[0] - 1,
+           DECODE_TEXT,
+           &first);
+  } else if (n_commas == 1) {
+    ok = put_string(w, "family", s, commas[0], DECODE_TEXT, &first)
+         && put_string(w,
+           "given",
+           s + commas[0] + 1,
+           n - commas[0] - 1,
+           DECODE_TEXT,
+           &first);
+  } else {
+    /* the family name starts with the first word in lowercase (a
+     * particle, like 'de'), or else it's the last word. */
+    size_t family = 0, last = 0;
+    depth = 0;
+    for (i = 0; i < n; i++) {
+      if (s[i] == '{')
+        depth++;
+      else if (s[i] == '}')
+        depth--;
+      if (depth == 0 && i > 0 && is_space(s[i - 1])
+          && !is_space(s[i])) {
+        last = i;
+        if (!family && s[i] >= 'a' && s[i] <= 'z')
+          family = i;
+      }
+    }
+    if (!family)
+      family = last;
+    ok = put_string(
+           w, "family", s + family, n - family, DECODE_TEXT, &first)
+         && put_string(w, "given", s, family, DECODE_TEXT, &first);
+  }
+  return ok && buf_cat(&w->out, "}", 1);
+}
+
+/* write a list of names, separated by 'and'. */
+static int
+put_names(struct Worker* w, const char* key, const struct Field* f)
+{
+  if (!f)
+    return 1;
+  const char* s = f->raw.s;
+  size_t n = f->raw.len;
+  int count = 0, depth = 0;
+  size_t i = 0, start = 0;
+  for (i = 0; i <= n; i++) {
+    size_t end = i, next = i + 1;
+    if (i < n) {
+      if (s[i] == '{')
+        depth++;
+      else if (s[i] == '}')
+        depth--;
+      if (depth != 0 || !is_space(s[i]) || i + 4 >= n
+          || strncasecmp(s + i + 1, "and", 3) != 0
+          || !is_space(s[i + 4]))
+        continue;
+      next = i + 5;
+    }
+    /* a name, trimmed. */
+    while (start < end && is_space(s[start]))
+      start++;
+    while (end > start && is_space(s[end - 1]))
+      end--;
+    if (end > start) {
+      int ok = count ? buf_cat(&w->out, ",", 1)
+                     : put_key(&w->out, key)
+                         && buf_cat(&w->out, "[", 1);
+      if (!ok)
+        return 0;
+      if (!put_name(w, s + start, end - start))
+        return 0;
+      count++;
+    }
+    start = next;
+    i = next - 1;
+  }
+  return !count || buf_cat(&w->out, "]", 1);
+}
+
+/* read a date (2024, 2024-03, 2024-03-12) into its parts. returns
+ * the number of parts (0 if it's not a date). */
+static int
+parse_date(const char* s, size_t n, int parts[3])
+{
+  int count = 0;
+  size_t i = 0;
+  while (count < 3 && i < n && is_digit(s[i])) {
+    int v = 0;
+    while (i < n && is_digit(s[i]) && v < 100000)
+      v = v * 10 + (s[i++] - '0');
+    parts[count++] = v;
+    if (i < n && s[i] != '-')
+      break;
+    i++;
+  }
+  return count;
+}
+
+/* write date parts: {"date-parts": [[2024, 3]]}. */
+static int
+put_date_parts(struct Buf* out, const int parts[3], int count)
+{
+  char num[16];
+  int i;
+  if (!buf_cat(out, "{\"date-parts\":[[", 16))
+    return 0;
+  for (i = 0; i < count; i++) {
+    int len = snprintf(num, sizeof(num), i ? ",%d" : "%d", parts[i]);
+    if (!buf_cat(out, num, (size_t)len))
+      return 0;
+  }
+  return buf_cat(out, "]]}", 3);
+}
+
+/* write a date field (urldate, date): nothing if it isn't a date. */
+static int
+put_date(struct Worker* w, const char* key, const struct Field* f)
+{
+  int parts[3];
+  if (!f)
+    return 1;
+  w->text.len = 0;
+  if (!decode(&w->text, f->raw.s, f->raw.len, DECODE_VERBATIM))
+    return 0;
+  int count = parse_date(w->text.s, w->text.len, parts);
+  return !count
+         || (put_key(&w->out, key)
+             && put_date_parts(&w->out, parts, count));
+}
+
+/* write the date of publication: the field date, or the fields year
+ * and month (a year that isn't a number is written as a literal). */
+static int
+put_issued(struct Worker* w)
+{
+  const struct Field* year = field(w, "year");
+  const struct Field* month = field(w, "month");
+  if (field(w, "date") || !year)
+    return put_date(w, "issued", field(w, "date"));
+  int parts[3];
+  w->text.len = 0;
+  if (!decode(&w->text, year->raw.s, year->raw.len, DECODE_VERBATIM))
+    return 0;
+  size_t i;
+  for (i = 0; i < w->text.len && is_digit(w->text.s[i]); i++)
+    ;
+  if (i == 0 || i < w->text.len || i > 6) {
+    int first = 1;
+    return put_key(&w->out, "issued") && buf_cat(&w->out, "{", 1)
+           && put_string(w,
+             "literal",
+             year->raw.s,
+             year->raw.len,
+             DECODE_TEXT,
+             &first)
+           && buf_cat(&w->out, "}", 1);
+  }
+  parts[0] = atoi(w->text.s);
+  int count = 1;
+  if (month) {
+    w->text.len = 0;
+    if (!decode(
+          &w->text, month->raw.s, month->raw.len, DECODE_VERBATIM))
+      return 0;
+    const char* m = w->text.s;
+    if (w->text.len > 0 && is_digit(m[0])) {
+      parts[1] = atoi(m);
+      count = parts[1] >= 1 && parts[1] <= 12 ? 2 : 1;
+    } else if (w->text.len >= 3) {
+      for (i = 0; i < 12; i++) {
+        if (strncasecmp(m, months[i], 3) == 0) {
+          parts[1] = (int)i + 1;
+          count = 2;
+        }
+      }
+    }
+  }
+  return put_key(&w->out, "issued")
+         && put_date_parts(&w->out, parts, count);
+}
+
+/* convert an entry into a csl-json object. */
+static int
+convert_entry(struct Worker* w, const struct Piece* p)
+{
+  if (!parse_fields(w, &p->body))
+    return 0;
+  const char* type = "document";
+  size_t i;
+  for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+    if (span_is(p->type.s, p->type.n, types[i].bibtex)) {
+      type = types[i].csl;
+      break;
+    }
+  }
+  int article = strcmp(type, "article-journal") == 0;
+  if (!buf_cat(&w->out, "{\"type\":", 8)
+      || !json_string(&w->out, type, strlen(type)))
+    return 0;
+
+  /* the title, with its subtitle. */
+  const struct Field* title = field(w, "title");
+  const struct Field* subtitle = field(w, "subtitle");
+  if (title && subtitle) {
+    w->text.len = 0;
+    int ok =
+      decode(&w->text, title->raw.s, title->raw.len, DECODE_TEXT)
+      && buf_cat(&w->text, ": ", 2)
+      && decode(
+        &w->text, subtitle->raw.s, subtitle->raw.len, DECODE_TEXT);
+    if (!ok || !put_key(&w->out, "title")
+        || !json_string(&w->out, w->text.s, w->text.len))
+      return 0;
+  } else if (!put_field(w, "title", title, DECODE_TEXT)) {
+    return 0;
+  }
+
+  for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (!put_names(w, names[i].csl, field(w, names[i].bibtex)))
+      return 0;
+  }
+  for (i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+    const struct Field* f = field(w, texts[i].bibtex);
+    if (!put_field(w, texts[i].csl, f, DECODE_TEXT))
+      return 0;
+  }
+  for (i = 0; i < sizeof(verbatims) / sizeof(verbatims[0]); i++) {
+    const struct Field* f = field(w, verbatims[i].bibtex);
+    if (!put_field(w, verbatims[i].csl, f, DECODE_VERBATIM))
+      return 0;
+  }
+
+  /* the number is the issue of an article, or the number of a book
+   * in its collection. (an annote is kept as it is: it may be the
+   * filepath of the notes, see replace_annote in csljson.c.) */
+  const char* number = article                 ? "issue"
+                       : field(w, "series") ? "collection-number"
+                                            : "number";
+  int ok = put_field(w,
+             "container-title",
+             first_field(w, "journal", "journaltitle", "booktitle"),
+             DECODE_TEXT)
+           && put_field(w,
+             "publisher",
+             first_field(w, "publisher", "school", "institution"),
+             DECODE_TEXT)
+           && put_field(w,
+             "publisher-place",
+             first_field(w, "address", "location", NULL),
+             DECODE_TEXT)
+           && put_field(w, "page", field(w, "pages"), DECODE_PAGES)
+           && put_field(w, number, field(w, "number"), DECODE_TEXT)
+           && put_field(w,
+             "annote",
+             first_field(w, "annote", "annotation", NULL),
+             DECODE_VERBATIM)
+           && put_issued(w)
+           && put_date(w, "accessed", field(w, "urldate"));
+
+  /* the kind of thesis, if it's not given. */
+  if (ok && !field(w, "type")) {
+    if (span_is(p->type.s, p->type.n, "phdthesis"))
+      ok = put_key(&w->out, "genre")
+           && json_string(&w->out, "PhD thesis", 10);
+    else if (span_is(p->type.s, p->type.n, "mastersthesis"))
+      ok = put_key(&w->out, "genre")
+           && json_string(&w->out, "Master's thesis", 15);
+  }
+  return ok && buf_cat(&w->out, "}", 1);
+}
+
+/* the thread: convert its entries. */
+static void*
+work(void* arg)
+{
+  struct Worker* w = arg;
+  size_t k;
+  w->ok = 1;
+  for (k = 0; w->ok && k < w->n; k++) {
+    w->ok = (w->out.len == 0 || buf_cat(&w->out, ",\n", 2))
+            && convert_entry(w, &w->pieces[k]);
+  }
+  return NULL;
+}
+
+/* split the file into its entries, and read the @string macros (in
+ * order, since a macro can use the previous ones). the comments
+ * (@comment, and the lines starting with %) and the @preamble are
+ * ignored. */
+static int
+split_entries(const char* s,
+  size_t n,
+  struct Piece** pieces,
+  size_t* n_pieces,
+  struct Macros* macros)
+{
+  size_t size = 0, macros_size = 0, i = 0;
+  while (i < n) {
+    if (s[i] == '%') {
+      const char* nl = memchr(s + i, '\n', n - i);
+      i = nl ? (size_t)(nl - s) + 1 : n;
+      continue;
+    }
+    if (s[i++] != '@')
+      continue;
+    size_t start = i;
+    while (i < n && is_alpha(s[i]))
+      i++;
+    struct Span type = { s + start, i - start };
+    while (i < n && is_space(s[i]))
+      i++;
+    if (i >= n || (s[i] != '{' && s[i] != '('))
+      continue;
+    /* the end of the entry: the closing brace, or the closing
+     * parenthesis (outside braces). */
+    size_t end = i + 1;
+    if (s[i] == '{') {
+      end = closing_brace(s, n, i);
+    } else {
+      int depth = 0;
+      for (; end < n && (s[end] != ')' || depth > 0); end++) {
+        if (s[end] == '{')
+          depth++;
+        else if (s[end] == '}')
+          depth--;
+      }
+    }
+    struct Span body = { s + i + 1, end - i - 1 };
+    i = end + 1;
+    if (span_is(type.s, type.n, "comment")
+        || span_is(type.s, type.n, "preamble"))
+      continue;
+
+    if (span_is(type.s, type.n, "string")) {
+      size_t k = 0;
+      while (k < body.n && is_space(body.s[k]))
+        k++;
+      size_t name = k;
+      while (k < body.n && is_ident(body.s[k]))
+        k++;
+      struct Span name_span = { body.s + name, k - name };
+      while (k < body.n && is_space(body.s[k]))
+        k++;
+      if (k >= body.n || body.s[k] != '=' || name_span.n == 0)
+        continue;
+      k++;
+      if (macros->n == macros_size) {
+        macros_size = macros_size ? macros_size * 2 : 16;
+        struct Macro* temp =
+          realloc(macros->m, macros_size * sizeof(struct Macro));
+        if (!temp) {
+          fputs("error reallocating memory.\n", stderr);
+          return 0;
+        }
+        macros->m = temp;
+      }
+      struct Macro* m = &macros->m[macros->n];
+      m->name = name_span;
+      m->value = (struct Buf){ 0 };
+      if (!buf_cat(&m->value, "", 0)
+          || !parse_value(body.s, body.n, &k, macros, &m->value)) {
+        free(m->value.s);
+        return 0;
+      }
+      macros->n++;
+      continue;
+    }
+
+    if (*n_pieces == size) {
+      size = size ? size * 2 : 256;
+      struct Piece* temp =
+        realloc(*pieces, size * sizeof(struct Piece));
+      if (!temp) {
+        fputs("error reallocating memory.\n", stderr);
+        return 0;
+      }
+      *pieces = temp;
+    }
+    (*pieces)[(*n_pieces)++] = (struct Piece){ type, body };
+  }
+  return 1;
+}
+
+int
+bibtex_write_objects(const char* bibpath, FILE* f)
+{
+  /* map the file. */
+  int fd = open(bibpath, O_RDONLY);
+  struct stat st;
+  if (fd == -1 || fstat(fd, &st) == -1) {
+    fprintf(stderr, "error opening file: %s\n", bibpath);
+    if (fd != -1)
+      close(fd);
+    return -1;
+  }
+  size_t n = (size_t)st.st_size;
+  const char* s = "";
+  if (n > 0) {
+    s = mmap(NULL, n, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (s == MAP_FAILED) {
+      perror("mmap");
+      close(fd);
+      return -1;
+    }
+  }
+  close(fd);
+
+  struct Piece* pieces = NULL;
+  size_t n_pieces = 0;
+  struct Macros macros = { NULL, 0 };
+  int ok = split_entries(s, n, &pieces, &n_pieces, &macros);
+
+  /* convert the entries, in threads if there are many. */
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t n_threads = n_pieces / MIN_ENTRIES;
+  if (cpus > 0 && n_threads > (size_t)cpus)
+    n_threads = (size_t)cpus;
+  if (n_threads > MAX_THREADS)
+    n_threads = MAX_THREADS;
+  if (n_threads == 0)
+    n_threads = 1;
+  struct Worker* workers =
+    ok ? calloc(n_threads, sizeof(*workers)) : NULL;
+  ok = workers != NULL;
+  size_t t;
+  size_t per = (n_pieces + n_threads - 1) / n_threads;
+  for (t = 0; ok && t < n_threads; t++) {
+    struct Worker* w = &workers[t];
+    size_t from = t * per < n_pieces ? t * per : n_pieces;
+    w->pieces = pieces + from;
+    w->n = n_pieces - from < per ? n_pieces - from : per;
+    w->macros = &macros;
+    w->ok = 1;
+    /* the first part is converted by this thread. */
+    if (t > 0 && pthread_create(&w->thread, NULL, work, w) != 0)
+      w->thread = 0;
+  }
+  if (ok)
+    work(&workers[0]);
+  for (t = 1; ok && t < n_threads; t++) {
+    if (workers[t].thread)
+      pthread_join(workers[t].thread, NULL);
+    else
+      work(&workers[t]);
+  }
+
+  /* write the parts, in order. */
+  int written = 0;
+  for (t = 0; ok && t < n_threads; t++) {
+    struct Worker* w = &workers[t];
+    ok = w->ok;
+    if (ok && w->out.len > 0) {
+      ok = (!written || fputs(",\n", f) != EOF)
+           && fwrite(w->out.s, 1, w->out.len, f) == w->out.len;
+      written = 1;
+    }
+  }
+
+  /* free everything. */
+  for (t = 0; workers && t < n_threads; t++) {
+    int k;
+    for (k = 0; k < MAX_FIELDS; k++)
+      free(workers[t].fields[k].raw.s);
+    free(workers[t].text.s);
+    free(workers[t].out.s);
+  }
+  free(workers);
+  for (t = 0; t < macros.n; t++)
+    free(macros.m[t].value.s);
+  free(macros.m);
+  free(pieces);
+  if (n > 0)
+    munmap((void*)s, n);
+  return ok ? (int)n_pieces : -1;
+}
+
+int
+bibtex_to_csljson(const char* bibpath, const char* jsonpath)
+{
+  FILE* f = fopen(jsonpath, "w");
+  if (!f) {
+    fprintf(stderr, "error opening file: %s\n", jsonpath);
+    return 0;
+  }
+  int ok = fputs("[\n", f) != EOF
+           && bibtex_write_objects(bibpath, f) != -1
+           && fputs("\n]\n", f) != EOF;
+  if (fclose(f) != 0)
+    ok = 0;
+  return ok;
+}
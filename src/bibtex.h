@@ -0,0 +1,28 @@
+/* bibtex
+ * ------
+ *
+ * convert a bibtex file into a csl-json file (the input of
+ * import_csljson, see csljson.h), without pandoc. the file is mapped
+ * in memory and split at its top-level entries (@type{...}); the
+ * @string macros are read first, then the entries are converted by
+ * several threads, each one writing its own part of the output.
+ *
+ * */
+
+#ifndef _BIBTEX_H
+#define _BIBTEX_H
+
+#include <stdio.h>
+
+/* convert the bibtex file bibpath into csl-json objects, written to
+ * f, separated by commas (without the brackets of the array).
+ * returns the number of objects written, or -1 on error. */
+int
+bibtex_write_objects(const char* bibpath, FILE* f);
+
+/* convert the bibtex file bibpath into the csl-json file jsonpath.
+ * returns 0 on error. */
+int
+bibtex_to_csljson(const char* bibpath, const char* jsonpath);
+
+#endif
@@ -0,0 +1,175 @@
+#include <postgresql/libpq-fe.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "catalog.h"
+
+/* the size of the chunks sent to the COPY. */
+#define CHUNK_SIZE 65536
+
+/* the lines are copied as they are: in the csv format, with a
+ * delimiter and a quote that a json text can't contain (control
+ * characters are escaped in it), nothing is unescaped. */
+#define COPY_CATALOG \
+  "copy _catalog (obj) from stdin with (format csv, " \
+  "delimiter e'\\x01', quote e'\\x02')"
+
+/* the identifiers (one by line, ignoring the empty lines and the
+ * comments), with the object found for each one. */
+#define CATALOG_LOOKUP \
+  "select i.id, c.obj from (" \
+  "select trim(x) as id, n " \
+  "from regexp_split_to_table($2, e'\\n') with ordinality s(x, n)" \
+  ") i left join catalog c on c.key = catalog_key($1, i.id) " \
+  "where i.id <> '' and i.id !~ '^#' order by i.n"
+
+/* copy the lines of the dump. returns 0 on error. */
+static int
+copy_lines(PGconn* conn, FILE* f)
+{
+  struct Buf chunk = { 0 };
+  char* line = NULL;
+  size_t size = 0;
+  ssize_t len;
+  int ok = 1;
+  while (ok && (len = getline(&line, &size, f)) != -1) {
+    /* the record is the last column (of an open library dump), or
+     * the whole line. */
+    char* s = strrchr(line, '\t');
+    s = s ? s + 1 : line;
+    size_t n = (size_t)len - (size_t)(s - line);
+    while (n > 0 && strchr(" \n\r", s[n - 1]))
+      n--;
+    if (n == 0)
+      continue;
+    ok = buf_cat(&chunk, s, n) && buf_cat(&chunk, "\n", 1);
+    if (ok && chunk.len >= CHUNK_SIZE) {
+      ok = PQputCopyData(conn, chunk.s, (int)chunk.len) == 1;
+      chunk.len = 0;
+    }
+  }
+  if (ok && chunk.len > 0)
+    ok = PQputCopyData(conn, chunk.s, (int)chunk.len) == 1;
+  if (!ok)
+    fprintf(stderr, "copy failed: %s", PQerrorMessage(conn));
+  else if (ferror(f)) {
+    fputs("error reading the catalog.\n", stderr);
+    ok = 0;
+  }
+  free(line);
+  free(chunk.s);
+  return ok;
+}
+
+int
+command_catalog(const char* filepath)
+{
+  if (!filepath) {
+    fputs("missing argument: file\n", stderr);
+    return 0;
+  }
+  FILE* f = strcmp(filepath, "-") == 0 ? stdin : fopen(filepath, "r");
+  if (!f) {
+    fprintf(stderr, "error opening file: %s\n", filepath);
+    return 0;
+  }
+  PGconn* conn = db_conn();
+  PGresult* res[2];
+
+  /* the transaction and its temporary table. */
+  struct Query start[] = {
+    { .query = "begin" },
+    { .query = "create temp table _catalog (n integer generated "
+               "always as identity, obj jsonb) on commit drop" },
+  };
+  int sent = pipeline_on(conn, start, NULL, 2, res);
+  /* the error of the first query that failed (the queries not sent
+   * have an error result). */
+  int ok = 1;
+  for (int i = 0; i < 2; i++) {
+    if (ok && PQresultStatus(res[i]) != PGRES_COMMAND_OK) {
+      fprintf(stderr, "query failed:\n %s\n", result_error(res[i]));
+      ok = 0;
+    }
+    PQclear(res[i]);
+  }
+  ok = ok && sent;
+
+  /* copy the records, as the file is read. */
+  if (ok) {
+    PGresult* r = PQexec(conn, COPY_CATALOG);
+    ok = PQresultStatus(r) == PGRES_COPY_IN;
+    if (!ok)
+      fprintf(stderr, "query failed:\n %s\n", result_error(r));
+    PQclear(r);
+  }
+  if (ok) {
+    ok = copy_lines(conn, f);
+    PQputCopyEnd(conn, ok ? NULL : "invalid catalog");
+    PGresult* r;
+    while ((r = PQgetResult(conn)) != NULL) {
+      if (ok && PQresultStatus(r) != PGRES_COMMAND_OK) {
+        fprintf(stderr, "copy failed:\n %s\n", result_error(r));
+        ok = 0;
+      }
+      PQclear(r);
+    }
+  }
+  if (f != stdin)
+    fclose(f);
+
+  /* store the records, and end the transaction. */
+  struct Query end[] = {
+    { .query = ok ? "select load_catalog()" : "select 0" },
+    { .query = ok ? "commit" : "rollback" },
+  };
+  sent = pipeline_on(conn, end, NULL, 2, res);
+  if (ok && PQresultStatus(res[0]) != PGRES_TUPLES_OK) {
+    fprintf(stderr, "loading failed:\n %s\n", result_error(res[0]));
+    ok = 0;
+  } else if (ok
+             && (!sent || PQresultStatus(res[1]) != PGRES_COMMAND_OK)) {
+    fprintf(stderr, "loading failed:\n %s\n", result_error(res[1]));
+    ok = 0;
+  } else if (ok) {
+    fprintf(stderr,
+      "(%s identifiers loaded.)\n",
+      PQgetvalue(res[0], 0, 0));
+  }
+  PQclear(res[0]);
+  PQclear(res[1]);
+  return ok;
+}
+
+int
+catalog_lookup(char* method,
+  const char* ids,
+  FILE* f,
+  struct Buf* missing)
+{
+  const char* params[] = { method, ids };
+  PGresult* res = exec_params(CATALOG_LOOKUP, 2, params);
+
+  /* without a catalog (an older database), all are missing. */
+  if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+    PQclear(res);
+    return buf_cat(missing, ids, strlen(ids)) ? 0 : -1;
+  }
+  int found = 0;
+  int i, n = PQntuples(res);
+  for (i = 0; found != -1 && i < n; i++) {
+    const char* id = PQgetvalue(res, i, 0);
+    if (PQgetisnull(res, i, 1)) {
+      if (!buf_cat(missing, id, strlen(id))
+          || !buf_cat(missing, "\n", 1))
+        found = -1;
+      continue;
+    }
+    if (found++ > 0)
+      fputs(",\n", f);
+    fputs(PQgetvalue(res, i, 1), f);
+  }
+  PQclear(res);
+  return found;
+}
@@ -0,0 +1,37 @@
+/* catalog
+ * -------
+ *
+ * a local catalog of references (e.g. a dump of open library), where
+ * the isbns and dois are looked up before fetchref fetches them from
+ * the network. a dump is read line by line (json lines, or the tab
+ * separated lines of open library, whose last column is the json
+ * record) and copied into a temporary table; the SQL function
+ * load_catalog (see schema.sql) then converts the records into
+ * csl-json and stores them in the table catalog, by isbn and doi.
+ *
+ * */
+
+#ifndef _CATALOG_H
+#define _CATALOG_H
+
+#include <stdio.h>
+
+#include "util.h"
+
+/* load the catalog dump at filepath ("-" for stdin). */
+int
+command_catalog(const char* filepath);
+
+/* look up identifiers (doi or isbn, one by line in ids) in the
+ * catalog. the csl-json objects found are written to f, separated by
+ * commas, and the identifiers not found are appended to missing (one
+ * by line). returns the number of objects written (-1 on error): if
+ * the catalog can't be used, it's 0 and all the identifiers are
+ * missing. */
+int
+catalog_lookup(char* method,
+  const char* ids,
+  FILE* f,
+  struct Buf* missing);
+
+#endif
@@ -1,4 +1,5 @@
 #include <limits.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,11 +9,90 @@
 #include "add_entries.h"
 #include "commands.h"
 #include "edit.h"
+#include "fuzzy.h"
+#include "output.h"
 #include "pgpopen2.h"
+#include "previews.h"
 #include "print.h"
 #include "underscore.h"
 #include "util.h"
 
+/* the environment variables holding the queries of the live picker
+ * (with the pattern typed, and without, for an empty one) and their
+ * parameters (RETROLIRE_PARAM_1...), for live_search. */
+#define LIVE_QUERY_VAR "RETROLIRE_QUERY"
+#define LIVE_ALL_VAR "RETROLIRE_QUERY_ALL"
+#define LIVE_PARAM_VAR "RETROLIRE_PARAM_"
+
+/* append a condition to a Stmt, with the placeholder $n for each $?
+ * in it. */
+static int
+append_match(struct Stmt* s, char* match, int n)
+{
+  char ph[PH] = "";
+  char part[MAX_STMT_LEN];
+  char* p;
+  snprintf(ph, PH, "$%d", n);
+  while ((p = strstr(match, "$?")) != NULL) {
+    size_t len = (size_t)(p - match);
+    if (len >= sizeof(part))
+      return 0;
+    memcpy(part, match, len);
+    part[len] = '\0';
+    if (!append_stmt(s, part) || !append_stmt(s, ph))
+      return 0;
+    match = p + 2;
+  }
+  return append_stmt(s, match);
+}
+
+/* make the pattern (for ilike) of the query typed in the live
+ * picker: its words, in that order, anywhere in the value. the
+ * characters % and _ are escaped. an empty query gives '%'. */
+static int
+live_pattern(const char* q, struct Buf* b)
+{
+  int wild = 1;
+  if (!buf_cat(b, "%", 1))
+    return 0;
+  for (; *q; q++) {
+    int ok = 1;
+    if (*q == ' ' || *q == '\t') {
+      if (!wild)
+        ok = buf_cat(b, "%", 1);
+      wild = 1;
+      continue;
+    }
+    if (strchr("%_\\", *q))
+      ok = buf_cat(b, "\\", 1);
+    if (!ok || !buf_cat(b, q, 1))
+      return 0;
+    wild = 0;
+  }
+  return wild || buf_cat(b, "%", 1);
+}
+
+/* make the query of the live picker for an empty pattern: the
+ * conditions of the picker, without the one of the pattern, which
+ * would match every row. it's a query of its own: the other one
+ * (prepared by the daemon) then keeps a plan that the trigram
+ * indexes can serve. it's written to dest (MAX_SIZE bytes) and
+ * passed in the environment. */
+static int
+live_all(struct Stmt* slct, struct Stmt* cnd, int lastedit, char* dest)
+{
+  char cnd_s[SIZE_CND] = "";
+  char limit[32];
+  struct Stmt c, all;
+  init_stmt(&c, cnd_s, SIZE_CND, 0);
+  init_stmt(&all, dest, MAX_SIZE, 0);
+  snprintf(limit, sizeof(limit), "\nlimit %d", live_limit);
+  return append_stmt(&c, cnd->start) && append_lastedit(c, lastedit)
+         && append_stmt(&all, slct->start) && append_stmt(&all, cnd_s)
+         && append_stmt(&all, limit)
+         && setenv(LIVE_ALL_VAR, dest, 1) == 0;
+}
+
 /* queryp2 -- concatenate statement, pipe out and get result.
  *
  * parameters
@@ -41,7 +121,13 @@
  *
  * pick (int):
  *      if the user must pick through the Shell Command or not.
- *      (if value is 0, then it's only output to stdout).
+ *      (if value is 0, then it's only output to stdout). with
+ *      PICK_LIVE (option -L), fzf doesn't filter the rows: each
+ *      change of its query reloads them from the database.
+ *
+ * live (char*):
+ *      the condition matching the query of the live picker (see
+ *      LIVE_ENTRY in stmt.h).
  * */
 int
 queryp2(struct Stmt* slct,
@@ -51,13 +137,28 @@ queryp2(struct Stmt* slct,
   const char* const* params,
   struct ShCmd* sh,
   char* dest,
-  int pick)
+  int pick,
+  char* live)
 {
+  /* the live mode makes no sense to select the last entry (-l). */
+  int is_live = pick == PICK_LIVE && lastedit != LASTEDIT_LAST;
+  int has_cnd = cnd->total != cnd->remain;
 
   /* add a final closing parenthese if there is at least one condition. */
-  if (cnd->total != cnd->remain)
+  if (has_cnd)
     append_stmt(cnd, ")");
 
+  /* in live mode, the rows must match the query typed in fzf: it's
+   * the last parameter. the first rows are those of an empty query,
+   * which has its own query. */
+  char all[MAX_SIZE];
+  if (is_live
+      && (!live_all(slct, cnd, lastedit, all)
+          || !append_stmt(cnd, has_cnd ? "\nand (" : "\nwhere (")
+          || !append_match(cnd, live, npar + 1)
+          || !append_stmt(cnd, ")")))
+    return 0;
+
   /* append the order clause to the conditional clause.*/
   append_lastedit(*cnd, lastedit);
 
@@ -66,44 +167,186 @@ queryp2(struct Stmt* slct,
     return 0;
   }
 
-  /* connect to the database */
-  CONNECT
-
-  /* send a query. */
-  PGresult* res = PQexecParams(
-    conn, slct->start, npar, NULL, params, NULL, NULL, 0);
-
-  /* check the result.*/
-  if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-    fprintf(stderr, "query failed:\n %s\n", PQerrorMessage(conn));
-    PQfinish(conn);
-    PQclear(res);
-    return 0;
+  /* the live picker: the query (and its parameters) is passed to
+   * the binding change:reload (retrolire _search {q}, that is
+   * live_search) in the environment, and the first rows are those
+   * of an empty query. */
+  const char* query = slct->start;
+  if (is_live) {
+    char limit[32];
+    char name[sizeof(LIVE_PARAM_VAR) + 12];
+    snprintf(limit, sizeof(limit), "\nlimit %d", live_limit);
+    if (!append_stmt(slct, limit)
+        || setenv(LIVE_QUERY_VAR, slct->start, 1) != 0)
+      return 0;
+    for (int i = 0; i < npar; i++) {
+      snprintf(name, sizeof(name), LIVE_PARAM_VAR "%d", i + 1);
+      if (setenv(name, params[i], 1) != 0)
+        return 0;
+    }
+    query = all;
+    append_sh(sh, "--disabled");
+    append_sh(sh, "--bind");
+    append_sh(sh, "change:reload(retrolire _search {q})");
   }
 
-  /* if there is no result, i still exit with success code, but
-   * i don't pipe the command, as it's useless. */
-  else if (PQntuples(res) == 0) {
-    PQfinish(conn);
-    PQclear(res);
+  /* send the query with COPY or in single row mode: the rows are
+   * passed to fzf (or printed) while the next ones are still
+   * coming. */
+  struct Rows rows = { 0 };
+  rows.conn = copy_rows ? exec_copy_out(query, npar, params)
+                        : exec_single_rows(query, npar, params);
+  if (rows.conn == NULL) {
+    fprintf(
+      stderr, "query failed:\n %s\n", PQerrorMessage(db_conn()));
     return 0;
   }
 
-  /* end connection before pipe or popen, for safety. */
-  PQfinish(conn);
+  /* if there is no result, i don't pipe the command, as it's
+   * useless. */
+  if (!first_row(&rows))
+    return 0;
 
   /* fzf is called here (only if parameter 'pick' is 1, else
    * the result is only printed to stdout.)*/
-  if (pick == 1)
-    pgpopen2(res, "\n\t", '\0', dest, 1000, sh->args[0], sh->args);
+  if (pick)
+    return pgpopen2(
+      &rows, "\n\t", '\0', dest, VAL_SIZE - 1, sh->args[0], sh->args);
+  return write_rows(&rows, "\n\t", '\0', stdout);
+}
+
+int
+live_search(const char* q)
+{
+  const char* query = getenv(LIVE_QUERY_VAR);
+  const char* all = getenv(LIVE_ALL_VAR);
+  if (!query || !all) {
+    fputs("no live picker (option -L).\n", stderr);
+    return 0;
+  }
+
+  /* the parameters of the picker, then the pattern, unless it's
+   * empty. */
+  const char* params[MAXOPT + 1];
+  char name[sizeof(LIVE_PARAM_VAR) + 12];
+  int npar = 0;
+  for (; npar < MAXOPT; npar++) {
+    snprintf(name, sizeof(name), LIVE_PARAM_VAR "%d", npar + 1);
+    if ((params[npar] = getenv(name)) == NULL)
+      break;
+  }
+  struct Buf pattern = { 0 };
+  if (!live_pattern(q, &pattern)) {
+    free(pattern.s);
+    return 0;
+  }
+  if (strcmp(pattern.s, "%") == 0)
+    query = all;
   else
-    write_res(res, "\n\t", '\0', stdout);
+    params[npar++] = pattern.s;
 
-  /* clear and exit */
+  /* a few rows: the whole result is sent at once (by the daemon,
+   * if it's running). */
+  PGresult* res = exec_params(query, npar, params);
+  free(pattern.s);
+  if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+    fprintf(stderr, "query failed:\n %s\n", result_error(res));
+    PQclear(res);
+    return 0;
+  }
+  write_res(res, "\n\t", '\0', stdout);
   PQclear(res);
   return 1;
 }
 
+/* the ranking of match_rows: the query, the best rows, the number
+ * of rows seen, and the row being copied. */
+struct Ranking
+{
+  struct Fuzzy fz;
+  struct Top top;
+  long n;
+  struct Buf row;
+};
+
+/* score a batch of rows, and keep the best ones. */
+static int
+match_batch(PGresult* res, void* data)
+{
+  struct Ranking* r = data;
+  int n_rows = PQntuples(res);
+  int n_fields = PQnfields(res);
+  struct FuzzyScore sc;
+  for (int i = 0; i < n_rows; i++, r->n++) {
+    if (!fuzzy_match(&r->fz, res, i, &sc))
+      continue;
+    sc.n = r->n;
+    if (!top_enters(&r->top, &sc))
+      continue;
+    /* the values are separated as in the output of queryp2. */
+    r->row.len = 0;
+    for (int j = 0; j < n_fields; j++) {
+      if ((j > 0 && !buf_cat(&r->row, "\n\t", 2))
+          || !buf_cat(&r->row,
+            PQgetvalue(res, i, j),
+            (size_t)PQgetlength(res, i, j)))
+        return FETCH_ERROR;
+    }
+    if (!top_add(&r->top, &sc, r->row.s, r->row.len))
+      return FETCH_ERROR;
+  }
+  return FETCH_NEXT;
+}
+
+int
+match_rows(struct Stmt* slct,
+  struct Stmt* cnd,
+  int lastedit,
+  int npar,
+  const char* const* params,
+  const char* query,
+  int top,
+  int exact)
+{
+  if (top < 1) {
+    fputs("the number of rows (--top) must be positive.\n", stderr);
+    return 0;
+  }
+  if (cnd->total != cnd->remain)
+    append_stmt(cnd, ")");
+  append_lastedit(*cnd, lastedit);
+  if (append_stmt(slct, cnd->start) == 0)
+    return 0;
+
+  struct Ranking r = { .n = 0 };
+  if (!fuzzy_init(&r.fz, query, exact))
+    return 0;
+  if (!top_init(&r.top, top)) {
+    fuzzy_free(&r.fz);
+    return 0;
+  }
+  /* the rows are scored by batches, while the next one is fetched. */
+  int code = fetch_cursor(
+    slct->start, npar, params, MATCH_BATCH, match_batch, &r);
+  /* nothing is written if it failed: the best rows of a part of
+   * the result are not the best rows. */
+  struct Output o;
+  if (code && r.top.n > 0) {
+    code = output_open(&o, stdout);
+    top_sort(&r.top);
+    for (int i = 0; code && i < r.top.n; i++) {
+      output_write(&o, r.top.m[i].row, r.top.m[i].row_len);
+      output_char(&o, '\0');
+    }
+    if (code)
+      code = output_close(&o);
+  }
+  free(r.row.s);
+  top_free(&r.top);
+  fuzzy_free(&r.fz);
+  return code;
+}
+
 void
 print_error_no_arg(char* argname)
 {
@@ -175,6 +418,35 @@ command_add(char* method, char* identifier)
   return 1;
 }
 
+/* the pager for list, opened with the first batch of entries. */
+struct ListPager
+{
+  FILE* f;
+  int term_width;
+};
+
+static int
+list_batch(PGresult* res, void* data)
+{
+#define CMD "bat -p"
+  struct ListPager* pager = data;
+  if (pager->f == NULL) {
+    pager->f = popen(CMD, "w");
+    if (!pager->f) {
+      fputs("error opening pager.\n", stderr);
+      return FETCH_ERROR;
+    }
+    return print_result(res, pager->f, pager->term_width)
+             ? FETCH_NEXT
+             : FETCH_ERROR;
+  }
+  /* it fails if the pager has been quit: the listing ends there. */
+  return print_next_rows(res, pager->f, pager->term_width)
+           ? FETCH_NEXT
+           : FETCH_STOP;
+#undef CMD
+}
+
 /* list -- list entries that matches filters criterias.
  *
  * parameters
@@ -199,8 +471,6 @@ list(struct Stmt* cnd,
   const char* params[MAXOPT],
   char* arg) // TODO: list tag 0/1 instead
 {
-#define FILEPATH "/tmp/retrolire.XXXXXX"
-#define CMD "bat -p "
   char slct_s[MAX_SIZE] = "";
   ;
   struct Stmt slct;
@@ -216,75 +486,55 @@ list(struct Stmt* cnd,
   if (append_stmt(&slct, cnd->start) == 0) {
     return 0;
   };
-  /* connect to the database and send the SELECT query.
-   * if the status is failing, end function. */
-  CONNECT;
-  PGresult* res = PQexecParams(
-    conn, slct.start, npar, NULL, params, NULL, NULL, 0);
-  if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-    fprintf(stderr, "query failed:\n %s\n", PQerrorMessage(conn));
-    PQclear(res);
-    PQfinish(conn);
-    return 0;
-  }
-  PQfinish(conn);
-  /* open a pipe to the pager LESS. if the pipe openning succeed,
-   * then use it to print entris. else, just use stdout.
-   * then clear the result and close the connection. */
-  int term_width = get_term_width();
-  /* create a temporary file name, open the file and write the
-   * result of the query. then close it. if the file cannot be
-   * created or cannot be opened, exit function. */
-  char fname[sizeof(FILEPATH) + 1] = FILEPATH;
-  int fd = mkstemp(fname);
-  if (fd == -1) {
-    fputs("error creating temporary file.\n", stderr);
-    return 0;
-  }
-  FILE* f = fdopen(fd, "w");
-  if (!f) {
-    fputs("error opening file.\n", stderr);
-    close(fd);
-    return 0;
-  }
-  print_result(res, f, term_width);
-  /* free memory of query (not usefull anymore) and close the
-   * file.*/
-  PQclear(res);
-  /* close file and file descriptor. */
-  fclose(f);
-  close(fd);
-  /* generate the command `less /tmp.retrolire.XXXXXX` */
-  char cmd[sizeof(FILEPATH) + sizeof(CMD) + 2] = "";
-  char* x = &cmd[0];
-  size_t csize = sizeof(cmd);
-  x = memccpy(x, CMD, '\0', csize);
-  if (!x) {
-    fputs("error with memccpy (edit_in_editor).\n", stderr);
-    remove(fname);
-    return 0;
-  }
-  /* check that there is still enough space */
-  size_t gap = (size_t)(x - cmd);
-  if (gap >= csize) {
-    remove(fname);
-    return 0;
-  }
-  csize -= gap;
-  /* copy the filename */
-  x = memccpy(x - 1, fname, '\0', csize);
-  if (!x) {
-    fputs("error (list).\n", stderr);
-    remove(fname);
-    return 0;
+  /* the entries are read with a cursor, by batches, and each batch
+   * is piped to the pager as soon as it arrives. the pager can be
+   * quit before the end of the listing: i don't want SIGPIPE to end
+   * the program then. */
+  struct ListPager pager = { NULL, get_term_width() };
+  struct sigaction ignore = { .sa_handler = SIG_IGN }, old;
+  sigaction(SIGPIPE, &ignore, &old);
+  int code = fetch_cursor(
+    slct.start, npar, params, LIST_BATCH, list_batch, &pager);
+  if (pager.f != NULL)
+    pclose(pager.f);
+  sigaction(SIGPIPE, &old, NULL);
+  return code;
+}
+
+/* the output of json, and the number of entries written. */
+struct JsonOut
+{
+  struct Output o;
+  int n;
+  int lines;
+};
+
+/* write a batch of entries. as a JSON array, the entries are pretty
+ * printed and indented (like jsonb_pretty does for an array). in
+ * NDJSON, there is one entry per line. */
+static int
+json_batch(PGresult* res, void* data)
+{
+  struct JsonOut* out = data;
+  int n_rows = PQntuples(res);
+  for (int i = 0; i < n_rows; i++, out->n++) {
+    const char* p = PQgetvalue(res, i, 0);
+    const char* end = p + PQgetlength(res, i, 0);
+    if (out->lines) {
+      output_write(&out->o, p, (size_t)(end - p));
+      output_char(&out->o, '\n');
+      continue;
+    }
+    output_str(&out->o, (out->n == 0) ? "[\n" : ",\n");
+    while (p < end) {
+      const char* nl = memchr(p, '\n', (size_t)(end - p));
+      const char* line_end = (nl != NULL) ? nl + 1 : end;
+      output_write(&out->o, "    ", 4);
+      output_write(&out->o, p, (size_t)(line_end - p));
+      p = line_end;
+    }
   }
-  /* call system with the less command. */
-  system(cmd);
-  /* remove the temporary file. */
-  remove(fname);
-  return 1;
-#undef FILEPATH
-#undef CMD
+  return out->o.error ? FETCH_ERROR : FETCH_NEXT;
 }
 
 /* json -- list entries in JSON entries.
@@ -300,38 +550,45 @@ list(struct Stmt* cnd,
  *
  * params (const char*):
  *      the parameters for the SQL.
+ *
+ * arg (char*):
+ *      the first positional argument: if it's 'lines', the entries
+ *      are written in NDJSON (one entry per line) instead of an
+ *      array.
  * */
 int
-json(struct Stmt* cnd, int npar, const char* params[MAXOPT])
+json(struct Stmt* cnd,
+  int npar,
+  const char* params[MAXOPT],
+  char* arg)
 {
-  CONNECT;
+  int lines = arg != NULL && strstarts("lines", arg);
   char slct_s[MAX_SIZE] = "";
   struct Stmt slct;
   init_stmt(&slct, slct_s, MAX_SIZE, 0);
   if (append_stmt(&slct,
-        "select jsonb_pretty(jsonb_agg(to_csl(e)))"
-        "from entry e join reading r on r.id = e.id\n") == 0) {
+        lines ? "select to_csl(e)::text "
+                "from entry e join reading r on r.id = e.id\n"
+              : "select jsonb_pretty(to_csl(e)) "
+                "from entry e join reading r on r.id = e.id\n") ==
+      0) {
     return 0;
   };
   if (append_stmt(&slct, cnd->start) == 0) {
     return 0;
   };
-  PGresult* res = PQexecParams(
-    conn, slct.start, npar, NULL, params, NULL, NULL, 0);
-  if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-    fprintf(stderr, "query failed:\n %s\n", PQerrorMessage(conn));
-    PQclear(res);
-    PQfinish(conn);
-    return 0;
-  }
-  PQfinish(conn);
-  if (PQntuples(res) == 0) {
-    PQclear(res);
+  /* the entries are read with a cursor, and written as they come:
+   * the array is made here, not by the database. */
+  struct JsonOut out = { .n = 0, .lines = lines };
+  if (!output_open(&out.o, stdout))
     return 0;
-  }
-  puts(PQgetvalue(res, 0, 0));
-  PQclear(res);
-  return 1;
+  int code = fetch_cursor(
+    slct.start, npar, params, JSON_BATCH, json_batch, &out);
+  /* if it failed, the array isn't closed: the output is not mistaken
+   * for a whole (and valid) listing. */
+  if (code && !lines)
+    output_str(&out.o, (out.n == 0) ? "[]\n" : "\n]\n");
+  return output_close(&out.o) && code;
 }
 
 /* make_stmt_quote -- make the SQL for quotes.
@@ -481,12 +738,7 @@ command_tag_edit(char* id, char* pos[MAXPOS], int npos)
 int
 command_edit(char* id, char* pos[MAXPOS], int npos)
 {
-  char ext[sizeof("md") + 1] = "md";
-  return edit_value(id,
-    "select notes from reading where id = $1::text",
-    "update reading set notes = trim($2::text, E'\n\t ') || E'\n'"
-    "\nwhere id = $1::text",
-    ext);
+  return edit_notes(id);
 }
 
 /* command_open -- open an URL/file attached to an entry.
@@ -512,36 +764,26 @@ command_open(char* id, char* pos[MAXPOS], int npos)
                 "union select \"URL\" from entry\n"
                 "where id = $1 and \"URL\" is not null";
 
-  /* connect to database and send query. ensure that query did not
+  /* send query. ensure that query did not
    * failed and if it succeed, pipe out the file to the program
    * defined as $OPENER or to xdg-open. */
-  CONNECT;
-  PGresult* res = PQexecParams(conn,
+  PGresult* res = exec_params(
     "select filepath from file where entry = $1\n"
     "union select \"URL\" from entry\n"
     "where id = $1 and \"URL\" is not null",
     1,
-    NULL,
-    params,
-    NULL,
-    NULL,
-    0);
+    params);
   if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-    fprintf(stderr, "query failed:\n %s\n", PQerrorMessage(conn));
+    fprintf(stderr, "query failed:\n %s\n", result_error(res));
     PQclear(res);
-    PQfinish(conn);
     return 0;
   } else if (PQntuples(res) == 0) {
     fputs("no file for this entry.\n", stderr);
-    PQfinish(conn);
     PQclear(res);
     return 0;
   }
 
-  update_lastedit(conn, id);
-
-  /* end connection before fork/pipe/execvp, for safety. */
-  PQfinish(conn);
+  update_lastedit(id);
 
   /* make the statement */
   char cmd[MAX_SIZE] = "";
@@ -625,28 +867,21 @@ command_quote(char* quote_id, char* pos[MAXPOS], int npos)
 int
 command_delete(char* id, char* pos[MAXPOS], int npos)
 {
-  /* connect to database. */
-  CONNECT
   /* send query*/
   const char* params[1] = { id };
-  PGresult* res = PQexecParams(conn,
-    "delete from entry where id = $1",
+  PGresult* res = exec_params("delete from entry where id = $1",
     1,
-    NULL,
-    params,
-    NULL,
-    NULL,
-    0);
+    params);
   /* check status. */
   int code;
   if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-    fprintf(stderr, "deletion failed: %s\n", PQerrorMessage(conn));
+    fprintf(stderr, "deletion failed: %s\n", result_error(res));
     code = 0;
   }
   code = 1;
+  previews_invalidate(id);
   /* free memory and exit function*/
   PQclear(res);
-  PQfinish(conn);
   return code;
 }
 
@@ -675,29 +910,22 @@ command_file(char* id, char* pos[MAXPOS], int npos)
 
   const char* const params[] = { id, filepath_real, NULL };
 
-  /* connect to database. */
-  CONNECT
-  PGresult* res = PQexecParams(conn,
-    "insert into file (entry, filepath)\n"
+  PGresult* res = exec_params("insert into file (entry, filepath)\n"
     "select $1, $2",
     2,
-    NULL,
-    params,
-    NULL,
-    NULL,
-    0);
+    params);
 
   /* check status. */
   if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-    fprintf(stderr, "insert failed: %s\n", PQerrorMessage(conn));
+    fprintf(stderr, "insert failed: %s\n", result_error(res));
     code = 0;
   }
 
   code = 1;
+  previews_invalidate(id);
 
   /* free memory and exit function*/
   PQclear(res);
-  PQfinish(conn);
   return code;
 }
 
@@ -718,8 +946,6 @@ command_file(char* id, char* pos[MAXPOS], int npos)
 int
 command_tag_pick(char* id, char* pos[MAXPOS], int npos)
 {
-  /* connect to database. */
-  CONNECT
   /* the first operation to do is to put the entry id in the cache
    * (so it can be previewed in fzf). */
   char* params[VAL_SIZE] = { id };
@@ -730,33 +956,26 @@ command_tag_pick(char* id, char* pos[MAXPOS], int npos)
   /* insert entry id in _cache table.
    * first, insert an empty line into _cache (a table with only
    * one row, that i just update). */
-  PGresult* res = PQexec(
-    conn, "insert into _cache select on conflict do nothing");
+  PGresult* res = exec_params(
+    "insert into _cache select on conflict do nothing", 0, NULL);
   if (PQresultStatus(res) != PGRES_COMMAND_OK) {
     fprintf(stderr,
       "setting cache value failed: %s\n",
-      PQerrorMessage(conn));
+      result_error(res));
     return 0;
   }
   PQclear(res);
   /* then, update the row with the tags values. */
-  res = PQexecParams(conn,
-    "update _cache set entry = $1",
+  res = exec_params("update _cache set entry = $1",
     1,
-    NULL,
-    (const char**)params,
-    NULL,
-    NULL,
-    0);
+    (const char**)params);
   if (PQresultStatus(res) != PGRES_COMMAND_OK) {
     fprintf(stderr,
       "setting cache value failed: %s\n",
-      PQerrorMessage(conn));
+      result_error(res));
     return 0;
   }
   PQclear(res);
-  /* end connection before forking, for safety. */
-  PQfinish(conn);
   /* open a pipe: user will chose tags with fzf among already used
    * tags. the pipe is open in READING mode, because the current
    * function send nothing to it (tags are read from retrolire
@@ -820,29 +1039,20 @@ command_tag_pick(char* id, char* pos[MAXPOS], int npos)
   arrayagg(&sql, tags_placeholders, npar);
   append_stmt(&sql, ", '')) on conflict do nothing");
 
-  /* reconnect to database.*/
-  RECONNECT
-
   /* send query. */
-  res = PQexecParams(conn,
-    sql.start,
-    npar + 1,
-    NULL,
-    (const char**)params,
-    NULL,
-    NULL,
-    0);
+  res = exec_params(sql.start, npar + 1, (const char**)params);
 
   /* check sent query status. */
   int code = 1;
   if (PQresultStatus(res) != PGRES_COMMAND_OK) {
     fprintf(stderr,
       "error sending query to database:\n%s\n",
-      PQerrorMessage(conn));
+      result_error(res));
     code = 0;
   }
   PQclear(res);
-  PQfinish(conn);
+  if (code)
+    previews_invalidate(id);
   return code;
 }
 
@@ -869,9 +1079,6 @@ command_update(char* id, char* pos[MAXPOS], int npos)
   }
   char* field = pos[0];
 
-  /* connect to the database. */
-  CONNECT;
-
   /* initiate a Stmt for the SQL select statement. */
   char slct_s[MAX_STMT_LEN] = "";
   struct Stmt slct;
@@ -884,9 +1091,8 @@ command_update(char* id, char* pos[MAXPOS], int npos)
 
   /* escape field using libpq functions. */
   char* escaped_field =
-    PQescapeIdentifier(conn, field, strlen(field));
+    PQescapeIdentifier(db_conn(), field, strlen(field));
   if (escaped_field == NULL) {
-    PQfinish(conn);
     exit(EXIT_FAILURE);
   }
 
@@ -897,22 +1103,27 @@ command_update(char* id, char* pos[MAXPOS], int npos)
 
   /* check that field exists. and if it exists, look if its datatype
    * is text or something else, because if it's text, i remove
-   * trailing newline. */
+   * trailing newline. the current value is selected in the same
+   * pipeline. */
   const char* params[1] = { field };
+  const char* params_id[1] = { id };
+  struct Query queries[] = {
+    { .query = "select data_type from information_schema.columns "
+               "where table_name = 'entry' and column_name = $1;",
+      .npar = 1,
+      .params = params },
+    { .query = slct_s, .npar = 1, .params = params_id },
+  };
+  PGresult* res[2];
+  if (!exec_pipeline(queries, 2, res)) {
+    free(escaped_field);
+    return 0;
+  }
   int datatype_test = 0;
-  PGresult* res = PQexecParams(conn,
-    "select data_type from information_schema.columns where "
-    "table_name = 'entry' and column_name = $1;",
-    1,
-    NULL,
-    params,
-    NULL,
-    NULL,
-    0);
-  if (PQresultStatus(res) != PGRES_TUPLES_OK ||
-      PQntuples(res) == 0) {
-    PQfinish(conn);
-    PQclear(res);
+  if (PQresultStatus(res[0]) != PGRES_TUPLES_OK ||
+      PQntuples(res[0]) == 0) {
+    PQclear(res[0]);
+    PQclear(res[1]);
     free(escaped_field);
     fputs("invalid field.\n", stderr);
     exit(EXIT_FAILURE);
@@ -920,11 +1131,10 @@ command_update(char* id, char* pos[MAXPOS], int npos)
 
   /* store as an integer that said if the datatype is text or not.
    */
-  datatype_test = strcmp("text", PQgetvalue(res, 0, 0));
+  datatype_test = strcmp("text", PQgetvalue(res[0], 0, 0));
 
-  /* clear query and end connection. */
-  PQclear(res);
-  PQfinish(conn);
+  /* clear query. */
+  PQclear(res[0]);
 
   /* chain concatenate the update statemente. */
   append_stmt(&slct_up, "update entry set ");
@@ -938,7 +1148,7 @@ command_update(char* id, char* pos[MAXPOS], int npos)
 
   /* edit the value. */
   char ext[sizeof(".txt") + 1] = ".txt";
-  return edit_value(id, slct_s, slct_up_s, ext);
+  return edit_result(id, res[1], slct_up_s, ext);
 }
 
 /* command_cite -- cite an entry (get its ID).
@@ -1008,19 +1218,19 @@ check_command_name(char* cmd)
     "open",
     "file",
     "tag",
+    "daemon",
+    "catalog",
     NULL };
   // iterate over the commands names. if the command passed as
   // argument starts with the same letter than a command, check that
-  // is a part of that command.
+  // is a part of that command. (two commands can start with the
+  // same letter, e.g. 'delete' and 'daemon', so all are checked.)
   for (int i = 0;; i++) {
     if (available_cmds[i] == NULL) {
       return 0;
     }
     const char* s = available_cmds[i];
-    if (s[0] == cmd[0]) {
-      if (!strstarts(s, cmd)) {
-        return 0;
-      }
+    if (s[0] == cmd[0] && strstarts(s, cmd)) {
       return 1;
     }
   }
@@ -40,7 +40,9 @@ check_command_name(char* s);
 
 /* send a query (SELECT) to the database, pipe out the result (all
  * values and rows) to a shell subprocess (fork + execvp), then read
- * the result of that subprocess and store it into 'dest'.
+ * the result of that subprocess and store it into 'dest'. returns 0
+ * if the query failed (even after some rows were piped out) or gave
+ * no row.
  * */
 int
 queryp2(struct Stmt* slct,
@@ -50,7 +52,26 @@ queryp2(struct Stmt* slct,
   const char* const* params,
   struct ShCmd* sh,
   char* dest,
-  int pick);
+  int pick,
+  char* live);
+
+/* print the rows of the live picker matching a query (see queryp2,
+ * option -L), for the fzf binding change:reload. */
+int
+live_search(const char* q);
+
+/* rank the rows of the query (as queryp2 would pass them to fzf)
+ * with a fuzzy query, and print the top best ones, without picking
+ * (options --match and --top, see fuzzy.h). */
+int
+match_rows(struct Stmt* slct,
+  struct Stmt* cnd,
+  int lastedit,
+  int npar,
+  const char* const* params,
+  const char* query,
+  int top,
+  int exact);
 
 /* cite quote. */
 int
@@ -69,6 +90,9 @@ list(struct Stmt* cnd,
 
 /* output entries matching criterias in JSON format. */
 int
-json(struct Stmt* cnd, int npar, const char* params[MAXOPT]);
+json(struct Stmt* cnd,
+  int npar,
+  const char* params[MAXOPT],
+  char* arg);
 
 #endif
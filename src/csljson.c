@@ -0,0 +1,321 @@
+#include <postgresql/libpq-fe.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "csljson.h"
+#include "util.h"
+
+/* the size of the chunks read from the file. */
+#define CHUNK_SIZE 65536
+
+/* the state of the splitter: the object being read (obj), where it
+ * is in it (depth, in a string, after a backslash) and where is the
+ * value of its field annote, if it's a string. */
+struct Splitter
+{
+  struct Buf obj;
+  int depth;
+  int in_string;
+  int escape;
+  /* at depth 1, a string is a key after '{' or ','. */
+  int expect_key;
+  size_t string_start;
+  int annote_key;
+  size_t annote_start;
+  size_t annote_end;
+  /* the line sent for an object (escaped for the COPY). */
+  struct Buf line;
+};
+
+/* if the field annote is a filepath (maybe starting with '~'), its
+ * value is replaced by the content of that file, as csl2psql does.
+ * returns 0 on error (memory). */
+static int
+replace_annote(struct Splitter* sp)
+{
+  /* the value, without its double quotes: it's only used if it has
+   * no escaped character (a filepath rarely has one). */
+  const char* v = sp->obj.s + sp->annote_start + 1;
+  size_t len = sp->annote_end - sp->annote_start - 2;
+  if (memchr(v, '\\', len))
+    return 1;
+  while (len > 0 && strchr(" \t\n\r", v[0])) {
+    v++;
+    len--;
+  }
+  while (len > 0 && strchr(" \t\n\r", v[len - 1]))
+    len--;
+  struct Buf path = { 0 };
+  const char* home = getenv("HOME");
+  if (len > 0 && v[0] == '~' && (len == 1 || v[1] == '/') && home) {
+    if (!buf_cat(&path, home, strlen(home)))
+      return 0;
+    v++;
+    len--;
+  }
+  if (!buf_cat(&path, v, len))
+    return 0;
+  struct stat st;
+  FILE* f = NULL;
+  if (stat(path.s, &st) == 0 && S_ISREG(st.st_mode))
+    f = fopen(path.s, "r");
+  free(path.s);
+  if (!f)
+    return 1;
+
+  /* read the file, and rebuild the object around its content. */
+  struct Buf content = { 0 };
+  char chunk[4096];
+  size_t n;
+  int ok = buf_cat(&content, "", 0);
+  while (ok && (n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    ok = buf_cat(&content, chunk, n);
+  fclose(f);
+  struct Buf obj = { 0 };
+  ok = ok && buf_cat(&obj, sp->obj.s, sp->annote_start)
+       && json_string(&obj, content.s, content.len)
+       && buf_cat(&obj,
+         sp->obj.s + sp->annote_end,
+         sp->obj.len - sp->annote_end);
+  free(content.s);
+  if (!ok) {
+    free(obj.s);
+    return 0;
+  }
+  free(sp->obj.s);
+  sp->obj = obj;
+  return 1;
+}
+
+/* send a whole object as a line of the COPY (in the text format: the
+ * backslashes and the control characters are escaped). */
+static int
+send_object(PGconn* conn, struct Splitter* sp)
+{
+  if (sp->annote_end > 0 && !replace_annote(sp))
+    return 0;
+  struct Buf* l = &sp->line;
+  l->len = 0;
+  const char* s = sp->obj.s;
+  size_t i, from = 0;
+  for (i = 0; i < sp->obj.len; i++) {
+    char esc;
+    switch (s[i]) {
+      case '\\':
+        esc = '\\';
+        break;
+      case '\n':
+        esc = 'n';
+        break;
+      case '\r':
+        esc = 'r';
+        break;
+      case '\t':
+        esc = 't';
+        break;
+      default:
+        continue;
+    }
+    char e[2] = { '\\', esc };
+    if (!buf_cat(l, s + from, i - from) || !buf_cat(l, e, 2))
+      return 0;
+    from = i + 1;
+  }
+  if (!buf_cat(l, s + from, sp->obj.len - from)
+      || !buf_cat(l, "\n", 1))
+    return 0;
+  if (PQputCopyData(conn, l->s, (int)l->len) != 1) {
+    fprintf(stderr, "copy failed: %s", PQerrorMessage(conn));
+    return 0;
+  }
+  return 1;
+}
+
+/* at the end of a string: at depth 1, it's a key or a value. */
+static void
+end_string(struct Splitter* sp)
+{
+  sp->in_string = 0;
+  if (sp->depth != 1)
+    return;
+  if (sp->expect_key) {
+    const char* key = sp->obj.s + sp->string_start + 1;
+    size_t len = sp->obj.len - sp->string_start - 2;
+    sp->annote_key = len == 6 && memcmp(key, "annote", 6) == 0;
+    sp->expect_key = 0;
+  } else if (sp->annote_key) {
+    sp->annote_start = sp->string_start;
+    sp->annote_end = sp->obj.len;
+    sp->annote_key = 0;
+  }
+}
+
+/* split a chunk of the file into objects, sent as they are complete.
+ * returns 0 on error. */
+static int
+split(PGconn* conn, struct Splitter* sp, const char* s, size_t n)
+{
+  size_t i = 0;
+  while (i < n) {
+    /* between the objects (the array). */
+    if (sp->depth == 0) {
+      char c = s[i++];
+      if (c == '{') {
+        sp->obj.len = 0;
+        sp->depth = 1;
+        sp->expect_key = 1;
+        sp->annote_key = 0;
+        sp->annote_end = 0;
+        if (!buf_cat(&sp->obj, "{", 1))
+          return 0;
+      } else if (!strchr(" \t\n\r[],", c)) {
+        fputs("not a csl-json array of objects.\n", stderr);
+        return 0;
+      }
+      continue;
+    }
+
+    /* in a string: everything up to the next double quote or
+     * backslash is copied at once (the character after a backslash
+     * is copied as it is). */
+    if (sp->in_string) {
+      size_t j = i;
+      if (sp->escape) {
+        sp->escape = 0;
+        j++;
+      }
+      while (j < n && s[j] != '"' && s[j] != '\\')
+        j++;
+      if (j == n) {
+        if (!buf_cat(&sp->obj, s + i, n - i))
+          return 0;
+        break;
+      }
+      if (!buf_cat(&sp->obj, s + i, j + 1 - i))
+        return 0;
+      i = j + 1;
+      if (s[j] == '\\')
+        sp->escape = 1;
+      else
+        end_string(sp);
+      continue;
+    }
+
+    char c = s[i++];
+    if (!buf_cat(&sp->obj, &c, 1))
+      return 0;
+    switch (c) {
+      case '"':
+        sp->in_string = 1;
+        sp->string_start = sp->obj.len - 1;
+        break;
+      case '{':
+      case '[':
+        sp->depth++;
+        break;
+      case '}':
+      case ']':
+        if (--sp->depth == 0 && !send_object(conn, sp))
+          return 0;
+        break;
+      case ',':
+        if (sp->depth == 1) {
+          sp->expect_key = 1;
+          sp->annote_key = 0;
+        }
+        break;
+    }
+  }
+  return 1;
+}
+
+int
+import_csljson(const char* filepath)
+{
+  FILE* f = strcmp(filepath, "-") == 0 ? stdin : fopen(filepath, "r");
+  if (!f) {
+    fprintf(stderr, "error opening file: %s\n", filepath);
+    return 0;
+  }
+  PGconn* conn = db_conn();
+  PGresult* res[2];
+
+  /* the transaction and its temporary table. */
+  struct Query start[] = {
+    { .query = "begin" },
+    { .query = "create temp table _import (n integer generated "
+               "always as identity, obj jsonb) on commit drop" },
+  };
+  int sent = pipeline_on(conn, start, NULL, 2, res);
+  /* the error of the first query that failed (the queries not sent
+   * have an error result). */
+  int ok = 1;
+  for (int i = 0; i < 2; i++) {
+    if (ok && PQresultStatus(res[i]) != PGRES_COMMAND_OK) {
+      fprintf(stderr, "query failed:\n %s\n", result_error(res[i]));
+      ok = 0;
+    }
+    PQclear(res[i]);
+  }
+  ok = ok && sent;
+
+  /* copy the objects, as the file is read. */
+  struct Splitter sp = { 0 };
+  if (ok) {
+    PGresult* r = PQexec(conn, "copy _import (obj) from stdin");
+    ok = PQresultStatus(r) == PGRES_COPY_IN;
+    if (!ok)
+      fprintf(stderr, "query failed:\n %s\n", result_error(r));
+    PQclear(r);
+  }
+  if (ok) {
+    char* chunk = malloc(CHUNK_SIZE);
+    size_t n;
+    ok = chunk != NULL;
+    while (ok && (n = fread(chunk, 1, CHUNK_SIZE, f)) > 0)
+      ok = split(conn, &sp, chunk, n);
+    free(chunk);
+    if (ok && (sp.depth != 0 || ferror(f))) {
+      fputs("incomplete csl-json file.\n", stderr);
+      ok = 0;
+    }
+    /* end the copy (an error message makes it fail), and read its
+     * result. */
+    PQputCopyEnd(conn, ok ? NULL : "invalid csl-json");
+    PGresult* r;
+    while ((r = PQgetResult(conn)) != NULL) {
+      if (ok && PQresultStatus(r) != PGRES_COMMAND_OK) {
+        fprintf(stderr, "copy failed:\n %s\n", result_error(r));
+        ok = 0;
+      }
+      PQclear(r);
+    }
+  }
+  free(sp.obj.s);
+  free(sp.line.s);
+  if (f != stdin)
+    fclose(f);
+
+  /* insert the entries, and end the transaction. */
+  struct Query end[] = {
+    { .query = ok ? "select import_entries()" : "select 0" },
+    { .query = ok ? "commit" : "rollback" },
+  };
+  sent = pipeline_on(conn, end, NULL, 2, res);
+  if (ok && PQresultStatus(res[0]) != PGRES_TUPLES_OK) {
+    fprintf(stderr, "import failed:\n %s\n", result_error(res[0]));
+    ok = 0;
+  } else if (ok
+             && (!sent || PQresultStatus(res[1]) != PGRES_COMMAND_OK)) {
+    fprintf(stderr, "import failed:\n %s\n", result_error(res[1]));
+    ok = 0;
+  } else if (ok) {
+    fprintf(
+      stderr, "(%s entries added.)\n", PQgetvalue(res[0], 0, 0));
+  }
+  PQclear(res[0]);
+  PQclear(res[1]);
+  return ok;
+}
@@ -0,0 +1,20 @@
+/* csljson
+ * -------
+ *
+ * import a csl-json bibliography (an array of objects) into the
+ * database. the file is read by chunks, and split into its objects,
+ * which are copied (COPY ... FROM STDIN) into a temporary table, one
+ * by one: the whole file is never held in memory. the SQL function
+ * import_entries (see schema.sql) then inserts them into the table
+ * entry, all in one transaction.
+ *
+ * */
+
+#ifndef _CSLJSON_H
+#define _CSLJSON_H
+
+/* import the csl-json file at filepath ("-" for stdin). */
+int
+import_csljson(const char* filepath);
+
+#endif
@@ -0,0 +1,583 @@
+/* struct ucred. */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "daemon.h"
+#include "sizes.h"
+#include "util.h"
+
+/* limits on what a client can send, so a broken client can't make
+ * the daemon allocate whatever it wants. */
+#define MAX_PARAMS 64
+#define MAX_MSG_LEN (64 * 1024 * 1024)
+
+/* number of statements the daemon keeps prepared. */
+#define MAX_PREPARED 64
+
+/* seconds the daemon waits for a client that doesn't send its
+ * query. (the daemon serves clients one after the other.) */
+#define CLIENT_TIMEOUT 5
+
+/* the error messages of the last results sent by the daemon. (a
+ * result rebuilt from a message can't hold its error message.) */
+static struct
+{
+  const PGresult* res;
+  char msg[MAX_SIZE];
+} errors[MAX_PIPELINE];
+
+/* once a connection to the daemon has failed, don't try again. */
+static int daemon_down = 0;
+
+/* set by the signal handler to end the daemon. */
+static volatile sig_atomic_t stop = 0;
+
+/* a statement prepared by the daemon. */
+struct Cached
+{
+  char* query;
+  char name[PH];
+};
+
+static struct Cached prepared[MAX_PREPARED];
+static int n_prepared = 0;
+
+/* the path of the socket: in $XDG_RUNTIME_DIR if it's set, else in
+ * /tmp, suffixed with the user id. */
+static int
+socket_path(char* dest, size_t size)
+{
+  char* dir = getenv("XDG_RUNTIME_DIR");
+  int n;
+  if (dir != NULL && dir[0] != '\0')
+    n = snprintf(dest, size, "%s/%s", dir, daemon_socket);
+  else
+    n = snprintf(
+      dest, size, "/tmp/%s.%u", daemon_socket, (unsigned)getuid());
+  return n > 0 && (size_t)n < size;
+}
+
+/* test that the other end of a socket is a process of the user. in
+ * /tmp, anyone could have made the socket first, to get the queries
+ * (and the notes) and to send back forged results. */
+static int
+same_user(int fd)
+{
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+  return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0
+         && cred.uid == getuid();
+}
+
+/* send a whole buffer to a socket. (MSG_NOSIGNAL: a closed socket
+ * must not kill the process with SIGPIPE.) */
+static int
+send_all(int fd, const char* buf, size_t size)
+{
+  while (size > 0) {
+    ssize_t n = send(fd, buf, size, MSG_NOSIGNAL);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return 0;
+    buf += n;
+    size -= (size_t)n;
+  }
+  return 1;
+}
+
+/* the messages are made of integers and of strings prefixed by
+ * their length (-1 is for NULL values). the daemon and its clients
+ * are the same program on the same machine, so integers are just
+ * sent in the host byte order. */
+static int
+put_int(FILE* f, int32_t i)
+{
+  return fwrite(&i, sizeof(i), 1, f) == 1;
+}
+
+static int
+get_int(FILE* f, int32_t* i)
+{
+  return fread(i, sizeof(*i), 1, f) == 1;
+}
+
+static int
+put_bytes(FILE* f, const char* s, int32_t len)
+{
+  if (!put_int(f, len))
+    return 0;
+  return len <= 0 || fwrite(s, 1, (size_t)len, f) == (size_t)len;
+}
+
+/* read a string in a buffer that is reallocated when needed. a NULL
+ * value has a length of -1. */
+static int
+get_bytes(FILE* f, char** buf, size_t* cap, int32_t* len)
+{
+  if (!get_int(f, len) || *len < -1 || *len > MAX_MSG_LEN)
+    return 0;
+  if (*len == -1)
+    return 1;
+  size_t needed = (size_t)*len + 1;
+  if (needed > *cap) {
+    char* temp = realloc(*buf, needed);
+    if (temp == NULL)
+      return 0;
+    *buf = temp;
+    *cap = needed;
+  }
+  if (fread(*buf, 1, (size_t)*len, f) != (size_t)*len)
+    return 0;
+  (*buf)[*len] = '\0';
+  return 1;
+}
+
+/* serialize a PGresult and send it to a client. */
+static int
+put_result(int fd, PGresult* res)
+{
+  char* buf = NULL;
+  size_t size = 0;
+  FILE* f = open_memstream(&buf, &size);
+  if (!f)
+    return 0;
+  int n_rows = PQntuples(res);
+  int n_fields = PQnfields(res);
+  char* msg = PQresultErrorMessage(res);
+  put_int(f, (int32_t)PQresultStatus(res));
+  put_bytes(f, msg, (int32_t)strlen(msg));
+  put_int(f, n_fields);
+  for (int j = 0; j < n_fields; j++) {
+    char* name = PQfname(res, j);
+    put_bytes(f, name, (int32_t)strlen(name));
+    put_int(f, (int32_t)PQftype(res, j));
+  }
+  put_int(f, n_rows);
+  for (int i = 0; i < n_rows; i++) {
+    for (int j = 0; j < n_fields; j++) {
+      if (PQgetisnull(res, i, j))
+        put_int(f, -1);
+      else
+        put_bytes(f, PQgetvalue(res, i, j), PQgetlength(res, i, j));
+    }
+  }
+  if (fclose(f) != 0) {
+    free(buf);
+    return 0;
+  }
+  int code = send_all(fd, buf, size);
+  free(buf);
+  return code;
+}
+
+/* read a serialized result and rebuild a PGresult from it. its
+ * error message is copied to msg. */
+static PGresult*
+get_result(FILE* f, char* msg, size_t msg_size)
+{
+  int32_t status, n_fields, n_rows, len;
+  char* buf = NULL;
+  size_t cap = 0;
+
+  if (!get_int(f, &status) || !get_bytes(f, &buf, &cap, &len) ||
+      len == -1)
+    return NULL;
+  snprintf(msg, msg_size, "%s", buf);
+
+  PGresult* res = PQmakeEmptyPGresult(NULL, (ExecStatusType)status);
+  if (!get_int(f, &n_fields) || n_fields < 0) {
+    free(buf);
+    PQclear(res);
+    return NULL;
+  }
+
+  /* fields names (and types). */
+  if (n_fields > 0) {
+    PGresAttDesc* attrs = calloc((size_t)n_fields, sizeof(*attrs));
+    int ok = attrs != NULL;
+    for (int j = 0; ok && j < n_fields; j++) {
+      int32_t type;
+      ok = get_bytes(f, &buf, &cap, &len) && len != -1 &&
+           get_int(f, &type);
+      if (ok) {
+        attrs[j].name = strdup(buf);
+        attrs[j].typid = (Oid)type;
+        attrs[j].typlen = -1;
+        attrs[j].atttypmod = -1;
+      }
+    }
+    if (ok)
+      ok = PQsetResultAttrs(res, n_fields, attrs);
+    for (int j = 0; attrs && j < n_fields; j++)
+      free(attrs[j].name);
+    free(attrs);
+    if (!ok) {
+      free(buf);
+      PQclear(res);
+      return NULL;
+    }
+  }
+
+  /* values. */
+  if (!get_int(f, &n_rows) || n_rows < 0) {
+    free(buf);
+    PQclear(res);
+    return NULL;
+  }
+  for (int i = 0; i < n_rows; i++) {
+    for (int j = 0; j < n_fields; j++) {
+      if (!get_bytes(f, &buf, &cap, &len) ||
+          !PQsetvalue(res, i, j, (len == -1) ? NULL : buf, len)) {
+        free(buf);
+        PQclear(res);
+        return NULL;
+      }
+    }
+  }
+  free(buf);
+  return res;
+}
+
+int
+daemon_exec_queries(const struct Query* queries,
+  int n,
+  PGresult** res)
+{
+  if (daemon_down || n > MAX_PIPELINE)
+    return 0;
+
+  /* connect to the socket. if it fails, the daemon is not running,
+   * and the caller will use a direct connection. */
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1 ||
+      !socket_path(addr.sun_path, sizeof(addr.sun_path)) ||
+      connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+    if (fd != -1)
+      close(fd);
+    daemon_down = 1;
+    return 0;
+  }
+  if (!same_user(fd)) {
+    fprintf(stderr,
+      "the daemon socket (%s) is not yours: not used.\n",
+      addr.sun_path);
+    close(fd);
+    daemon_down = 1;
+    return 0;
+  }
+
+  /* write the queries and their parameters, then send them. */
+  char* buf = NULL;
+  size_t size = 0;
+  FILE* out = open_memstream(&buf, &size);
+  if (!out) {
+    close(fd);
+    return 0;
+  }
+  put_int(out, n);
+  for (int i = 0; i < n; i++) {
+    put_int(out, queries[i].npar);
+    put_bytes(
+      out, queries[i].query, (int32_t)strlen(queries[i].query));
+    for (int j = 0; j < queries[i].npar; j++) {
+      const char* p = queries[i].params[j];
+      put_bytes(out, p, (p == NULL) ? -1 : (int32_t)strlen(p));
+    }
+  }
+  int sent = fclose(out) == 0 && send_all(fd, buf, size);
+  free(buf);
+  if (!sent) {
+    close(fd);
+    daemon_down = 1;
+    return 0;
+  }
+
+  /* read the results. (fclose also closes the socket.) */
+  FILE* in = fdopen(fd, "r");
+  if (!in) {
+    close(fd);
+    return 0;
+  }
+  for (int i = 0; i < MAX_PIPELINE; i++) {
+    errors[i].res = NULL;
+    if (i >= n)
+      continue;
+    res[i] = get_result(in, errors[i].msg, MAX_SIZE);
+    if (res[i] == NULL) {
+      snprintf(
+        errors[i].msg, MAX_SIZE, "lost connection to daemon.\n");
+      res[i] = PQmakeEmptyPGresult(NULL, PGRES_FATAL_ERROR);
+    }
+    errors[i].res = res[i];
+  }
+  fclose(in);
+  return 1;
+}
+
+PGresult*
+daemon_exec(const char* query, int npar, const char* const* params)
+{
+  struct Query q = { .query = query, .npar = npar, .params = params };
+  PGresult* res;
+  if (!daemon_exec_queries(&q, 1, &res))
+    return NULL;
+  return res;
+}
+
+const char*
+daemon_error(const PGresult* res)
+{
+  for (int i = 0; i < MAX_PIPELINE; i++) {
+    if (errors[i].res == res)
+      return errors[i].msg;
+  }
+  return "";
+}
+
+/* forget all prepared statements (e.g. after a reconnection). */
+static void
+forget_prepared()
+{
+  for (int i = 0; i < n_prepared; i++)
+    free(prepared[i].query);
+  n_prepared = 0;
+}
+
+/* get the index of the statement prepared for a query. the
+ * statement is prepared the first time the query is received.
+ * returns -1 if it can't be prepared. */
+static int
+find_cached(PGconn* conn, const char* query)
+{
+  int i;
+  for (i = 0; i < n_prepared; i++) {
+    if (strcmp(prepared[i].query, query) == 0)
+      return i;
+  }
+  if (n_prepared == MAX_PREPARED)
+    return -1;
+  snprintf(prepared[i].name, PH, "_d%d", i);
+  PGresult* res = PQprepare(conn, prepared[i].name, query, 0, NULL);
+  int ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+  PQclear(res);
+  if (!ok)
+    return -1;
+  prepared[i].query = strdup(query);
+  n_prepared++;
+  return i;
+}
+
+/* deallocate a prepared statement. */
+static void
+forget_cached(PGconn* conn, int i)
+{
+  char deallocate[PH + sizeof("deallocate ")] = "";
+  snprintf(deallocate,
+    sizeof(deallocate),
+    "deallocate %s",
+    prepared[i].name);
+  PQclear(PQexec(conn, deallocate));
+  free(prepared[i].query);
+  n_prepared--;
+  prepared[i] = prepared[n_prepared];
+}
+
+/* execute a query with a prepared statement. */
+static PGresult*
+exec_cached(PGconn* conn, const struct Query* q)
+{
+  int i = find_cached(conn, q->query);
+  if (i == -1)
+    return PQexecParams(
+      conn, q->query, q->npar, NULL, q->params, NULL, NULL, 0);
+  PGresult* res = PQexecPrepared(
+    conn, prepared[i].name, q->npar, q->params, NULL, NULL, 0);
+
+  /* a prepared 'select *' can't be used anymore when a column has
+   * been added to the table (that's the case after imports). the
+   * statement is then prepared again. */
+  if (plan_changed(res)) {
+    PQclear(res);
+    forget_cached(conn, i);
+    i = find_cached(conn, q->query);
+    if (i == -1)
+      return PQexecParams(
+        conn, q->query, q->npar, NULL, q->params, NULL, NULL, 0);
+    res = PQexecPrepared(
+      conn, prepared[i].name, q->npar, q->params, NULL, NULL, 0);
+  }
+  return res;
+}
+
+/* execute the queries sent by a client: in a pipeline if there are
+ * several of them. */
+static void
+exec_queries(PGconn* conn,
+  const struct Query* q,
+  int n,
+  PGresult** res)
+{
+  if (n == 1) {
+    res[0] = exec_cached(conn, q);
+    return;
+  }
+
+  /* the statements are prepared before entering pipeline mode. */
+  const char* names[MAX_PIPELINE] = { NULL };
+  for (int i = 0; i < n; i++) {
+    int k = find_cached(conn, q[i].query);
+    names[i] = (k == -1) ? NULL : prepared[k].name;
+  }
+  pipeline_on(conn, q, names, n, res);
+
+  /* the statements with an outdated plan are sent again, alone. */
+  for (int i = 0; i < n; i++) {
+    if (names[i] != NULL && plan_changed(res[i])) {
+      PQclear(res[i]);
+      res[i] = exec_cached(conn, &q[i]);
+    }
+  }
+}
+
+/* read queries from a client, execute them and send the results. */
+static void
+serve(PGconn* conn, int fd)
+{
+  FILE* in = fdopen(fd, "r");
+  if (!in) {
+    close(fd);
+    return;
+  }
+  int32_t n, npar, len;
+  struct Query queries[MAX_PIPELINE] = {};
+  char* texts[MAX_PIPELINE] = {};
+  size_t text_caps[MAX_PIPELINE] = {};
+  char* params[MAX_PIPELINE][MAX_PARAMS] = {};
+  size_t caps[MAX_PIPELINE][MAX_PARAMS] = {};
+  /* NULL parameters are passed as NULL pointers. */
+  const char* values[MAX_PIPELINE][MAX_PARAMS] = {};
+
+  int ok = get_int(in, &n) && n > 0 && n <= MAX_PIPELINE;
+  for (int i = 0; ok && i < n; i++) {
+    ok = get_int(in, &npar) && npar >= 0 && npar <= MAX_PARAMS &&
+         get_bytes(in, &texts[i], &text_caps[i], &len) && len != -1;
+    for (int j = 0; ok && j < npar; j++) {
+      ok = get_bytes(in, &params[i][j], &caps[i][j], &len);
+      values[i][j] = (len == -1) ? NULL : params[i][j];
+    }
+    queries[i].query = texts[i];
+    queries[i].npar = npar;
+    queries[i].params = values[i];
+  }
+
+  if (ok) {
+    PGresult* res[MAX_PIPELINE];
+    exec_queries(conn, queries, n, res);
+
+    /* if the connection to the database was lost, reset it (all
+     * prepared statements are lost too) and try again. */
+    if (PQstatus(conn) == CONNECTION_BAD) {
+      for (int i = 0; i < n; i++)
+        PQclear(res[i]);
+      PQreset(conn);
+      forget_prepared();
+      exec_queries(conn, queries, n, res);
+    }
+    for (int i = 0; i < n; i++) {
+      put_result(fd, res[i]);
+      PQclear(res[i]);
+    }
+  }
+
+  for (int i = 0; i < MAX_PIPELINE; i++) {
+    free(texts[i]);
+    for (int j = 0; j < MAX_PARAMS; j++)
+      free(params[i][j]);
+  }
+  fclose(in);
+}
+
+static void
+on_signal(int sig)
+{
+  stop = 1;
+}
+
+int
+command_daemon()
+{
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if (!socket_path(addr.sun_path, sizeof(addr.sun_path))) {
+    fputs("socket path too long.\n", stderr);
+    return 0;
+  }
+
+  /* refuse to start if a daemon is already listening. else, the
+   * socket file is left by a daemon that didn't end properly. */
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    perror("socket");
+    return 0;
+  }
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+    fprintf(stderr, "daemon already running (%s).\n", addr.sun_path);
+    close(fd);
+    return 0;
+  }
+  unlink(addr.sun_path);
+
+  /* only the user can connect to the socket. */
+  mode_t mask = umask(0077);
+  int bound = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+  umask(mask);
+  if (bound == -1 || listen(fd, 16) == -1) {
+    perror("bind");
+    close(fd);
+    return 0;
+  }
+
+  /* the connection is kept for the whole life of the daemon. */
+  PGconn* conn = PQconnectdb(connectioninfo);
+  checkconn(conn);
+
+  /* end properly on SIGINT and SIGTERM. (no SA_RESTART, so accept
+   * is interrupted.) */
+  struct sigaction sa = { .sa_handler = on_signal };
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  fprintf(stderr, "listening on %s.\n", addr.sun_path);
+  struct timeval timeout = { .tv_sec = CLIENT_TIMEOUT };
+  while (!stop) {
+    int client = accept(fd, NULL, NULL);
+    if (client == -1)
+      continue;
+    if (!same_user(client)) {
+      close(client);
+      continue;
+    }
+    setsockopt(
+      client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    serve(conn, client);
+  }
+
+  close(fd);
+  unlink(addr.sun_path);
+  forget_prepared();
+  PQfinish(conn);
+  return 1;
+}
@@ -0,0 +1,42 @@
+/* daemon
+ * ------
+ *
+ * a small server that keeps a connection to the database (and the
+ * statements it has already prepared) behind a unix socket. short
+ * lived processes, such as the fzf callbacks (_preview, _head,
+ * _input), send their queries to it instead of connecting to the
+ * database themselves.
+ *
+ * */
+
+#ifndef _DAEMON_H
+#define _DAEMON_H
+
+#include <postgresql/libpq-fe.h>
+
+/* run the daemon (only returns on error). */
+int
+command_daemon();
+
+struct Query;
+
+/* send queries to the daemon (it executes them in a pipeline) and
+ * get their results in res. returns 0 if the daemon is not running
+ * (the caller must then connect to the database by itself). */
+int
+daemon_exec_queries(const struct Query* queries,
+  int n,
+  PGresult** res);
+
+/* send a query to the daemon and get its result. returns NULL if
+ * the daemon is not running (the caller must then connect to the
+ * database by itself). */
+PGresult*
+daemon_exec(const char* query, int npar, const char* const* params);
+
+/* the error message sent by the daemon with a result (one of the
+ * last ones received). */
+const char*
+daemon_error(const PGresult* res);
+
+#endif
@@ -5,6 +5,8 @@
 #include <unistd.h>
 
 #include "edit.h"
+#include "notes.h"
+#include "previews.h"
 #include "sizes.h"
 #include "util.h"
 
@@ -131,61 +133,170 @@ edit_in_editor(char* value, char* ext)
 int
 edit_value(char* id, char* stmtselect, char* stmtupdate, char* ext)
 {
-  /* connect to the database. then make the query params array and
-   * send the query. if the query fails, exit the function because a
-   * return is required to be edited. plus if there is an error or
-   * no row returned, there is probably no row to send the edited
-   * value. */
-  CONNECT
+  /* make the query params array and send the query. */
   const char* params[1] = { id };
-  PGresult* res =
-    PQexecParams(conn, stmtselect, 1, NULL, params, NULL, NULL, 0);
+  PGresult* res = exec_params(stmtselect, 1, params);
+  return edit_result(id, res, stmtupdate, ext);
+}
+
+/* check the result of the select, and edit its value in $EDITOR
+ * (res is cleared). returns the edited value (to be freed), or NULL.
+ * */
+static char*
+edited_value(PGresult* res, char* ext)
+{
+  /* if the query failed, exit the function because a return is
+   * required to be edited. plus if there is an error or no row
+   * returned, there is probably no row to send the edited value. */
   if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-    fprintf(stderr, "query failed:\n %s\n", PQerrorMessage(conn));
-    PQfinish(conn);
+    fprintf(stderr, "query failed:\n %s\n", result_error(res));
     PQclear(res);
-    return 0;
+    return NULL;
   } else if (PQntuples(res) == 0) {
     fputs("(no entry matched.)\n", stderr);
-    PQfinish(conn);
     PQclear(res);
-    return 0;
+    return NULL;
   }
-  /* end connection before using system in `edit_in_editor`, because
-   * else it would not be safe. */
-  PQfinish(conn);
   /* edit the value in $EDITOR. new value goes in s. */
   char* s = edit_in_editor(PQgetvalue(res, 0, 0), ext);
   /* clear query because the original value is not needed anymore as
    * i have the edited (new) value. */
   PQclear(res);
-  /* if nothing returned by the previous function exit function. */
-  if (s == NULL) {
-    return 0;
-  }
-  /* restart new connection, build the parameters to the query, and
-   * send the query.*/
-  RECONNECT
+  return s;
+}
+
+/* send the edited value (s) with the update statement, in a pipeline
+ * with the update of lastedit. */
+static int
+save_value(char* id, char* s, char* stmtupdate)
+{
+  const char* params[1] = { id };
   const char* params_mod[2] = { id, s };
-  res = PQexecParams(
-    conn, stmtupdate, 2, NULL, params_mod, NULL, NULL, 0);
-  /* once i have send the query, the new value is not needed
-   * anymore. so i free it. */
-  free(s);
+  struct Query queries[] = {
+    { .query = stmtupdate, .npar = 2, .params = params_mod },
+    { .stmt = STMT_LASTEDIT, .npar = 1, .params = params },
+  };
+  PGresult* results[2];
+  if (!exec_pipeline(queries, 2, results))
+    return 0;
   /* check that the query has been successfully sent.*/
   int code = 1;
-  int status = PQresultStatus(res);
+  int status = PQresultStatus(results[0]);
   if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
-    fprintf(stderr, "query failed:\n %s\n", PQerrorMessage(conn));
+    fprintf(
+      stderr, "query failed:\n %s\n", result_error(results[0]));
     code = 0;
   }
+  PQclear(results[0]);
+  PQclear(results[1]);
+  return code;
+}
 
-  PQclear(res);
+int
+edit_result(char* id, PGresult* res, char* stmtupdate, char* ext)
+{
+  char* s = edited_value(res, ext);
+  /* if nothing returned by the previous function exit function. */
+  if (s == NULL) {
+    return 0;
+  }
+  int code = save_value(id, s, stmtupdate);
+  /* once i have send the query, the new value is not needed
+   * anymore. so i free it. */
+  free(s);
+  if (code)
+    previews_invalidate(id);
+  return code;
+}
 
-  update_lastedit(conn, id);
+#define NOTES_UPDATE \
+  "update reading set notes = trim($2::text, E'\n\t ') || E'\n'" \
+  "\nwhere id = $1::text"
 
-  PQfinish(conn);
+/* send the notes with the quotes and concepts parsed from them, in
+ * one transaction (a pipeline): the trigger parse_note then doesn't
+ * parse them again. returns -1 if they couldn't be parsed, or if
+ * the database couldn't take them (e.g. a schema without
+ * set_note_items), so that the notes can be sent alone. */
+static int
+save_parsed_notes(char* id, char* s)
+{
+  char* t = trim_notes(s);
+  if (!t)
+    return -1;
+  struct Notes notes;
+  if (!parse_notes(&notes, t)) {
+    free(t);
+    return -1;
+  }
+  const char* params[1] = { id };
+  const char* params_mod[2] = { id, t };
+  const char* params_items[6] = { id, notes.quotes.s,
+    notes.quote_pages.s, notes.concepts.s, notes.definitions.s,
+    notes.concept_pages.s };
+  struct Query queries[] = {
+    { .query = "begin" },
+    { .query = "select set_config('retrolire.parsed', 'on', true)" },
+    { .query = NOTES_UPDATE, .npar = 2, .params = params_mod },
+    { .query = "select set_note_items($1::text, $2::text[], "
+               "$3::text[], $4::text[], $5::text[], $6::text[])",
+      .npar = 6,
+      .params = params_items },
+    { .stmt = STMT_LASTEDIT, .npar = 1, .params = params },
+    { .query = "commit" },
+  };
+#define N_QUERIES (int)(sizeof(queries) / sizeof(queries[0]))
+  PGresult* results[N_QUERIES];
+  int code = exec_pipeline(queries, N_QUERIES, results);
+  free(t);
+  free_notes(&notes);
+  if (!code)
+    return 0;
+  /* the first query that failed (the next ones failed with it,
+   * since the transaction was aborted, and the commit then rolled
+   * back everything, lastedit included). */
+  int failed = -1;
+  for (int i = 0; i < N_QUERIES; i++) {
+    int status = PQresultStatus(results[i]);
+    if (failed == -1 && status != PGRES_COMMAND_OK
+        && status != PGRES_TUPLES_OK)
+      failed = i;
+  }
+  if (failed == 1 || failed == 3) {
+    fprintf(stderr,
+      "(the database parses the notes: %s)\n",
+      result_error(results[failed]));
+    code = -1;
+  } else if (failed != -1) {
+    fprintf(
+      stderr, "query failed:\n %s\n", result_error(results[failed]));
+    code = 0;
+  }
+  for (int i = 0; i < N_QUERIES; i++)
+    PQclear(results[i]);
+  return code;
+#undef N_QUERIES
+}
 
+int
+edit_notes(char* id)
+{
+  const char* params[1] = { id };
+  char ext[sizeof("md") + 1] = "md";
+  char* s =
+    edited_value(exec_prepared(STMT_PREVIEW_NOTES, 1, params), ext);
+  if (s == NULL) {
+    return 0;
+  }
+  /* the quotes and concepts are parsed here, unless the config says
+   * otherwise or it fails: then the notes are sent alone, and the
+   * trigger parses them. */
+  int code = parse_in_client ? save_parsed_notes(id, s) : -1;
+  if (code == -1)
+    code = save_value(id, s, NOTES_UPDATE);
+  free(s);
+  if (code)
+    previews_invalidate(id);
   return code;
 }
 
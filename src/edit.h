@@ -8,6 +8,8 @@
 #ifndef _EDITOR_H
 #define _EDITOR_H
 
+#include <postgresql/libpq-fe.h>
+
 /* edit a string. */
 char*
 edit_in_editor(char* value, char* ext);
@@ -16,6 +18,16 @@ edit_in_editor(char* value, char* ext);
 int
 edit_value(char* id, char* stmtselect, char* stmtupdate, char* ext);
 
+/* edit the value selected by a query (res, which is cleared) and
+ * update it in the database. */
+int
+edit_result(char* id, PGresult* res, char* stmtupdate, char* ext);
+
+/* edit the reading notes of an entry, and update them in the
+ * database with the quotes and concepts parsed from them. */
+int
+edit_notes(char* id);
+
 /* edit a file */
 int
 edit_file(char* filepath);
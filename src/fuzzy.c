@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "fuzzy.h"
+
+/* the scores of fzf. a match counts more than two gaps, and the
+ * bonus of consecutive characters makes up for a gap. */
+#define SCORE_MATCH 16
+#define SCORE_GAP_START (-3)
+#define SCORE_GAP_EXTENSION (-1)
+#define BONUS_BOUNDARY (SCORE_MATCH / 2)
+#define BONUS_NON_WORD (SCORE_MATCH / 2)
+#define BONUS_CAMEL (BONUS_BOUNDARY + SCORE_GAP_EXTENSION)
+#define BONUS_CONSECUTIVE (-(SCORE_GAP_START + SCORE_GAP_EXTENSION))
+#define BONUS_FIRST_CHAR 2
+
+/* the classes of characters (the bytes of non-ascii characters are
+ * taken as letters). */
+enum CharClass
+{
+  NON_WORD,
+  LOWER,
+  UPPER,
+  DIGIT
+};
+
+static enum CharClass
+char_class(unsigned char c)
+{
+  if (c >= 'a' && c <= 'z')
+    return LOWER;
+  if (c >= 'A' && c <= 'Z')
+    return UPPER;
+  if (c >= '0' && c <= '9')
+    return DIGIT;
+  return c >= 0x80 ? LOWER : NON_WORD;
+}
+
+/* the bonus of a character matched after another one. */
+static int
+bonus(enum CharClass prev, enum CharClass cur)
+{
+  if (cur == NON_WORD)
+    return BONUS_NON_WORD;
+  if (prev == NON_WORD)
+    return BONUS_BOUNDARY;
+  if ((prev == LOWER && cur == UPPER)
+      || (prev != DIGIT && cur == DIGIT))
+    return BONUS_CAMEL;
+  return 0;
+}
+
+static char
+fold_char(char c, int fold)
+{
+  return (fold && c >= 'A' && c <= 'Z') ? (char)(c + 32) : c;
+}
+
+/* find the first c in s[0..n), in both cases if fold is set (c is
+ * then lowercase). returns n if there is none. */
+static size_t
+find_char(const char* s, size_t n, char c, int fold)
+{
+  char other = (fold && c >= 'a' && c <= 'z') ? (char)(c - 32) : c;
+  size_t i = 0;
+#ifdef __SSE2__
+  __m128i a = _mm_set1_epi8(c);
+  __m128i b = _mm_set1_epi8(other);
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+    int mask = _mm_movemask_epi8(
+      _mm_or_si128(_mm_cmpeq_epi8(v, a), _mm_cmpeq_epi8(v, b)));
+    if (mask)
+      return i + (size_t)__builtin_ctz((unsigned)mask);
+  }
+#endif
+  for (; i < n; i++)
+    if (s[i] == c || s[i] == other)
+      return i;
+  return n;
+}
+
+/* the score of a term matched in s[start..end), as fzf computes it:
+ * the characters of the term are matched the first time they're
+ * found from start. */
+static int
+score_window(const struct Term* t,
+  const char* s,
+  size_t start,
+  size_t end,
+  int fold)
+{
+  int score = 0, in_gap = 0, consecutive = 0, first_bonus = 0;
+  size_t k = 0;
+  enum CharClass prev =
+    start > 0 ? char_class((unsigned char)s[start - 1]) : NON_WORD;
+  for (size_t i = start; i < end; i++) {
+    enum CharClass cur = char_class((unsigned char)s[i]);
+    if (k < t->len && fold_char(s[i], fold) == t->s[k]) {
+      int b = bonus(prev, cur);
+      score += SCORE_MATCH;
+      if (consecutive == 0) {
+        first_bonus = b;
+      } else {
+        /* a boundary in a run of characters starts a new run. */
+        if (b >= BONUS_BOUNDARY && b > first_bonus)
+          first_bonus = b;
+        if (first_bonus > b)
+          b = first_bonus;
+        if (BONUS_CONSECUTIVE > b)
+          b = BONUS_CONSECUTIVE;
+      }
+      score += (k == 0) ? b * BONUS_FIRST_CHAR : b;
+      in_gap = 0;
+      consecutive++;
+      k++;
+    } else {
+      score += in_gap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+      in_gap = 1;
+      consecutive = 0;
+      first_bonus = 0;
+    }
+    prev = cur;
+  }
+  return score;
+}
+
+/* match a term in a field. fuzzy: its characters are searched
+ * forward, then backward from the last one, for the shortest match
+ * ending there. exact: the best of its occurrences. returns 0 if
+ * it doesn't match. */
+static int
+match_term(const struct Fuzzy* fz,
+  const struct Term* t,
+  const char* s,
+  size_t n,
+  int* score,
+  size_t* start)
+{
+  size_t pos = 0, k;
+  if (!fz->exact) {
+    for (k = 0; k < t->len; k++) {
+      pos += find_char(s + pos, n - pos, t->s[k], fz->fold);
+      if (pos++ >= n)
+        return 0;
+    }
+    size_t end = pos;
+    size_t i = end - 1;
+    for (k = t->len - 1;; i--) {
+      if (fold_char(s[i], fz->fold) == t->s[k] && k-- == 0)
+        break;
+    }
+    *start = i;
+    *score = score_window(t, s, i, end, fz->fold);
+    return 1;
+  }
+
+  int found = 0;
+  while (pos + t->len <= n) {
+    pos += find_char(s + pos, n - pos, t->s[0], fz->fold);
+    if (pos + t->len > n)
+      break;
+    for (k = 1; k < t->len; k++)
+      if (fold_char(s[pos + k], fz->fold) != t->s[k])
+        break;
+    if (k == t->len) {
+      int sc = score_window(t, s, pos, pos + t->len, fz->fold);
+      if (!found || sc > *score) {
+        *score = sc;
+        *start = pos;
+      }
+      found = 1;
+    }
+    pos++;
+  }
+  return found;
+}
+
+int
+fuzzy_init(struct Fuzzy* fz, const char* query, int exact)
+{
+  memset(fz, 0, sizeof(*fz));
+  fz->exact = exact;
+  fz->query = strdup(query);
+  if (!fz->query) {
+    fputs("error allocating memory.\n", stderr);
+    return 0;
+  }
+  /* smart case: the case is ignored if the query is lowercase. */
+  fz->fold = 1;
+  for (char* p = fz->query; *p; p++)
+    if (*p >= 'A' && *p <= 'Z')
+      fz->fold = 0;
+  char* p = fz->query;
+  while (*(p += strspn(p, " \t"))) {
+    if (fz->n_terms == MAX_TERMS) {
+      fprintf(stderr, "too many words (max %d).\n", MAX_TERMS);
+      fuzzy_free(fz);
+      return 0;
+    }
+    struct Term* t = &fz->terms[fz->n_terms++];
+    t->s = p;
+    t->len = strcspn(p, " \t");
+    p += t->len;
+  }
+  return 1;
+}
+
+void
+fuzzy_free(struct Fuzzy* fz)
+{
+  free(fz->query);
+  fz->query = NULL;
+}
+
+int
+fuzzy_match(const struct Fuzzy* fz,
+  const PGresult* res,
+  int row,
+  struct FuzzyScore* sc)
+{
+  int n_fields = PQnfields(res);
+  sc->score = 0;
+  sc->start = 0;
+  sc->len = 0;
+  /* an empty query keeps the order of the rows. */
+  for (int j = 0; j < n_fields && fz->n_terms > 0; j++)
+    sc->len += PQgetlength(res, row, j);
+  /* each word matches the field where it scores best. */
+  for (int i = 0; i < fz->n_terms; i++) {
+    int best = 0, found = 0;
+    size_t best_start = 0;
+    for (int j = 0; j < n_fields; j++) {
+      int score = 0;
+      size_t start;
+      if (match_term(fz,
+            &fz->terms[i],
+            PQgetvalue(res, row, j),
+            (size_t)PQgetlength(res, row, j),
+            &score,
+            &start)
+          && (!found || score > best)) {
+        best = score;
+        best_start = start;
+        found = 1;
+      }
+    }
+    if (!found)
+      return 0;
+    sc->score += best;
+    if (i == 0)
+      sc->start = (int)best_start;
+  }
+  return 1;
+}
+
+/* test if a row ranks after another one: a lower score, then a
+ * later match, a longer row, and a later row. */
+static int
+ranks_after(const struct FuzzyScore* a, const struct FuzzyScore* b)
+{
+  if (a->score != b->score)
+    return a->score < b->score;
+  if (a->start != b->start)
+    return a->start > b->start;
+  if (a->len != b->len)
+    return a->len > b->len;
+  return a->n > b->n;
+}
+
+int
+top_init(struct Top* top, int size)
+{
+  top->n = 0;
+  top->size = size;
+  top->m = malloc((size_t)size * sizeof(struct Match));
+  if (!top->m) {
+    fputs("error allocating memory.\n", stderr);
+    return 0;
+  }
+  return 1;
+}
+
+int
+top_enters(const struct Top* top, const struct FuzzyScore* sc)
+{
+  return top->n < top->size || ranks_after(&top->m[0].sc, sc);
+}
+
+/* move the match at i down the heap, to its place. */
+static void
+sift_down(struct Top* top, int i)
+{
+  for (;;) {
+    int worst = i, l = 2 * i + 1, r = l + 1;
+    if (l < top->n && ranks_after(&top->m[l].sc, &top->m[worst].sc))
+      worst = l;
+    if (r < top->n && ranks_after(&top->m[r].sc, &top->m[worst].sc))
+      worst = r;
+    if (worst == i)
+      return;
+    struct Match m = top->m[i];
+    top->m[i] = top->m[worst];
+    top->m[worst] = m;
+    i = worst;
+  }
+}
+
+int
+top_add(struct Top* top,
+  const struct FuzzyScore* sc,
+  const char* row,
+  size_t len)
+{
+  char* s = malloc(len);
+  if (!s) {
+    fputs("error allocating memory.\n", stderr);
+    return 0;
+  }
+  memcpy(s, row, len);
+  struct Match m = { *sc, s, len };
+
+  /* the ranking is full: the new row replaces the worst one. */
+  if (top->n == top->size) {
+    free(top->m[0].row);
+    top->m[0] = m;
+    sift_down(top, 0);
+    return 1;
+  }
+  int i = top->n++;
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (!ranks_after(&m.sc, &top->m[parent].sc))
+      break;
+    top->m[i] = top->m[parent];
+    i = parent;
+  }
+  top->m[i] = m;
+  return 1;
+}
+
+static int
+compare_matches(const void* a, const void* b)
+{
+  const struct FuzzyScore* x = &((const struct Match*)a)->sc;
+  const struct FuzzyScore* y = &((const struct Match*)b)->sc;
+  return ranks_after(x, y) ? 1 : ranks_after(y, x) ? -1 : 0;
+}
+
+void
+top_sort(struct Top* top)
+{
+  qsort(
+    top->m, (size_t)top->n, sizeof(struct Match), compare_matches);
+}
+
+void
+top_free(struct Top* top)
+{
+  for (int i = 0; i < top->n; i++)
+    free(top->m[i].row);
+  free(top->m);
+  top->m = NULL;
+  top->n = 0;
+}
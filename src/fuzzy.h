@@ -0,0 +1,110 @@
+/* fuzzy
+ * -----
+ *
+ * rank rows with a fuzzy query, as `fzf --filter` does, without
+ * running fzf (options --match and --top). the query is split into
+ * words, which must all match a field of the row: their characters
+ * in that order (or the whole word, with --exact). the score is the
+ * one of fzf (its algorithm v1): the matched characters which follow
+ * each other, or which start a word, count more, and the gaps cost.
+ * as with fzf, the case is ignored unless the query has an uppercase
+ * letter.
+ *
+ * most rows don't match at all: they are rejected while looking for
+ * the characters of the query, 16 bytes at a time (SSE2), before any
+ * scoring. only the best rows are kept (a heap), with a copy of
+ * their values.
+ *
+ * */
+
+#ifndef _FUZZY_H
+#define _FUZZY_H
+
+#include <postgresql/libpq-fe.h>
+#include <stddef.h>
+
+/* the words of a query. */
+#define MAX_TERMS 16
+
+struct Term
+{
+  const char* s;
+  size_t len;
+};
+
+struct Fuzzy
+{
+  /* the query, where the words are. */
+  char* query;
+  struct Term terms[MAX_TERMS];
+  int n_terms;
+  int fold;
+  int exact;
+};
+
+/* the score of a row, where its first word matched (the rows
+ * matching first come first, as with fzf --tiebreak begin), its
+ * length, and its position in the result. */
+struct FuzzyScore
+{
+  int score;
+  int start;
+  int len;
+  long n;
+};
+
+/* a row kept by the ranking: its values, separated as in the
+ * output. */
+struct Match
+{
+  struct FuzzyScore sc;
+  char* row;
+  size_t row_len;
+};
+
+/* the best rows seen so far, the worst of them first (a heap). */
+struct Top
+{
+  struct Match* m;
+  int n;
+  int size;
+};
+
+/* parse a query. returns 0 on error (memory, too many words). */
+int
+fuzzy_init(struct Fuzzy* fz, const char* query, int exact);
+
+void
+fuzzy_free(struct Fuzzy* fz);
+
+/* score a row of a result. returns 0 if it doesn't match. */
+int
+fuzzy_match(const struct Fuzzy* fz,
+  const PGresult* res,
+  int row,
+  struct FuzzyScore* sc);
+
+/* start a ranking of the size best rows. returns 0 on error. */
+int
+top_init(struct Top* top, int size);
+
+/* test if a row would be kept, before copying it. */
+int
+top_enters(const struct Top* top, const struct FuzzyScore* sc);
+
+/* keep a row (copied), in place of the worst one if the ranking is
+ * full. returns 0 on error (memory). */
+int
+top_add(struct Top* top,
+  const struct FuzzyScore* sc,
+  const char* row,
+  size_t len);
+
+/* sort the rows kept, the best first. */
+void
+top_sort(struct Top* top);
+
+void
+top_free(struct Top* top);
+
+#endif
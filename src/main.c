@@ -5,7 +5,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "catalog.h"
 #include "commands.h"
+#include "daemon.h"
+#include "previews.h"
 #include "sizes.h"
 #include "underscore.h"
 #include "util.h"
@@ -21,13 +24,15 @@ static char doc[] =
   "  open\n"
   "  add METHOD {IDENTIFIER|FILE}\n"
   "  tag [pick]\n"
-  "  json\n"
+  "  json [lines]\n"
   "  file FILE\n"
   "  delete\n"
   "  refer\n"
   "  print\n"
   "  quote\n"
-  "  update FIELD\n";
+  "  update FIELD\n"
+  "  catalog FILE\n"
+  "  daemon\n";
 
 // clang-format off
 static struct argp_option options[] = {
@@ -36,7 +41,9 @@ static struct argp_option options[] = {
   { "var", 'v', "field=regex", 0, "field-value search" , 0},
   { "tag", 't', "tag", 0, "filter entries with a tag", 0},
   { "search", 's', "regex", 0, "search pattern in reading notes", 0 },
+  { "fts", 'f', "words", 0, "full-text search in reading notes", 0 },
   { "quote", 'q', "regex", 0, "search pattern in quotes", 0 },
+  { "concept", 'c', "regex", 0, "search pattern in concepts", 0 },
   { 0, 0, NULL, OPTION_DOC,  "logical operators:", 2},
   { "not", 'n', NULL, 0, "" , 0},
   { "or", 'o', NULL, 0, "" , 0},
@@ -44,12 +51,15 @@ static struct argp_option options[] = {
   { "exact", 'e', NULL, 0, "no fuzzy matching" , 0},
   { "preview", 'p', NULL, 0, "show entry infos, files and notes" , 0},
   { "showtags", 'T', NULL, 0, "list tags for in the fzf picker" , 0},
+  { "live", 'L', NULL, 0, "search in the database as you type" , 0},
   { 0, 0, NULL, OPTION_DOC,  "history:", 4},
   { "last", 'l', NULL, 0, "select the last selected entry" , 0},
   { "recent", 'r', NULL, 0, "order entries by recent editing", 0 },
   { 0, 0, NULL, OPTION_DOC,  "misc:", 5},
   { "id", 'i', "id", 0, "specified the entry id " , 0},
   { "output", 'O', NULL, 0, "do not interactively pick an id" , 0},
+  { "match", 'm', "query", 0, "rank the rows with a fuzzy query" , 0},
+  { "top", 'N', "n", 0, "the number of rows printed by --match" , 0},
   { 0 }
 };
 // clang-format on
@@ -65,6 +75,9 @@ struct arguments
   // - ON/OFF values
   int lastedit, showtags;
   int pick;
+  // - the fuzzy ranking (--match, --top, and --exact).
+  char* match;
+  int top, exact;
   char* command;     // first positional argument is the command
   char* pos[MAXPOS]; // other positional arguments (files, etc.)
   const char* params[MAXOPT]; // parameters for the SQL
@@ -95,6 +108,7 @@ parse_opt(int key, char* arg, struct argp_state* state)
   switch (key) {
     case 'e': // exact
       append_sh(arguments->sh, "--exact");
+      arguments->exact = 1;
       break;
     case 'p': // preview
       append_sh(arguments->sh, "--preview");
@@ -114,6 +128,16 @@ parse_opt(int key, char* arg, struct argp_state* state)
       // TODO: rename this one. maybe S or O, or -_
       arguments->pick = 0;
       break;
+    case 'L': // live
+      if (arguments->pick)
+        arguments->pick = PICK_LIVE;
+      break;
+    case 'm': // match
+      arguments->match = arg;
+      break;
+    case 'N': // top
+      arguments->top = atoi(arg);
+      break;
 
     case 'o': // TEST
       arguments->cnd->next_or = 1;
@@ -144,23 +168,31 @@ parse_opt(int key, char* arg, struct argp_state* state)
         arguments, arg, "regexp_like(r.notes, ", "::text, 'i') ");
       break;
 
+    case 'f': // full-text search in notes
+      /* the text search configuration must be the one of the
+       * indexed column (reading.notes_tsv, see schema.sql). */
+      _add_cnd(arguments,
+        arg,
+        "r.notes_tsv @@ websearch_to_tsquery('simple', ",
+        "::text) ");
+      break;
+
+    /* the regex filters use the operator ~* (and not the function
+     * regexp_like), because the trigram indexes can serve it. */
     case 'q': // quote
       _add_cnd(arguments,
         arg,
-        "(select exists (select 1 from quote where entry = "
-        "e.id "
-        "and regexp_like(quote, ",
-        "::text, 'i'))) ");
+        "exists (select 1 from quote q where q.entry = e.id "
+        "and q.quote ~* ",
+        "::text) ");
       break;
 
     case 'c': // concept
       _add_cnd(arguments,
         arg,
-        "(select exists (select 1 from concept where entry "
-        "= "
-        "e.id "
-        "and regexp_like(name, ",
-        "::text, 'i'))) ");
+        "exists (select 1 from concept c where c.entry = e.id "
+        "and c.name ~* ",
+        "::text) ");
       break;
 
     case 'i': // id
@@ -224,6 +256,10 @@ main(int argc, char** argv)
   a.showtags = 0;
   // - enum (0, 1, 2)
   a.lastedit = 0;
+  // - no fuzzy ranking, and its number of rows from config.h.
+  a.match = NULL;
+  a.top = match_top;
+  a.exact = 0;
 
   // only exception is 'pick'. by default it's 1, and the option -o
   // turns it off to 0 if the query has not to be passed to FZF.
@@ -275,32 +311,33 @@ main(int argc, char** argv)
     NULL,
     NULL,
     NULL }; // the args in execvp must be NULL-terminated
-  struct ShCmd sh;
-  init_sh(&sh, pick_command);
-  a.sh = &sh;
+  /* the args of a ShCmd are a flexible array member: it's
+   * allocated with room for the arguments appended later. */
+  struct ShCmd* sh =
+    malloc(sizeof(struct ShCmd) + MAX_SH_ARGS * sizeof(char*));
+  if (!sh) {
+    fputs("error allocating memory.\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+  init_sh(sh, pick_command);
+  a.sh = sh;
 
   // parse arguments
   argp_parse(&argp, argc, argv, 0, 0, &a);
 
-  CONNECT;
-
   // add 'field=values' to conditional clause and to params.
   // - field is escaped and concatenated in the conditional clause.
   // - value goes in params.
   for (int i = 0; i < a.nvar; i++) {
     int npar = a.npar;
     char* value =
-      parse_key_value(conn, &cnd, a.npar, a.varvalues[i]);
+      parse_key_value(db_conn(), &cnd, a.npar, a.varvalues[i]);
     if (!value) {
-      PQfinish(conn);
       exit(EXIT_FAILURE);
     }
     a.params[a.npar] = value;
     a.npar++;
   }
-  // end connection, not needed anymore because not all commands
-  // requires it (it was only usefull for field escaping).
-  PQfinish(conn);
 
   // initiate a Stmt for the default SELECT statement.
   struct Stmt slct;
@@ -320,6 +357,10 @@ main(int argc, char** argv)
   // define a function pointer.
   int (*func)(char*, char* [MAXPOS], int) = NULL;
 
+  // the condition of the live picker (option -L), on entries by
+  // default.
+  char* live = LIVE_ENTRY;
+
   /* commands
    *
    * assign the function to the function pointer 'func', if it's one
@@ -333,11 +374,23 @@ main(int argc, char** argv)
       func = command_print;
       break;
 
-    case 'c': // cite
+    case 'c': // cite, catalog
+      /* 'c' alone is still 'cite'. */
+      if (cmd[1] == 'a') {
+        if (!command_catalog(pos[0]))
+          exit(EXIT_FAILURE);
+        exit(EXIT_SUCCESS);
+      }
       func = command_cite;
       break;
 
-    case 'd': // delete
+    case 'd': // delete, daemon
+      /* 'd' alone is still 'delete'. */
+      if (cmd[1] == 'a') {
+        if (!command_daemon())
+          exit(EXIT_FAILURE);
+        exit(EXIT_SUCCESS);
+      }
       func = command_delete;
       break;
 
@@ -347,13 +400,15 @@ main(int argc, char** argv)
 
     case 'q': // quote
       func = command_quote;
-      if (!make_stmt_quote(&slct, &sh))
+      live = LIVE_QUOTE;
+      if (!make_stmt_quote(&slct, sh))
         exit(EXIT_FAILURE);
       break;
 
     case 'r': // refer
       func = command_refer;
-      if (!make_stmt_refer(&slct, &sh))
+      live = LIVE_CONCEPT;
+      if (!make_stmt_refer(&slct, sh))
         exit(EXIT_FAILURE);
       break;
 
@@ -415,7 +470,7 @@ main(int argc, char** argv)
       if (a.ncnd > 0)
         append_stmt(&cnd, ")");
 
-      if (!json(&cnd, a.npar, a.params))
+      if (!json(&cnd, a.npar, a.params, pos[0]))
         exit(EXIT_FAILURE);
       else
         exit(EXIT_SUCCESS);
@@ -446,9 +501,35 @@ main(int argc, char** argv)
   /* if the function is not a NULL pointer, pick an ID and call
    * the function with the returned ID as first argument. if no ID
    * has been written to 'id' var, the function is not called. */
-  if (func) {
-    queryp2(
-      &slct, &cnd, a.lastedit, a.npar, a.params, &sh, id, a.pick);
+  if (func && a.match) {
+    /* the rows are ranked here, no id is picked. */
+    if (!match_rows(&slct,
+          &cnd,
+          a.lastedit,
+          a.npar,
+          a.params,
+          a.match,
+          a.top,
+          a.exact))
+      exit(EXIT_FAILURE);
+  } else if (func) {
+    /* the previews of the entries are refreshed while the picker
+     * runs (not those of quotes and concepts). */
+    if (a.pick && preview_store && func != command_quote
+        && func != command_refer)
+      previews_spawn(0);
+    /* if the query failed, the rows were not all shown: nothing is
+     * done with the one picked. */
+    if (!queryp2(&slct,
+          &cnd,
+          a.lastedit,
+          a.npar,
+          a.params,
+          sh,
+          id,
+          a.pick,
+          live))
+      exit(EXIT_FAILURE);
     if (strnlen(id, 1))
       (*func)(id, pos, a.npos);
   }
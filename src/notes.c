@@ -0,0 +1,244 @@
+/* memmem. */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "notes.h"
+#include "util.h"
+
+/* the characters trimmed from the stored notes, from the concepts
+ * and their definitions. */
+#define TRIM_NOTES "\n\t "
+/* the characters trimmed from the quotes. */
+#define TRIM_QUOTE " \n\t>"
+
+char*
+trim_notes(const char* s)
+{
+  /* the update does: trim($2::text, E'\n\t ') || E'\n'. */
+  s += strspn(s, TRIM_NOTES);
+  size_t len = strlen(s);
+  while (len > 0 && strchr(TRIM_NOTES, s[len - 1]))
+    len--;
+  char* t = malloc(len + 2);
+  if (!t) {
+    fputs("error allocating memory.\n", stderr);
+    return NULL;
+  }
+  memcpy(t, s, len);
+  t[len] = '\n';
+  t[len + 1] = '\0';
+  return t;
+}
+
+/* append an element to an array literal (after a comma, except for
+ * the first one). a NULL element is written NULL, the others are
+ * double quoted, with their backslashes and double quotes escaped.
+ * if unquote is set, each "\n>" of the element is written "\n" (the
+ * quote marks of the lines of a blockquote). */
+static int
+array_add(struct Buf* a, const char* s, size_t n, int unquote)
+{
+  if (a->len > 1 && !buf_cat(a, ",", 1))
+    return 0;
+  if (!s)
+    return buf_cat(a, "NULL", 4);
+  if (!buf_cat(a, "\"", 1))
+    return 0;
+  size_t i, from = 0;
+  for (i = 0; i < n; i++) {
+    if (s[i] == '"' || s[i] == '\\') {
+      if (!buf_cat(a, s + from, i - from)
+          || !buf_cat(a, "\\", 1))
+        return 0;
+      from = i;
+    } else if (unquote && i > 0 && s[i] == '>'
+               && s[i - 1] == '\n') {
+      if (!buf_cat(a, s + from, i - from))
+        return 0;
+      from = i + 1;
+    }
+  }
+  return buf_cat(a, s + from, n - from) && buf_cat(a, "\"", 1);
+}
+
+/* trim characters (from set) at both ends of s[*start..*end). */
+static void
+trim(const char* s, size_t* start, size_t* end, const char* set)
+{
+  while (*start < *end && strchr(set, s[*start]))
+    (*start)++;
+  while (*end > *start && strchr(set, s[*end - 1]))
+    (*end)--;
+}
+
+/* the space characters of regexes (\s). */
+static int
+is_space(char c)
+{
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static int
+is_digit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+/* find the page number at the end of s[start..*end), as the SQL
+ * function split_quote_page_number does: "[12]", "(p. 12-14)",
+ * "[pages 3]"... followed by spaces. if there is one, *end is set to
+ * its opening bracket (so that s[start..*end) is the quote, not
+ * trimmed), and the number is s[*page..*page_end). returns 0 if
+ * there is no page number. */
+static int
+split_page(const char* s,
+  size_t start,
+  size_t* end,
+  size_t* page,
+  size_t* page_end)
+{
+  static const char* prefixes[] = { "pages", "page", "pp.", "p.",
+    "pp", "p", "" };
+  size_t e = *end;
+  while (e > start && is_space(s[e - 1]))
+    e--;
+  if (e == start || (s[e - 1] != ']' && s[e - 1] != ')'))
+    return 0;
+  size_t d_end = --e;
+  while (e > start && is_digit(s[e - 1]))
+    e--;
+  if (e == d_end)
+    return 0;
+  /* a range of pages (12-14). */
+  if (e - start >= 2 && s[e - 1] == '-' && is_digit(s[e - 2])) {
+    e--;
+    while (e > start && is_digit(s[e - 1]))
+      e--;
+  }
+  size_t d_start = e;
+  while (e > start && s[e - 1] == ' ')
+    e--;
+  size_t i;
+  for (i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+    size_t len = strlen(prefixes[i]);
+    if (e - start < len + 1
+        || memcmp(s + e - len, prefixes[i], len) != 0)
+      continue;
+    char bracket = s[e - len - 1];
+    if (bracket == '[' || bracket == '(') {
+      *end = e - len - 1;
+      *page = d_start;
+      *page_end = d_end;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* add a quote, from s[start..end) (the match of get_quotes). */
+static int
+add_quote(struct Notes* notes,
+  const char* s,
+  size_t start,
+  size_t end)
+{
+  size_t page, page_end;
+  trim(s, &start, &end, TRIM_QUOTE);
+  if (split_page(s, start, &end, &page, &page_end))
+    return array_add(&notes->quotes, s + start, end - start, 1)
+           && array_add(
+             &notes->quote_pages, s + page, page_end - page, 0);
+  return array_add(&notes->quotes, s + start, end - start, 1)
+         && array_add(&notes->quote_pages, NULL, 0, 0);
+}
+
+/* add a concept, named s[name..name_end), defined by s[def..end). */
+static int
+add_concept(struct Notes* notes,
+  const char* s,
+  size_t name,
+  size_t name_end,
+  size_t def,
+  size_t end)
+{
+  size_t page, page_end;
+  int has_page;
+  trim(s, &name, &name_end, TRIM_NOTES);
+  trim(s, &def, &end, TRIM_NOTES);
+  has_page = split_page(s, def, &end, &page, &page_end);
+  /* the definition is trimmed again once the page is removed. */
+  trim(s, &def, &end, TRIM_NOTES);
+  return array_add(&notes->concepts, s + name, name_end - name, 0)
+         && array_add(&notes->definitions, s + def, end - def, 0)
+         && (has_page
+               ? array_add(
+                 &notes->concept_pages, s + page, page_end - page, 0)
+               : array_add(&notes->concept_pages, NULL, 0, 0));
+}
+
+int
+parse_notes(struct Notes* notes, const char* s)
+{
+  memset(notes, 0, sizeof(*notes));
+  struct Buf* arrays[] = { &notes->quotes, &notes->quote_pages,
+    &notes->concepts, &notes->definitions, &notes->concept_pages };
+  size_t i;
+  for (i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+    if (!buf_cat(arrays[i], "{", 1)) {
+      free_notes(notes);
+      return 0;
+    }
+  }
+  /* the notes are read line by line, once. a line starting with '>'
+   * starts a quote, which ends before the next empty line. a
+   * (non-empty) line followed by a line starting with ':' (maybe
+   * after one empty line) is a concept, defined by the rest of that
+   * line. as with the regexes, a quote (or a concept) cannot start
+   * within the previous one: quote_end and concept_end are where
+   * the previous ones ended. */
+  size_t n = strlen(s);
+  size_t line = 0, quote_end = 0, concept_end = 0;
+  int ok = 1;
+  while (ok && line < n) {
+    const char* nl = memchr(s + line, '\n', n - line);
+    size_t line_end = nl ? (size_t)(nl - s) : n;
+    if (s[line] == '>' && line >= quote_end) {
+      const char* blank = NULL;
+      if (line + 1 < n)
+        blank = memmem(s + line + 1, n - line - 1, "\n\n", 2);
+      quote_end = blank ? (size_t)(blank - s) : n;
+      ok = add_quote(notes, s, line, quote_end);
+    }
+    if (ok && line_end > line && line >= concept_end && nl) {
+      size_t colon = line_end + 1;
+      if (colon < n && s[colon] == '\n' && colon + 1 < n
+          && s[colon + 1] == ':')
+        colon++;
+      if (colon < n && s[colon] == ':') {
+        const char* def_nl = memchr(s + colon, '\n', n - colon);
+        concept_end = def_nl ? (size_t)(def_nl - s) : n;
+        ok = add_concept(
+          notes, s, line, line_end, colon + 1, concept_end);
+      }
+    }
+    line = line_end + 1;
+  }
+  for (i = 0; ok && i < sizeof(arrays) / sizeof(arrays[0]); i++)
+    ok = buf_cat(arrays[i], "}", 1);
+  if (!ok)
+    free_notes(notes);
+  return ok;
+}
+
+void
+free_notes(struct Notes* notes)
+{
+  free(notes->quotes.s);
+  free(notes->quote_pages.s);
+  free(notes->concepts.s);
+  free(notes->definitions.s);
+  free(notes->concept_pages.s);
+  memset(notes, 0, sizeof(*notes));
+}
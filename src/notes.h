@@ -0,0 +1,45 @@
+/* notes
+ * -----
+ *
+ * parse the quotes (blockquotes, with an optional page number at
+ * the end) and the concepts (definition lists) of reading notes, in
+ * a single pass, the way the SQL functions get_quotes and
+ * get_concepts do. the items are written as postgresql text[]
+ * literals, to be sent to the function set_note_items (see
+ * schema.sql) instead of letting the trigger parse_note parse the
+ * notes again with regexes.
+ *
+ * */
+
+#ifndef _NOTES_H
+#define _NOTES_H
+
+#include "util.h"
+
+/* the items parsed from notes, as five array literals (the quotes
+ * and their pages, the concepts with their definitions and pages).
+ * */
+struct Notes
+{
+  struct Buf quotes;
+  struct Buf quote_pages;
+  struct Buf concepts;
+  struct Buf definitions;
+  struct Buf concept_pages;
+};
+
+/* trim the notes the way they are stored (see command_edit), in a
+ * new string (to be freed). returns NULL if it fails. */
+char*
+trim_notes(const char* s);
+
+/* parse the notes (already trimmed). returns 0 if it fails (memory),
+ * and then nothing has to be freed. */
+int
+parse_notes(struct Notes* notes, const char* s);
+
+/* free the arrays. */
+void
+free_notes(struct Notes* notes);
+
+#endif
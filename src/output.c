@@ -0,0 +1,125 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "output.h"
+
+/* size of the buffer, aligned on pages. */
+#define OUTPUT_BUFSIZE (64 * 1024)
+#define OUTPUT_ALIGN 4096
+
+int
+output_open(struct Output* o, FILE* f)
+{
+  o->f = f;
+  o->len = 0;
+  o->error = 0;
+  /* what is in the buffer of the FILE must be written first. */
+  fflush(f);
+  o->fd = fileno(f);
+  void* buf;
+  if (posix_memalign(&buf, OUTPUT_ALIGN, OUTPUT_BUFSIZE) != 0) {
+    fputs("error allocating memory.\n", stderr);
+    o->buf = NULL;
+    return 0;
+  }
+  o->buf = buf;
+  return 1;
+}
+
+/* write the buffer, and then data (it can be empty), with a single
+ * call to writev. */
+static void
+output_writev(struct Output* o, const char* data, size_t len)
+{
+  /* after an error, the output is dropped. */
+  if (o->error) {
+    o->len = 0;
+    return;
+  }
+  if (o->fd == -1) {
+    fwrite(o->buf, 1, o->len, o->f);
+    if (len > 0)
+      fwrite(data, 1, len, o->f);
+    o->len = 0;
+    o->error = ferror(o->f) != 0;
+    return;
+  }
+  struct iovec iov[] = {
+    { .iov_base = o->buf, .iov_len = o->len },
+    { .iov_base = (void*)data, .iov_len = len },
+  };
+  struct iovec* v = iov;
+  int n_iov = 2;
+  while (n_iov > 0) {
+    ssize_t n = writev(o->fd, v, n_iov);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      o->error = 1;
+      break;
+    }
+    /* skip what has been written (it can be a part of an iovec). */
+    size_t written = (size_t)n;
+    while (n_iov > 0 && written >= v->iov_len) {
+      written -= v->iov_len;
+      v++;
+      n_iov--;
+    }
+    if (n_iov > 0) {
+      v->iov_base = (char*)v->iov_base + written;
+      v->iov_len -= written;
+    }
+  }
+  o->len = 0;
+}
+
+void
+output_write(struct Output* o, const char* s, size_t len)
+{
+  if (len <= OUTPUT_BUFSIZE - o->len) {
+    memcpy(o->buf + o->len, s, len);
+    o->len += len;
+  }
+  /* a large value is not copied: it's written with the buffer. */
+  else if (len >= OUTPUT_BUFSIZE / 2) {
+    output_writev(o, s, len);
+  } else {
+    output_writev(o, NULL, 0);
+    memcpy(o->buf, s, len);
+    o->len = len;
+  }
+}
+
+void
+output_str(struct Output* o, const char* s)
+{
+  output_write(o, s, strlen(s));
+}
+
+void
+output_char(struct Output* o, char c)
+{
+  if (o->len == OUTPUT_BUFSIZE)
+    output_writev(o, NULL, 0);
+  o->buf[o->len++] = c;
+}
+
+int
+output_flush(struct Output* o)
+{
+  output_writev(o, NULL, 0);
+  if (o->fd == -1 && fflush(o->f) != 0)
+    o->error = 1;
+  return !o->error;
+}
+
+int
+output_close(struct Output* o)
+{
+  int code = output_flush(o);
+  free(o->buf);
+  o->buf = NULL;
+  return code;
+}
@@ -0,0 +1,51 @@
+/* output
+ * ------
+ *
+ * a buffered writer for query results. values are copied (their
+ * length is known from libpq, so there is no strlen) in a large
+ * aligned buffer, which is written in a single writev with the next
+ * large value when it's full. the FILE is only used if it has no
+ * file descriptor (e.g. the pipe to fzf, see pgpopen2).
+ *
+ * */
+
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <stdio.h>
+
+struct Output
+{
+  FILE* f;
+  int fd;
+  char* buf;
+  size_t len;
+  /* set if a write has failed. */
+  int error;
+};
+
+/* start writing to a FILE (which is flushed first). */
+int
+output_open(struct Output* o, FILE* f);
+
+/* write len bytes. */
+void
+output_write(struct Output* o, const char* s, size_t len);
+
+/* write a string. */
+void
+output_str(struct Output* o, const char* s);
+
+/* write a single char. */
+void
+output_char(struct Output* o, char c);
+
+/* write what is in the buffer. returns 0 if a write has failed. */
+int
+output_flush(struct Output* o);
+
+/* flush and free the buffer. returns 0 if a write has failed. */
+int
+output_close(struct Output* o);
+
+#endif
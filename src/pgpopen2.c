@@ -1,14 +1,116 @@
+/* fopencookie. */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "output.h"
 #include "pgpopen2.h"
 
-#define READ 0
-#define WRITE 1
+/* size of the buffer for the writes to the subprocess. */
+#define PUMP_BUFSIZE (64 * 1024)
+
+/* the pipes to a subprocess, and what has been read from it. */
+struct Pump
+{
+  int in;
+  int out;
+  char* dest;
+  size_t s_dest;
+  size_t n_read;
+  /* the subprocess has closed its stdout (it has ended). */
+  int done;
+};
+
+/* read the output of the subprocess. what doesn't fit in dest is
+ * read anyway, and dropped. */
+static void
+pump_read(struct Pump* p)
+{
+  char drop[BUFSIZ];
+  char* buf = drop;
+  size_t size = sizeof(drop);
+  if (p->n_read < p->s_dest) {
+    buf = p->dest + p->n_read;
+    size = p->s_dest - p->n_read;
+  }
+  ssize_t n = read(p->out, buf, size);
+  if (n > 0 && buf != drop)
+    p->n_read += (size_t)n;
+  else if (n == 0 || (n == -1 && errno != EINTR))
+    p->done = 1;
+}
+
+/* write to the subprocess (the write function of the FILE used by
+ * write_rows). its output is read while its stdin is full. if the
+ * subprocess ends, the write fails: the FILE then has its error
+ * indicator set (ferror). */
+static ssize_t
+pump_write(void* cookie, const char* buf, size_t size)
+{
+  struct Pump* p = cookie;
+  size_t written = 0;
+  while (written < size && !p->done) {
+    struct pollfd fds[] = {
+      { .fd = p->in, .events = POLLOUT },
+      { .fd = p->out, .events = POLLIN },
+    };
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (fds[1].revents)
+      pump_read(p);
+    /* the subprocess has closed its stdin. */
+    if (fds[0].revents & (POLLERR | POLLHUP))
+      break;
+    if (fds[0].revents & POLLOUT) {
+      ssize_t n = write(p->in, buf + written, size - written);
+      if (n > 0)
+        written += (size_t)n;
+      else if (n == -1 && errno != EAGAIN && errno != EINTR)
+        break;
+    }
+  }
+  if (written < size) {
+    errno = EPIPE;
+    return -1;
+  }
+  return (ssize_t)size;
+}
+
+/* wait for data on the connection. if the rows are piped to a
+ * subprocess, its output is read meanwhile. returns 0 if the
+ * subprocess has ended, or if the connection failed. */
+static int
+wait_conn(struct Rows* rows)
+{
+  struct pollfd fds[] = {
+    { .fd = PQsocket(rows->conn), .events = POLLIN },
+    { .fd = -1, .events = POLLIN },
+  };
+  if (rows->pump != NULL)
+    fds[1].fd = rows->pump->out;
+  if (poll(fds, 2, -1) == -1)
+    return errno == EINTR;
+  if (fds[1].revents) {
+    pump_read(rows->pump);
+    if (rows->pump->done)
+      return 0;
+  }
+  if (fds[0].revents)
+    return PQconsumeInput(rows->conn);
+  return 1;
+}
 
 int
-pgpopen2(PGresult* res,
+pgpopen2(struct Rows* rows,
   char* field_sep,
   char record_sep,
   char* dest,
@@ -56,63 +158,283 @@ pgpopen2(PGresult* res,
     _exit(EXIT_SUCCESS); // unnecessary?
   }
 
-  else {
-    /* parent process */
+  /* parent process */
 
-    /* close file descriptors used by child process.*/
-    close(p_out[1]);
-    close(p_in[0]);
+  /* close file descriptors used by child process.*/
+  close(p_out[1]);
+  close(p_in[0]);
 
-    /* open the file from file descriptor (pipe). */
-    FILE* f = fdopen(p_in[1], "w");
+  /* the writes to the subprocess never block: while its stdin is
+   * full, its stdout is read (see pump_write). */
+  struct Pump pump = {
+    .in = p_in[1], .out = p_out[0], .dest = dest, .s_dest = s_dest
+  };
+  fcntl(pump.in, F_SETFL, fcntl(pump.in, F_GETFL) | O_NONBLOCK);
+  cookie_io_functions_t io = { .write = pump_write };
+  FILE* f = fopencookie(&pump, "w", io);
 
-    /* exit function if the file descriptor opening fails. */
-    if (!f) {
-      fputs("pipe failed.\n", stderr);
-      return 0;
-    }
+  /* exit function if the file opening fails. */
+  if (!f) {
+    fputs("pipe failed.\n", stderr);
+    close(pump.in);
+    close(pump.out);
+    return 0;
+  }
+  setvbuf(f, NULL, _IOFBF, PUMP_BUFSIZE);
 
-    write_res(res, field_sep, record_sep, f);
+  /* fzf can end before all rows are written (e.g. the user picks an
+   * entry while the query is running): i don't want SIGPIPE to end
+   * the program then. */
+  struct sigaction ignore = { .sa_handler = SIG_IGN }, old;
+  sigaction(SIGPIPE, &ignore, &old);
+  rows->pump = &pump;
+  int code = write_rows(rows, field_sep, record_sep, f);
+  rows->pump = NULL;
 
-    /* close file (pipe). */
-    fclose(f);
+  /* close file (pipe). the subprocess then gets EOF. */
+  fclose(f);
+  close(pump.in);
+  sigaction(SIGPIPE, &old, NULL);
 
-    /* close file descriptor.
-     * /!\: before read(...) */
-    close(p_in[1]);
+  /* read the rest of the output (until the subprocess ends). */
+  while (!pump.done)
+    pump_read(&pump);
+  close(pump.out);
+  waitpid(cpid, NULL, 0);
 
-    /* read to dest */
-    read(p_out[0], dest, s_dest);
+  return code;
+}
 
-    /* close file descriptors.*/
-    close(p_out[0]);
+/* write a row, with a field separator after each field but the
+ * last one. there is no need to check that a value is not NULL
+ * because NULL values are just returned as empty strings by libpq. */
+static void
+write_row(PGresult* res,
+  int i,
+  char* field_sep,
+  char record_sep,
+  struct Output* o)
+{
+  int n_fields = PQnfields(res) - 1;
+  int j;
+  for (j = 0; j < n_fields; j++) {
+    output_write(
+      o, PQgetvalue(res, i, j), (size_t)PQgetlength(res, i, j));
+    output_str(o, field_sep);
   }
-
-  return 1;
+  output_write(
+    o, PQgetvalue(res, i, j), (size_t)PQgetlength(res, i, j));
+  output_char(o, record_sep);
 }
 
 void
 write_res(PGresult* res, char* field_sep, char record_sep, FILE* f)
 {
-  /* get number of rows and columns, in order to iterate on them.
-   * i substract 1 to n_fields because i don't want a delimiter
-   * after last field (so it requires another processing after the
-   * loop). */
+  struct Output o;
+  if (!output_open(&o, f))
+    return;
   int n_rows = PQntuples(res);
-  int n_fields = PQnfields(res) - 1;
-  int i = 0, j = 0;
-  /* iterate over the rows and columns and pipe everything to
-   * stdout (popen). there is no need to check that a value is not
-   * NULL because NULL values are just returned as empty strings
-   * by libpq.*/
-  for (i = 0; i < n_rows; i++) {
-    for (j = 0; j < n_fields; j++) {
-      char* data = PQgetvalue(res, i, j);
-      fputs(data, f);
-      fputs(field_sep, f);
+  for (int i = 0; i < n_rows; i++)
+    write_row(res, i, field_sep, record_sep, &o);
+  output_close(&o);
+}
+
+/* cancel the query running on a connection. */
+static void
+cancel_query(PGconn* conn)
+{
+  PGcancel* cancel = PQgetCancel(conn);
+  char errbuf[256];
+  if (cancel != NULL) {
+    PQcancel(cancel, errbuf, sizeof(errbuf));
+    PQfreeCancel(cancel);
+  }
+}
+
+/* read the last results of a query (res is the first of them), and
+ * print an error message if the query has failed. returns 0 then,
+ * unless it was cancelled here (the rows left were not wanted). */
+static int
+end_rows(PGconn* conn, PGresult* res, int cancelled)
+{
+  int code = 1;
+  do {
+    ExecStatusType status = PQresultStatus(res);
+    if (status != PGRES_TUPLES_OK && status != PGRES_COMMAND_OK) {
+      if (!cancelled) {
+        fprintf(stderr,
+          "query failed:\n %s\n",
+          PQresultErrorMessage(res));
+        code = 0;
+      }
+    }
+    PQclear(res);
+  } while ((res = PQgetResult(conn)) != NULL);
+  return code;
+}
+
+/* write a row in COPY text format: fields are separated by tabs,
+ * the row ends with a newline, and tabs, newlines and backslashes
+ * in values are escaped with backslashes (NULL is \N). the bytes
+ * are written as they are, except for these. */
+static void
+write_copy_row(const char* row,
+  int len,
+  char* field_sep,
+  char record_sep,
+  struct Output* o)
+{
+  const char* end = row + len;
+  const char* span = row;
+  for (const char* p = row; p < end; p++) {
+    if (*p != '\t' && *p != '\n' && *p != '\\')
+      continue;
+    output_write(o, span, (size_t)(p - span));
+    if (*p == '\t')
+      output_str(o, field_sep);
+    else if (*p == '\n')
+      output_char(o, record_sep);
+    else if (p + 1 < end) {
+      switch (*++p) {
+        case 'n':
+          output_char(o, '\n');
+          break;
+        case 't':
+          output_char(o, '\t');
+          break;
+        case 'r':
+          output_char(o, '\r');
+          break;
+        case 'b':
+          output_char(o, '\b');
+          break;
+        case 'f':
+          output_char(o, '\f');
+          break;
+        case 'v':
+          output_char(o, '\v');
+          break;
+        case 'N':
+          break;
+        default:
+          output_char(o, *p);
+          break;
+      }
+    }
+    span = p + 1;
+  }
+  output_write(o, span, (size_t)(end - span));
+}
+
+int
+first_row(struct Rows* rows)
+{
+  PGresult* res = PQgetResult(rows->conn);
+  switch (PQresultStatus(res)) {
+    case PGRES_SINGLE_TUPLE:
+      rows->first = res;
+      return 1;
+    case PGRES_COPY_OUT:
+      PQclear(res);
+      rows->copy_len = PQgetCopyData(rows->conn, &rows->copy, 0);
+      if (rows->copy_len > 0)
+        return 1;
+      end_rows(rows->conn, PQgetResult(rows->conn), 0);
+      return 0;
+    default:
+      end_rows(rows->conn, res, 0);
+      return 0;
+  }
+}
+
+/* write the rows of a query sent in single row mode. */
+static int
+write_single_rows(struct Rows* rows,
+  char* field_sep,
+  char record_sep,
+  struct Output* o)
+{
+  PGconn* conn = rows->conn;
+  PGresult* res = rows->first;
+  int cancelled = 0;
+  while (PQresultStatus(res) == PGRES_SINGLE_TUPLE) {
+    if (!cancelled)
+      write_row(res, 0, field_sep, record_sep, o);
+    PQclear(res);
+    /* if the next row is not there yet, the rows already written
+     * are flushed, so they are shown while the query is running. if
+     * fzf ends while waiting, the query is cancelled. */
+    if (!cancelled && PQisBusy(conn)) {
+      output_flush(o);
+      while (PQisBusy(conn) && wait_conn(rows))
+        ;
+      if (PQisBusy(conn)) {
+        cancel_query(conn);
+        cancelled = 1;
+      }
+    }
+    /* if the file can't be written anymore (fzf has ended before
+     * the end of the query), the query is cancelled. */
+    if (!cancelled && o->error) {
+      cancel_query(conn);
+      cancelled = 1;
+    }
+    res = PQgetResult(conn);
+  }
+
+  /* the last result has no row: it only tells if the query has
+   * succeeded. (an error can come after some rows.) */
+  return end_rows(conn, res, cancelled);
+}
+
+/* write the rows of a COPY, the same way. */
+static int
+write_copy_rows(struct Rows* rows,
+  char* field_sep,
+  char record_sep,
+  struct Output* o)
+{
+  PGconn* conn = rows->conn;
+  char* row = rows->copy;
+  int len = rows->copy_len;
+  int cancelled = 0;
+  while (len > 0) {
+    if (!cancelled)
+      write_copy_row(row, len, field_sep, record_sep, o);
+    PQfreemem(row);
+    len = PQgetCopyData(conn, &row, 1);
+    if (len == 0 && !cancelled) {
+      output_flush(o);
+      while (len == 0 && wait_conn(rows))
+        len = PQgetCopyData(conn, &row, 1);
+      if (len == 0) {
+        cancel_query(conn);
+        cancelled = 1;
+      }
+    }
+    if (len == 0)
+      len = PQgetCopyData(conn, &row, 0);
+    if (!cancelled && o->error) {
+      cancel_query(conn);
+      cancelled = 1;
     }
-    char* data = PQgetvalue(res, i, j);
-    fputs(data, f);
-    fputc(record_sep, f);
   }
+  return end_rows(conn, PQgetResult(conn), cancelled);
+}
+
+int
+write_rows(struct Rows* rows,
+  char* field_sep,
+  char record_sep,
+  FILE* f)
+{
+  struct Output o;
+  if (!output_open(&o, f))
+    return 0;
+  int code =
+    (rows->first != NULL)
+      ? write_single_rows(rows, field_sep, record_sep, &o)
+      : write_copy_rows(rows, field_sep, record_sep, &o);
+  output_close(&o);
+  return code;
 }
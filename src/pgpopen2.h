@@ -13,15 +13,45 @@
 #include <stdio.h>
 #include <unistd.h>
 
-/* pgpopen2 -- pipe out a PGresult then read the result.
+struct Pump;
+
+/* the rows of a query, read while they arrive: in single row mode,
+ * or with 'copy ... to stdout'. */
+struct Rows
+{
+  PGconn* conn;
+  /* single row mode: the first row. */
+  PGresult* first;
+  /* copy: the first row (in COPY text format) and its length. */
+  char* copy;
+  int copy_len;
+  /* the subprocess the rows are piped to (set by pgpopen2). */
+  struct Pump* pump;
+};
+
+/* first_row -- read the first row of a query.
+ *
+ * returns 0 if the query has failed (an error message is printed)
+ * or if there is no row. else, the row is in rows.
+ * */
+int
+first_row(struct Rows* rows);
+
+/* pgpopen2 -- pipe out the rows of a query then read the result.
  *
  * like popen2, it uses bidirectional pipe (main -> sub -> main).
+ * the rows are piped out as they arrive (see write_rows), and the
+ * output of the subprocess is read at the same time. if the
+ * subprocess ends first, the query is cancelled.
+ *
+ * returns 0 if the query failed: the subprocess was then given only
+ * some of the rows.
  *
  * parameters
  * ----------
  *
- * res (PGresult):
- *      pointer to the PGresult.
+ * rows (struct Rows*):
+ *      the rows, the first one already read (first_row).
  *
  * field_sep (char*):
  *      field separator (char*).
@@ -45,7 +75,7 @@
  *
  */
 int
-pgpopen2(PGresult* res,
+pgpopen2(struct Rows* rows,
   char* field_sep,
   char record_sep,
   char* dest,
@@ -73,4 +103,36 @@ pgpopen2(PGresult* res,
 void
 write_res(PGresult* res, char* field_sep, char record_sep, FILE* f);
 
+/* write_rows -- write the rows of a query while they arrive.
+ *
+ * each row is written as soon as it arrives, so the memory used
+ * doesn't depend on the size of the result. rows from COPY are
+ * written almost as they are: only the separators and the escaped
+ * characters are replaced. the results are cleared and the
+ * connection is left ready for another query.
+ *
+ * parameters
+ * ----------
+ *
+ *  rows (struct Rows*)
+ *      the rows, the first one already read (first_row).
+ *
+ *  field_sep (char*)
+ *      field separator
+ *
+ *  record_sep (char)
+ *      record separator. a single char.
+ *
+ *  f (FILE*)
+ *      the opened file.
+ *
+ * returns 0 if the query failed (not if it was cancelled because
+ * the rows were not read anymore).
+ * */
+int
+write_rows(struct Rows* rows,
+  char* field_sep,
+  char record_sep,
+  FILE* f);
+
 #endif
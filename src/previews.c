@@ -0,0 +1,607 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "previews.h"
+#include "print.h"
+#include "sizes.h"
+#include "util.h"
+
+/* the file of the store, in the cache directory. */
+#define STORE_NAME "previews"
+#define STORE_MAGIC "rlprev1"
+/* the fingerprints are md5 sums (in hex). */
+#define FP_LEN 32
+
+/* the fingerprints of the entries. the ids are sorted as bytes (as
+ * strcmp does), to be merged with the results of the rendering. */
+#define FINGERPRINTS \
+  "select e.id, md5(e::text || r.lastedit::text\n" \
+  "  || coalesce(get_tags(e, ''), '') || coalesce((select\n" \
+  "  string_agg(f.filepath, ' ' order by f.filepath) from file f\n" \
+  "  where f.entry = e.id), ''))\n" \
+  "from entry e join reading r on r.id = e.id\n" \
+  "order by e.id collate \"C\""
+
+/* the queries of preview (see util.c), for a batch of entries. */
+#define RENDER_ENTRIES \
+  "select e.*, get_tags(e, '') as tags from entry e\n" \
+  "where e.id = any($1::text[]) order by e.id collate \"C\""
+#define RENDER_FILES \
+  "select * from (select entry, filepath from file\n" \
+  "where entry = any($1::text[])\n" \
+  "union select id, \"URL\" from entry where id = any($1::text[]))" \
+  " u\norder by u.entry collate \"C\""
+#define RENDER_NOTES \
+  "select id, notes from reading where id = any($1::text[])\n" \
+  "order by id collate \"C\""
+
+/* the file starts with a header, followed by the slots of the hash
+ * table (a power of 2, at most half full, probed linearly), then by
+ * the ids and the previews, which the slots point to. */
+struct Header
+{
+  char magic[8];
+  uint32_t width;
+  uint32_t n_slots;
+  uint64_t n_entries;
+};
+
+/* a slot of the table (key_len is 0 if it's empty). stale counts
+ * the times the preview was marked stale. */
+struct Slot
+{
+  uint64_t hash;
+  uint64_t key;
+  uint64_t blob;
+  uint32_t key_len;
+  uint32_t blob_len;
+  uint32_t stale;
+  char fp[FP_LEN];
+};
+
+/* a store mapped in memory. */
+struct Store
+{
+  char* map;
+  size_t size;
+  const struct Header* h;
+  struct Slot* slots;
+};
+
+/* the store being written: its file, its slots (with the ids they
+ * hold) and the offset of the next id. */
+struct Writer
+{
+  FILE* f;
+  struct Slot* slots;
+  const char** keys;
+  uint32_t n_slots;
+  uint64_t n_entries;
+  uint64_t off;
+};
+
+/* the path of a file of the store, in $XDG_CACHE_HOME/retrolire (or
+ * ~/.cache/retrolire), which is made if mkdirs is set. */
+static int
+store_path(char* dest, size_t size, const char* name, int mkdirs)
+{
+  const char* cache = getenv("XDG_CACHE_HOME");
+  const char* home = getenv("HOME");
+  int n;
+  if (cache != NULL && cache[0] != '\0')
+    n = snprintf(dest, size, "%s/retrolire", cache);
+  else if (home != NULL)
+    n = snprintf(dest, size, "%s/.cache/retrolire", home);
+  else
+    return 0;
+  if (n <= 0 || (size_t)n >= size)
+    return 0;
+  if (mkdirs) {
+    /* the parent first (~/.cache), which can be missing too. */
+    char* slash = strrchr(dest, '/');
+    *slash = '\0';
+    mkdir(dest, 0700);
+    *slash = '/';
+    mkdir(dest, 0700);
+  }
+  int m = snprintf(dest + n, size - (size_t)n, "/%s", name);
+  return m > 0 && (size_t)m < size - (size_t)n;
+}
+
+/* map the store in memory (shared: the stale marks of the other
+ * processes are seen). returns 0 if there is none, or if it's not a
+ * valid one. */
+static int
+map_store(struct Store* st, int writable)
+{
+  char path[MAX_FILEPATH];
+  if (!store_path(path, sizeof(path), STORE_NAME, 0))
+    return 0;
+  int fd = open(path, writable ? O_RDWR : O_RDONLY);
+  if (fd == -1)
+    return 0;
+  struct stat sb;
+  if (fstat(fd, &sb) == -1
+      || (size_t)sb.st_size < sizeof(struct Header)) {
+    close(fd);
+    return 0;
+  }
+  st->size = (size_t)sb.st_size;
+  int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+  st->map = mmap(NULL, st->size, prot, MAP_SHARED, fd, 0);
+  close(fd);
+  if (st->map == MAP_FAILED)
+    return 0;
+  st->h = (const struct Header*)st->map;
+  st->slots = (struct Slot*)(st->map + sizeof(struct Header));
+  uint32_t n_slots = st->h->n_slots;
+  if (memcmp(st->h->magic, STORE_MAGIC, sizeof(STORE_MAGIC)) != 0
+      || n_slots == 0 || (n_slots & (n_slots - 1)) != 0
+      || (st->size - sizeof(struct Header)) / sizeof(struct Slot)
+           < n_slots) {
+    munmap(st->map, st->size);
+    return 0;
+  }
+  return 1;
+}
+
+static void
+unmap_store(struct Store* st)
+{
+  munmap(st->map, st->size);
+  st->map = NULL;
+}
+
+/* fnv-1a. */
+static uint64_t
+hash_id(const char* id, size_t len)
+{
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)id[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/* find the slot of an id, with its preview (NULL if there is none,
+ * or if the slot points out of the file). */
+static struct Slot*
+find_slot(const struct Store* st, const char* id)
+{
+  size_t len = strlen(id);
+  uint64_t h = hash_id(id, len);
+  uint32_t mask = st->h->n_slots - 1;
+  uint32_t i = (uint32_t)h & mask;
+  for (uint32_t n = 0; n < st->h->n_slots; n++, i = (i + 1) & mask) {
+    struct Slot* s = &st->slots[i];
+    if (s->key_len == 0)
+      return NULL;
+    if (s->hash != h || s->key_len != len || s->key > st->size
+        || s->blob > st->size || st->size - s->key < len
+        || st->size - s->blob < s->blob_len)
+      continue;
+    if (memcmp(st->map + s->key, id, len) == 0)
+      return s;
+  }
+  return NULL;
+}
+
+/* take the lock of the stale marks: a refresh holds it from the
+ * copy of the marks to the rename of the new store, so that a mark
+ * can't be made in the old store once it has been copied. returns
+ * the locked file (closing it releases the lock), or -1. */
+static int
+lock_marks()
+{
+  char path[MAX_FILEPATH];
+  if (!store_path(path, sizeof(path), STORE_NAME ".marks", 0))
+    return -1;
+  int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd != -1 && flock(fd, LOCK_EX) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int
+previews_get(const char* id, int width, FILE* f)
+{
+  struct Store st;
+  if (width <= 0 || !map_store(&st, 0))
+    return 0;
+  struct Slot* s = NULL;
+  if (st.h->width == (uint32_t)width)
+    s = find_slot(&st, id);
+  int found = s != NULL && !s->stale;
+  if (found)
+    found =
+      fwrite(st.map + s->blob, 1, s->blob_len, f) == s->blob_len;
+  unmap_store(&st);
+  return found;
+}
+
+int
+previews_width()
+{
+  struct Store st;
+  if (!map_store(&st, 0))
+    return 0;
+  int width = (int)st.h->width;
+  unmap_store(&st);
+  return width;
+}
+
+void
+previews_invalidate(const char* id)
+{
+  int lock = lock_marks();
+  struct Store st;
+  if (map_store(&st, 1)) {
+    struct Slot* s = find_slot(&st, id);
+    if (s != NULL)
+      s->stale++;
+    unmap_store(&st);
+  }
+  if (lock != -1)
+    close(lock);
+}
+
+/* check if a refresh holds its lock, without waiting for it. */
+static int
+refresh_running()
+{
+  char path[MAX_FILEPATH];
+  if (!store_path(path, sizeof(path), STORE_NAME ".lock", 0))
+    return 0;
+  int fd = open(path, O_RDWR | O_CLOEXEC);
+  if (fd == -1)
+    return 0;
+  int running = flock(fd, LOCK_EX | LOCK_NB) == -1;
+  close(fd);
+  return running;
+}
+
+void
+previews_spawn(int width)
+{
+  /* the running refresh will do: no process is forked for nothing
+   * (e.g. for each row of a picker scrolled before the store is
+   * made). */
+  if (refresh_running())
+    return;
+  /* what is written must not be written again by the child. */
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid != 0) {
+    if (pid > 0)
+      waitpid(pid, NULL, 0);
+    return;
+  }
+  /* the child forks again and ends at once: the refresh is not a
+   * child of the caller, which doesn't wait for it. it keeps none
+   * of the pipes of the caller (fzf waits for the end of the
+   * output of the preview). */
+  if (fork() != 0)
+    _exit(EXIT_SUCCESS);
+  setsid();
+  int fd = open("/dev/null", O_RDWR);
+  if (fd != -1) {
+    dup2(fd, STDIN_FILENO);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    if (fd > STDERR_FILENO)
+      close(fd);
+  }
+  char w[16];
+  snprintf(w, sizeof(w), "%d", width);
+  execlp("retrolire", "retrolire", "_store", w, (char*)NULL);
+  _exit(EXIT_FAILURE);
+}
+
+/* find the free slot of an id in the store being written. */
+static struct Slot*
+free_slot(struct Writer* w, const char* id, uint64_t h)
+{
+  uint32_t mask = w->n_slots - 1;
+  uint32_t i = (uint32_t)h & mask;
+  while (w->slots[i].key_len != 0)
+    i = (i + 1) & mask;
+  w->keys[i] = id;
+  return &w->slots[i];
+}
+
+/* write an id and its preview, and put it in the table. */
+static int
+put_entry(struct Writer* w,
+  const char* id,
+  const char* fp,
+  const char* blob,
+  size_t blob_len)
+{
+  size_t len = strlen(id);
+  if (len == 0 || blob_len > UINT32_MAX
+      || fwrite(id, 1, len, w->f) != len
+      || fwrite(blob, 1, blob_len, w->f) != blob_len) {
+    fputs("error writing the previews.\n", stderr);
+    return 0;
+  }
+  uint64_t h = hash_id(id, len);
+  struct Slot* s = free_slot(w, id, h);
+  s->hash = h;
+  s->key = w->off;
+  s->key_len = (uint32_t)len;
+  s->blob = w->off + len;
+  s->blob_len = (uint32_t)blob_len;
+  s->stale = 0;
+  memcpy(s->fp, fp, FP_LEN);
+  w->off += len + blob_len;
+  w->n_entries++;
+  return 1;
+}
+
+/* make the array literal of a list of ids (each one double quoted,
+ * with its backslashes and double quotes escaped). */
+static int
+array_literal(struct Buf* b, PGresult* fps, const int* rows, int n)
+{
+  if (!buf_cat(b, "{", 1))
+    return 0;
+  for (int i = 0; i < n; i++) {
+    const char* id = PQgetvalue(fps, rows[i], 0);
+    if ((i > 0 && !buf_cat(b, ",", 1)) || !buf_cat(b, "\"", 1))
+      return 0;
+    for (; *id; id++) {
+      if ((*id == '"' || *id == '\\') && !buf_cat(b, "\\", 1))
+        return 0;
+      if (!buf_cat(b, id, 1))
+        return 0;
+    }
+    if (!buf_cat(b, "\"", 1))
+      return 0;
+  }
+  return buf_cat(b, "}", 1);
+}
+
+/* move a cursor in a result sorted by ids (column col) to the first
+ * row of an id, or after it. returns 1 if the row is one of id. */
+static int
+seek_id(PGresult* res, int col, int* row, const char* id)
+{
+  int n_rows = PQntuples(res);
+  while (*row < n_rows && strcmp(PQgetvalue(res, *row, col), id) < 0)
+    (*row)++;
+  return *row < n_rows && strcmp(PQgetvalue(res, *row, col), id) == 0;
+}
+
+/* render the previews of a batch of entries (rows of fps), with the
+ * queries of preview sent at once for the whole batch. */
+static int
+render_batch(struct Writer* w,
+  PGresult* fps,
+  const int* rows,
+  int n,
+  int width)
+{
+  struct Buf ids = { 0 };
+  if (!array_literal(&ids, fps, rows, n)) {
+    free(ids.s);
+    return 0;
+  }
+  const char* params[] = { ids.s };
+  struct Query queries[] = {
+    { .query = RENDER_ENTRIES, .npar = 1, .params = params },
+    { .query = RENDER_FILES, .npar = 1, .params = params },
+    { .query = RENDER_NOTES, .npar = 1, .params = params },
+  };
+  PGresult* res[3];
+  int ok = exec_pipeline(queries, 3, res);
+  free(ids.s);
+  if (!ok)
+    return 0;
+  for (int i = 0; i < 3; i++) {
+    if (ok && PQresultStatus(res[i]) != PGRES_TUPLES_OK) {
+      fprintf(stderr, "query failed:\n %s\n", result_error(res[i]));
+      ok = 0;
+    }
+  }
+
+  /* the previews are written one after the other in memory, then
+   * copied to the store. */
+  char* buf = NULL;
+  size_t size = 0;
+  FILE* m = ok ? open_memstream(&buf, &size) : NULL;
+  long* ends = ok ? calloc((size_t)n + 1, sizeof(long)) : NULL;
+  ok = m != NULL && ends != NULL;
+  int id_col = ok ? PQfnumber(res[0], "id") : -1;
+  int e = 0, f = 0, no = 0;
+  for (int i = 0; ok && i < n; i++) {
+    const char* id = PQgetvalue(fps, rows[i], 0);
+    struct Preview p = { .entry = res[0], .row = -1 };
+    p.files = res[1];
+    p.files_col = 1;
+    if (seek_id(res[0], id_col, &e, id))
+      p.row = e;
+    seek_id(res[1], 0, &f, id);
+    p.files_from = f;
+    while (f < PQntuples(res[1])
+           && strcmp(PQgetvalue(res[1], f, 0), id) == 0)
+      f++;
+    p.files_to = f;
+    if (seek_id(res[2], 0, &no, id))
+      p.notes = PQgetvalue(res[2], no, 1);
+    /* an entry deleted since the fingerprints is left out. */
+    if (p.row != -1)
+      ok = write_preview(&p, m, width);
+    ok = ok && fflush(m) == 0;
+    ends[i + 1] = ftell(m);
+  }
+  if (m != NULL)
+    fclose(m);
+  for (int i = 0; ok && i < n; i++) {
+    if (ends[i + 1] == ends[i])
+      continue;
+    ok = put_entry(w,
+      PQgetvalue(fps, rows[i], 0),
+      PQgetvalue(fps, rows[i], 1),
+      buf + ends[i],
+      (size_t)(ends[i + 1] - ends[i]));
+  }
+  free(buf);
+  free(ends);
+  for (int i = 0; i < 3; i++)
+    PQclear(res[i]);
+  return ok;
+}
+
+/* the previews marked stale in the old store while the new one was
+ * written (since the snapshot of their marks) stay stale in the new
+ * one. */
+static void
+copy_stale(struct Writer* w, const struct Store* old, uint32_t* snap)
+{
+  uint32_t mask = w->n_slots - 1;
+  for (uint32_t j = 0; j < old->h->n_slots; j++) {
+    const struct Slot* o = &old->slots[j];
+    if (o->stale == snap[j] || o->key_len == 0 || o->key > old->size
+        || old->size - o->key < o->key_len)
+      continue;
+    uint32_t i = (uint32_t)o->hash & mask;
+    for (; w->slots[i].key_len != 0; i = (i + 1) & mask) {
+      if (w->slots[i].hash == o->hash
+          && w->slots[i].key_len == o->key_len
+          && memcmp(w->keys[i], old->map + o->key, o->key_len) == 0) {
+        w->slots[i].stale = 1;
+        break;
+      }
+    }
+  }
+}
+
+/* write a new store, with the previews of the old one that are
+ * still up to date, and rename it over the old one. */
+static int
+build_store(const struct Store* old, int width)
+{
+  char path[MAX_FILEPATH], tmp[MAX_FILEPATH];
+  if (!store_path(path, sizeof(path), STORE_NAME, 1)
+      || !store_path(tmp, sizeof(tmp), STORE_NAME ".tmp", 0)) {
+    fputs("no cache directory for the previews.\n", stderr);
+    return 0;
+  }
+  /* the stale marks, before the fingerprints are taken. */
+  uint32_t* snap = NULL;
+  if (old != NULL) {
+    snap = malloc(old->h->n_slots * sizeof(uint32_t));
+    for (uint32_t j = 0; snap && j < old->h->n_slots; j++)
+      snap[j] = old->slots[j].stale;
+  }
+  PGresult* fps = exec_params(FINGERPRINTS, 0, NULL);
+  if (PQresultStatus(fps) != PGRES_TUPLES_OK) {
+    fprintf(stderr, "query failed:\n %s\n", result_error(fps));
+    PQclear(fps);
+    free(snap);
+    return 0;
+  }
+  int n = PQntuples(fps);
+  struct Writer w = { .n_slots = 16 };
+  while (w.n_slots < 2 * (uint64_t)n)
+    w.n_slots *= 2;
+  w.off = sizeof(struct Header) + w.n_slots * sizeof(struct Slot);
+  w.slots = calloc(w.n_slots, sizeof(struct Slot));
+  w.keys = calloc(w.n_slots, sizeof(char*));
+  int* todo = malloc(((size_t)n + 1) * sizeof(int));
+  w.f = fopen(tmp, "w");
+  int ok = w.slots && w.keys && todo && w.f && (!old || snap)
+           && fseeko(w.f, (off_t)w.off, SEEK_SET) == 0;
+  if (!ok)
+    fputs("error writing the previews.\n", stderr);
+
+  /* the previews that are up to date are copied, the others are
+   * rendered again. */
+  int n_todo = 0;
+  int same_width = old != NULL && old->h->width == (uint32_t)width;
+  for (int i = 0; ok && i < n; i++) {
+    const char* id = PQgetvalue(fps, i, 0);
+    const char* fp = PQgetvalue(fps, i, 1);
+    const struct Slot* s = same_width ? find_slot(old, id) : NULL;
+    if (s && !s->stale && memcmp(s->fp, fp, FP_LEN) == 0)
+      ok = put_entry(&w, id, fp, old->map + s->blob, s->blob_len);
+    else
+      todo[n_todo++] = i;
+  }
+  for (int i = 0; ok && i < n_todo; i += PREVIEW_BATCH) {
+    int batch = n_todo - i;
+    if (batch > PREVIEW_BATCH)
+      batch = PREVIEW_BATCH;
+    ok = render_batch(&w, fps, todo + i, batch, width);
+  }
+  /* from here to the rename, no preview can be marked stale in the
+   * old store. */
+  int lock = ok ? lock_marks() : -1;
+  if (ok && old != NULL)
+    copy_stale(&w, old, snap);
+
+  /* the header and the table, at the start of the file. */
+  struct Header h = { STORE_MAGIC, (uint32_t)width, w.n_slots, 0 };
+  h.n_entries = w.n_entries;
+  ok = ok && fseeko(w.f, 0, SEEK_SET) == 0
+       && fwrite(&h, sizeof(h), 1, w.f) == 1
+       && fwrite(w.slots, sizeof(struct Slot), w.n_slots, w.f)
+            == w.n_slots;
+  if (w.f != NULL && fclose(w.f) != 0)
+    ok = 0;
+  if (ok && rename(tmp, path) != 0) {
+    perror("rename");
+    ok = 0;
+  }
+  if (lock != -1)
+    close(lock);
+  if (!ok && w.f != NULL)
+    unlink(tmp);
+  free(w.slots);
+  free(w.keys);
+  free(todo);
+  free(snap);
+  PQclear(fps);
+  return ok;
+}
+
+int
+previews_refresh(int width)
+{
+  char lock[MAX_FILEPATH];
+  if (!store_path(lock, sizeof(lock), STORE_NAME ".lock", 1)) {
+    fputs("no cache directory for the previews.\n", stderr);
+    return 0;
+  }
+  int fd = open(lock, O_RDWR | O_CREAT, 0600);
+  if (fd == -1) {
+    perror("open");
+    return 0;
+  }
+  /* another refresh is running: it will do. */
+  if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+    close(fd);
+    return 1;
+  }
+  struct Store old;
+  int has_old = map_store(&old, 0);
+  if (width <= 0 && has_old)
+    width = (int)old.h->width;
+  /* no width yet: the first preview will give one. */
+  int code = width <= 0 || build_store(has_old ? &old : NULL, width);
+  if (has_old)
+    unmap_store(&old);
+  close(fd);
+  return code;
+}
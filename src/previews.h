@@ -0,0 +1,51 @@
+/* previews
+ * --------
+ *
+ * a store of the previews of the entries (see preview in print.h),
+ * rendered in advance, so that the preview of the picker doesn't
+ * query the database. it's a file ($XDG_CACHE_HOME/retrolire/
+ * previews) mapped in memory: a hash table of the entry ids, with
+ * their rendered preview and a fingerprint of what it shows (the
+ * entry, its tags and files, and reading.lastedit, which changes
+ * with the notes). the previews are rendered for one width of the
+ * preview window.
+ *
+ * the store is refreshed in the background (retrolire _store) when
+ * the picker starts, and made again when a preview is wanted for
+ * another width: only the entries whose fingerprint has changed are
+ * rendered again. the commands
+ * that change an entry mark its preview as stale, so that it's
+ * queried again until the next refresh.
+ *
+ * */
+
+#ifndef _PREVIEWS_H
+#define _PREVIEWS_H
+
+#include <stdio.h>
+
+/* write the stored preview of an entry to f. returns 0 if there is
+ * none (no store, another width, a stale or missing preview). */
+int
+previews_get(const char* id, int width, FILE* f);
+
+/* the width of the stored previews, or 0 if there is no store. */
+int
+previews_width();
+
+/* mark the preview of an entry as stale (if it's stored). */
+void
+previews_invalidate(const char* id);
+
+/* refresh the store in a detached process (retrolire _store), for a
+ * width (0 for the width of the store, if there is one), unless a
+ * refresh is already running. */
+void
+previews_spawn(int width);
+
+/* refresh the store (retrolire _store). it does nothing if another
+ * refresh is running. returns 0 on error. */
+int
+previews_refresh(int width);
+
+#endif
@@ -1,19 +1,112 @@
-#include <ctype.h>
+/* memrchr. */
+#define _GNU_SOURCE
+
 #include <postgresql/libpq-fe.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "output.h"
+#include "previews.h"
 #include "print.h"
 #include "sizes.h"
 #include "util.h"
 
-// print the result of a query, row by row (expanded mode wrapped).
-int
-print_result(PGresult* res, FILE* f, int term_width)
+/* the wrapping is done by scanning the value 8 bytes at a time:
+ * only the bytes that start a char are counted (the continuation
+ * bytes of UTF-8, 10xxxxxx, are not), so the width of a line is a
+ * number of chars, not of bytes. */
+#define CONT_MASK 0x8080808080808080ULL
+
+/* count the bytes that start a char in a word of 8 bytes. */
+static inline size_t
+count_chars(uint64_t w)
 {
-  // get number of rows and columns, in order to iterate on them.
-  int n_rows = PQntuples(res);
+  /* bit 7 set and bit 6 unset: a continuation byte. */
+  uint64_t cont = w & ~(w << 1) & CONT_MASK;
+  return 8 - (size_t)__builtin_popcountll(cont);
+}
+
+/* get the offset of the n-th char (from 0) of s, or len if s has
+ * fewer chars. */
+static size_t
+utf8_offset(const char* s, size_t len, size_t n)
+{
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, s + i, sizeof(w));
+    size_t c = count_chars(w);
+    if (c > n)
+      break;
+    n -= c;
+  }
+  for (; i < len; i++) {
+    if (((unsigned char)s[i] & 0xC0) != 0x80) {
+      if (n == 0)
+        return i;
+      n--;
+    }
+  }
+  return len;
+}
+
+/* write a value on lines of at most 'limit' chars, each new line
+ * starting with the margin. lines are broken after the last space
+ * if there is one, and at the newlines of the value. the value is
+ * written by whole line segments. */
+static void
+write_wrapped(struct Output* o,
+  const char* data,
+  size_t len,
+  size_t limit,
+  const char* margin,
+  size_t margin_len)
+{
+  const char* p = data;
+  const char* end = data + len;
+  while (p < end) {
+    size_t rest = (size_t)(end - p);
+    size_t cut = utf8_offset(p, rest, limit);
+    /* a newline or a space just after the last char of the line
+     * can be used too. */
+    size_t span = (cut < rest) ? cut + 1 : cut;
+    const char* nl = memchr(p, '\n', span);
+    if (nl != NULL) {
+      output_write(o, p, (size_t)(nl - p));
+      if (nl + 1 < end)
+        output_write(o, margin, margin_len);
+      p = nl + 1;
+      continue;
+    }
+    if (cut == rest) {
+      output_write(o, p, rest);
+      break;
+    }
+    const char* sp = memrchr(p, ' ', span);
+    if (sp != NULL && sp > p) {
+      output_write(o, p, (size_t)(sp - p));
+      p = sp + 1;
+    } else {
+      output_write(o, p, cut);
+      p += cut;
+    }
+    output_write(o, margin, margin_len);
+  }
+}
+
+// print the rows [from, to), with a record separator after each one
+// (and before the first one, if 'first' is set).
+static int
+print_rows(PGresult* res,
+  int from,
+  int to,
+  FILE* f,
+  int term_width,
+  int first)
+{
+  // get number of columns, in order to iterate on them.
   int n_fields = PQnfields(res);
   // two arrays for fields:
   // - name
@@ -70,7 +163,7 @@ print_result(PGresult* res, FILE* f, int term_width)
   for (s = 1; s <= max_f_len; s++) {
     margin[s] = ' ';
   }
-  char* x = memccpy(margin + s, "\\  ", '\0', size);
+  char* x = memccpy(margin + s, "\\  ", '\0', size - (size_t)s);
   if (!x) {
     fputs("error creating margin for printing.\n", stderr);
     return 0;
@@ -90,93 +183,79 @@ print_result(PGresult* res, FILE* f, int term_width)
   // define a limit: the maximum number of character per line for a
   // value.
   int limit = term_width - (max_f_len + 1);
+  size_t record_sep_len = (size_t)i;
+  size_t margin_len = strlen(margin);
+  size_t names_lens[n_fields];
+  for (j = 0; j < n_fields; j++)
+    names_lens[j] = strlen(fields_names[j]);
+  // the output is buffered (see output.h).
+  struct Output o;
+  if (!output_open(&o, f))
+    return 0;
   // start by a record separator (as there is also one at the end).
-  fputs(record_sep, f);
-  putc('\n', f);
+  if (first) {
+    output_write(&o, record_sep, record_sep_len);
+    output_char(&o, '\n');
+  }
   // iterate on the rows
-  for (i = 0; i < n_rows; i++) {
+  for (i = from; i < to; i++) {
     // iterate on the fields
     for (j = 0; j < n_fields; j++) {
       // if the value is NULL, do not print it.
       if (PQgetisnull(res, i, j) == 0) {
         // else, print the field name (with padding and delimiter).
-        fputs(fields_names[j], f);
+        output_write(&o, fields_names[j], names_lens[j]);
         // get the value
         char* data = PQgetvalue(res, i, j);
         // get the length of the value
         int len = PQgetlength(res, i, j);
-        // if the length of the value is smaller than the limit,
-        // i just print it.
-        if (len < limit) {
-          fputs(data, f);
-        }
-        // but if the length is bigger than the limit, then i
-        // wrap the value
-        else {
-          // first, put the first char, so i can use modulo without
-          // having issue with the first char (index 0).
-          putc(data[0], f);
-          // then, i iterate over the chars, until i reach the total
-          // length
-          for (int c = 1; c < len; ++c) {
-            // if char-index modulo limit is 0: newline and margin.
-            if (c % limit == 0) {
-              // that part is ugly but well it works so for now i'll
-              // keep this.
-              if (isascii(data[c])) {
-                fputs(margin, f);
-              } else {
-                while (1) {
-                  putc(data[c], f);
-                  c++;
-                  if (isascii(data[c])) {
-                    fputs(margin, f);
-                    break;
-                  }
-                }
-              }
-            }
-            // put the char.
-            putc(data[c], f);
-          }
-        }
-        putc('\n', f);
+        // wrap the value (if it's smaller than the limit, it's just
+        // printed).
+        write_wrapped(&o,
+          data,
+          (size_t)len,
+          (limit > 0) ? (size_t)limit : 1,
+          margin,
+          margin_len);
+        output_char(&o, '\n');
       }
     }
     // a record separator: newlines and many hyphens.
-    fputs(record_sep, f);
-    putc('\n', f);
+    output_write(&o, record_sep, record_sep_len);
+    output_char(&o, '\n');
   }
-  return 1;
+  return output_close(&o);
+}
+
+// print the result of a query, row by row (expanded mode wrapped).
+int
+print_result(PGresult* res, FILE* f, int term_width)
+{
+  return print_rows(res, 0, PQntuples(res), f, term_width, 1);
+}
+
+int
+print_next_rows(PGresult* res, FILE* f, int term_width)
+{
+  return print_rows(res, 0, PQntuples(res), f, term_width, 0);
 }
 
 /* minimal informations about an entry. */
 int
 head_entry(char* id)
 {
-  /* connect to the database. then, define an array for parameters,
-   * and a string for statement.
+  /* define an array for parameters, and a string for statement.
    * */
-  CONNECT
   const char* params[] = { id };
-  PGresult* res = PQexecParams(conn,
-    "select * from _head where id = $1",
-    1,
-    NULL,
-    params,
-    NULL,
-    NULL,
-    0);
+  PGresult* res = exec_prepared(STMT_HEAD, 1, params);
   /* this function is used for previewing, so i don't want it to
    * print long and complete messages. but i still handle errors and
    * exit function in case there is a problem. */
   if (PQresultStatus(res) != PGRES_TUPLES_OK) {
     fputs("query failed.\n", stderr);
     PQclear(res);
-    PQfinish(conn);
     return 0;
   } else if (PQntuples(res) == 0) {
-    PQfinish(conn);
     PQclear(res);
     return 0;
   }
@@ -188,97 +267,96 @@ head_entry(char* id)
     puts(PQgetvalue(res, 0, i));
   }
   PQclear(res);
-  PQfinish(conn);
   return 0;
 }
 
-/* preview with: bat, less or stdout. */
+int
+write_preview(const struct Preview* p, FILE* f, int term_width)
+{
+  /* first part of the preview: informations about the entry (only
+   * the separator if there is no row). */
+  int from = p->row < 0 ? 0 : p->row;
+  int to = p->row < 0 ? 0 : p->row + 1;
+  if (p->entry && !print_rows(p->entry, from, to, f, term_width, 1))
+    return 0;
+
+  /* then its files (and url), one a line, and its notes. */
+  for (int i = p->files_from; p->files && i < p->files_to; i++) {
+    fputs(PQgetvalue(p->files, i, p->files_col), f);
+    fputc('\n', f);
+  }
+  if (p->notes != NULL) {
+    fputs("\n\n", f);
+    fputs(p->notes, f);
+  }
+  putc('\n', f);
+  return !ferror(f);
+}
+
+/* preview with: bat, less or stdout. the preview is taken from the
+ * store (see previews.h) if it's there, and up to date. */
 int
 preview(char* id)
 {
-  /* connect to the database and send a simple query to get entry
-   * metadata (all fields). */
-  CONNECT
-  const char* params[] = { id };
+  int term_width = get_term_width();
+  if (preview_store && previews_get(id, term_width, stdout))
+    return 1;
 
-  /* first part of the preview: informations about the entry. */
-  PGresult* res = PQexecParams(conn,
-    "select e.*, get_tags(e, '') as tags from entry e\n"
-    "where e.id = $1",
-    1,
-    NULL,
-    params,
-    NULL,
-    NULL,
-    0);
-  if (PQresultStatus(res) == PGRES_TUPLES_OK)
-    print_result(res, stdout, get_term_width());
-  PQclear(res);
+  /* the three queries (entry metadata, files and notes) are sent in
+   * a single pipeline. */
+  const char* params[] = { id };
+  struct Query queries[] = {
+    { .stmt = STMT_PREVIEW_ENTRY, .npar = 1, .params = params },
+    { .stmt = STMT_PREVIEW_FILES, .npar = 1, .params = params },
+    { .stmt = STMT_PREVIEW_NOTES, .npar = 1, .params = params },
+  };
+  PGresult* res[3];
+  if (!exec_pipeline(queries, 3, res))
+    return 0;
 
-  /* show files associated with the entry, and show tags. */
-  res = PQexecParams(conn,
-    "select filepath from file where entry = $1\n"
-    "union select \"URL\" from entry e where e.id = $1",
-    1,
-    NULL,
-    params,
-    NULL,
-    NULL,
-    0);
-  /* 2nd and 3rd queries are for files are for notes.
-   * here, it's different from the first query. if it fails or if
-   * there is no row, it doesn't matter. and it's the same for the
-   * last query. */
-  if (PQresultStatus(res) == PGRES_TUPLES_OK) {
-    int n_rows = PQntuples(res);
-    if (n_rows > 0) {
-      for (int i = 0; i < n_rows; i++) {
-        fputs(PQgetvalue(res, i, 0), stdout);
-        fputc('\n', stdout);
-      }
-    }
+  /* if the entry query fails, nothing is written about the entry.
+   * the files and the notes are optional: if a query fails or if
+   * there is no row, it doesn't matter. */
+  struct Preview p = { .entry = NULL, .row = -1 };
+  if (PQresultStatus(res[0]) == PGRES_TUPLES_OK) {
+    p.entry = res[0];
+    p.row = PQntuples(res[0]) > 0 ? 0 : -1;
+  }
+  if (PQresultStatus(res[1]) == PGRES_TUPLES_OK) {
+    p.files = res[1];
+    p.files_to = PQntuples(res[1]);
   } else {
-    fputs(PQerrorMessage(conn), stderr);
+    fputs(result_error(res[1]), stderr);
   }
-
-  PQclear(res);
-  res = PQexecParams(conn,
-    "select notes from reading where id = $1",
-    1,
-    NULL,
-    params,
-    NULL,
-    NULL,
-    0);
-  if (PQresultStatus(res) == PGRES_TUPLES_OK) {
-    int n_rows = PQntuples(res);
-    if (n_rows != 0) {
-      char* data = PQgetvalue(res, 0, 0);
-      if (data != NULL) {
-        fputs("\n\n", stdout);
-        fputs(data, stdout);
-      }
-    }
+  if (PQresultStatus(res[2]) == PGRES_TUPLES_OK) {
+    if (PQntuples(res[2]) != 0)
+      p.notes = PQgetvalue(res[2], 0, 0);
   } else {
-    fputs(PQerrorMessage(conn), stderr);
+    fputs(result_error(res[2]), stderr);
   }
+  write_preview(&p, stdout, term_width);
+  PQclear(res[0]);
+  PQclear(res[1]);
+  PQclear(res[2]);
 
-  putc('\n', stdout);
-  PQclear(res);
-  PQfinish(conn);
+  /* the store has no previews for this width (or there is no store
+   * yet): it's made in the background. a stale or missing preview
+   * is left to the refresh of the picker session (see main.c). */
+  if (preview_store && previews_width() != term_width)
+    previews_spawn(term_width);
   return 1;
 }
 
 int
 preview_cache_entry()
 {
-  CONNECT
-  PGresult* res = PQexec(conn,
+  PGresult* res = exec_params(
     "select e.*, get_tags(e, '') as tags from entry e\n"
-    "join _cache c on c.entry = e.id\n");
+    "join _cache c on c.entry = e.id\n",
+    0,
+    NULL);
   print_result(res, stdout, get_term_width());
   PQclear(res);
-  PQfinish(conn);
   return 1;
 }
 
@@ -286,16 +364,14 @@ preview_cache_entry()
 int
 list_tags()
 {
-  /* connect to database. */
-  CONNECT;
   /* send query. */
-  PGresult* res = PQexec(conn, "select distinct tag from tag");
+  PGresult* res =
+    exec_params("select distinct tag from tag", 0, NULL);
   /* ensure result. */
   if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-    fprintf(stderr, "query failed: %s\n", PQerrorMessage(conn));
+    fprintf(stderr, "query failed: %s\n", result_error(res));
     /* if error: free and exit function. */
     PQclear(res);
-    PQfinish(conn);
     return 0;
   }
   /* print rows. */
@@ -305,15 +381,13 @@ list_tags()
   }
   /* free and end. */
   PQclear(res);
-  PQfinish(conn);
   return 1;
 }
 
 int
 list_fields()
 {
-  CONNECT;
-  PGresult* res = PQexec(conn, "select list_fields()");
+  PGresult* res = exec_params("select list_fields()", 0, NULL);
   int code = 1;
   /* for auto completion: no error message if it fails.*/
   if (PQresultStatus(res) != PGRES_TUPLES_OK ||
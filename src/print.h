@@ -18,6 +18,30 @@
 int
 print_result(PGresult* res, FILE* f, int term_width);
 
+/* print rows that follow rows already printed by print_result (e.g.
+ * fetched from a cursor). */
+int
+print_next_rows(PGresult* res, FILE* f, int term_width);
+
+/* the parts of the preview of an entry: its row in a result (with
+ * its tags), its files (the column files_col of the rows
+ * [files_from, files_to) of a result) and its notes. entry, files
+ * and notes can be NULL, and row is -1 if there is no entry. */
+struct Preview
+{
+  PGresult* entry;
+  int row;
+  PGresult* files;
+  int files_col;
+  int files_from;
+  int files_to;
+  const char* notes;
+};
+
+/* write the preview of an entry. returns 0 if a write failed. */
+int
+write_preview(const struct Preview* p, FILE* f, int term_width);
+
 /* preview an entry (fields, note, files, tags). */
 int
 preview(char* id);
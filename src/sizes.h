@@ -19,6 +19,25 @@
 #define MAXOPT 10
 #define MAX_ADD_TAGS 20
 
+/* queries sent together in a pipeline. */
+#define MAX_PIPELINE 8
+
+/* rows fetched at once from a cursor. */
+#define LIST_BATCH 200
+#define JSON_BATCH 500
+#define MATCH_BATCH 2000
+
+/* previews rendered at once for the store (see previews.h). */
+#define PREVIEW_BATCH 500
+
 /* les valeurs de la variable lastedit pour les options -l et -r. */
 #define LASTEDIT_LAST 1
 #define LASTEDIT_RECENT 2
+
+/* the value of pick for the option -L (search in the database as
+ * the query is typed). */
+#define PICK_LIVE 2
+
+/* the arguments of the picker (fzf), with those appended by the
+ * options and the commands. */
+#define MAX_SH_ARGS 48
@@ -82,6 +82,16 @@ append_sh(struct ShCmd* sh, char* value);
   "jsonb_concat_values(coalesce(e.author, e.editor, " \
   "e.translator), ' ') as someone\nfrom entry e join reading r " \
   "on r.id = e.id "
+/* the conditions of the live mode (option -L): the rows matching
+ * the query typed in the picker, as a pattern for ilike (see
+ * live_pattern), which the trigram indexes can serve. $? is its
+ * placeholder. an empty query is sent without this condition (see
+ * live_all in commands.c). */
+#define LIVE_ENTRY \
+  "e.title ilike $? or e.author::text ilike $? " \
+  "or e.editor::text ilike $? or e.translator::text ilike $?"
+#define LIVE_QUOTE "q.quote ilike $?"
+#define LIVE_CONCEPT "c.name ilike $?"
 #define WHEREAND(i) i == 0 ? "\n\nwhere " : "\nand "
 #define ORDER "order by lastedit"
 #define SIZE_CND MAX_SIZE - (sizeof(BASE_STMT) + sizeof(ORDER))
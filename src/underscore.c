@@ -4,6 +4,7 @@
 #include <unistd.h>
 
 #include "commands.h"
+#include "previews.h"
 #include "print.h"
 #include "sizes.h"
 #include "underscore.h"
@@ -162,7 +163,17 @@ do_underscore(char* argv[])
       command_delete(pos[1], pos, 0);
       break;
 
-    case 's': // _schema
+    case 's': // _search, _store, _schema
+      if (argv[1][2] == 'e') {
+        if (!live_search(pos[1] ? pos[1] : ""))
+          exit(EXIT_FAILURE);
+        break;
+      }
+      if (argv[1][2] == 't') {
+        if (!previews_refresh(pos[1] ? atoi(pos[1]) : 0))
+          exit(EXIT_FAILURE);
+        break;
+      }
       system("cat /usr/share/retrolire/schema.sql 2>/dev/null "
              "|| echo 'schema not found (reinstall retrolire).'");
       break;
@@ -1,7 +1,12 @@
+#include <ctype.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
 
+#include "daemon.h"
+#include "output.h"
+#include "previews.h"
+#include "sizes.h"
 #include "string.h"
 #include "util.h"
 
@@ -46,23 +51,26 @@ get_term_width()
 int
 get_single_value(char* id, char* query)
 {
-  CONNECT
   /* array for parameter for single value. */
   const char* params[1] = { id };
   /* send query */
-  PGresult* res =
-    PQexecParams(conn, query, 1, NULL, params, NULL, NULL, 0);
+  PGresult* res = exec_params(query, 1, params);
   /* if query fails, return false. */
   if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-    fprintf(stderr, "query failed: %s\n", PQerrorMessage(conn));
+    fprintf(stderr, "query failed: %s\n", result_error(res));
+    PQclear(res);
+    return 0;
+  }
+  struct Output o;
+  if (!output_open(&o, stdout)) {
     PQclear(res);
-    PQfinish(conn);
     return 0;
   }
-  puts(PQgetvalue(res, 0, 0));
+  output_write(
+    &o, PQgetvalue(res, 0, 0), (size_t)PQgetlength(res, 0, 0));
+  output_char(&o, '\n');
   PQclear(res);
-  PQfinish(conn);
-  return 1;
+  return output_close(&o);
 }
 
 /* a shortcut function to check for argument and print an error
@@ -81,25 +89,16 @@ check_nonull(char* arg, char* arg_type)
 int
 check_field(char* field)
 {
-  /* connection to database.*/
-  CONNECT
   /* single element array for field. */
   const char* params[1] = { field };
   /* send query. */
-  PGresult* res = PQexecParams(conn,
-    "select field_exists($1::text)",
+  PGresult* res = exec_params("select field_exists($1::text)",
     1,
-    NULL,
-    params,
-    NULL,
-    NULL,
-    0);
-  /* end connection. */
-  PQfinish(conn);
+    params);
   /* check result */
   int code = 0;
   if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-    fprintf(stderr, "query failed:\n %s\n", PQerrorMessage(conn));
+    fprintf(stderr, "query failed:\n %s\n", result_error(res));
     code = 0;
   } else if (PQgetvalue(res, 0, 0)[0] == 't') {
     code = 1;
@@ -173,8 +172,9 @@ parse_key_value(PGconn* conn,
   char* optarg)
 {
   /* define a macro for the size of the s_start string, which is the
-   * concatenation of "regexp_like(e.", the escaped field, and
-   * "::text, ". */
+   * concatenation of "e.", the escaped field, and "::text ~* ". (the
+   * operator ~* is used, and not regexp_like, because the trigram
+   * indexes can serve it.) */
   /* initiate a string to perform concatenation with. */
   /* use the split_v function and check its return value. if it's 0,
    * it failed, so exit function. */
@@ -190,10 +190,10 @@ parse_key_value(PGconn* conn,
    * after each call of memccpy, check for the result and if the
    * returned value is 0, free memory for the escaped field and end
    * function. */
-#define SIZE sizeof("regexp_like(e.::text, ") + FIELD_SIZE + 1
+#define SIZE sizeof("e.::text ~* ") + FIELD_SIZE + 1
   size_t dsize = SIZE;
   char s_start[SIZE] = "";
-  char* x = memccpy(s_start, "regexp_like(e.", '\0', SIZE);
+  char* x = memccpy(s_start, "e.", '\0', SIZE);
   if (!x) {
     free(escaped_field);
     return 0;
@@ -214,12 +214,12 @@ parse_key_value(PGconn* conn,
     return 0;
   }
   dsize -= gap;
-  x = memccpy(x - 1, "::text, ", '\0', dsize);
+  x = memccpy(x - 1, "::text ~* ", '\0', dsize);
   if (!x) {
     return 0;
   }
   /* call the function cat_cnd and return its return value. */
-  if (cat_cnd(cnd, s_start, "::text, 'i') ", npar))
+  if (cat_cnd(cnd, s_start, "::text ", npar))
     return fv.value;
   else
     return NULL;
@@ -294,79 +294,517 @@ checkconn(PGconn* conn)
 int
 cache_entry(char* id)
 {
-
-  /* connect to the database, and make sure the line in cache is not
-   * empty by insert an empty line.  */
-  CONNECT
+  /* make sure the line in cache is not empty by insert an empty
+   * line, and update the value of 'entry' with the selected id, for
+   * the preview. */
   const char* params[1] = { id };
-  PGresult* res = PQexec(
-    conn, "insert into _cache select on conflict do nothing");
-  /* check result. */
+  struct Query queries[] = {
+    { .query = "insert into _cache select on conflict do nothing" },
+    { .query = "update _cache set entry = $1",
+      .npar = 1,
+      .params = params },
+  };
+  PGresult* res[2];
+  if (!exec_pipeline(queries, 2, res))
+    return 0;
+
+  /* check results. */
+  int code = 1;
+  for (int i = 0; i < 2; i++) {
+    if (code && PQresultStatus(res[i]) != PGRES_COMMAND_OK) {
+      fprintf(stderr,
+        "error sending query to database:\n%s\n",
+        result_error(res[i]));
+      code = 0;
+    }
+    PQclear(res[i]);
+  }
+  return code;
+}
+
+int
+ask_confirmation()
+{
+  fputs("\nconfirm [y/N]: ", stdout);
+  if (getchar() != 'y') {
+    fputs("cancelled.\n", stdout);
+    return 0;
+  }
+  return 1;
+}
+
+int
+update_lastedit(char* id)
+{
+  const char* params[] = { id };
+  PGresult* res = exec_prepared(STMT_LASTEDIT, 1, params);
   if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-    fprintf(stderr,
-      "error sending query to database:\n%s\n",
-      PQerrorMessage(conn));
+    fprintf(stderr, "query failed:\n %s\n", result_error(res));
     PQclear(res);
-    PQfinish(conn);
     return 0;
   }
   PQclear(res);
+  previews_invalidate(id);
+  return 1;
+}
 
-  /* update the value of 'entry' with the selected id, for the
-   * preview. */
-  res = PQexecParams(conn,
-    "update _cache set entry = $1",
-    1,
-    NULL,
-    params,
-    NULL,
-    NULL,
-    0);
+/* the connection of the process, and the id of that process: a
+ * child process (fork) must not end it. */
+static PGconn* conn = NULL;
+static pid_t conn_pid = 0;
 
-  /* check result. */
+/* the registry of prepared statements. (they are prepared the first
+ * time they are used.) */
+static struct
+{
+  const char* name;
+  const char* query;
+  int prepared;
+} statements[N_STMT] = {
+  [STMT_HEAD] = { "head", "select * from _head where id = $1", 0 },
+  [STMT_PREVIEW_ENTRY] = { "preview_entry",
+    "select e.*, get_tags(e, '') as tags from entry e\n"
+    "where e.id = $1",
+    0 },
+  [STMT_PREVIEW_FILES] = { "preview_files",
+    "select filepath from file where entry = $1\n"
+    "union select \"URL\" from entry e where e.id = $1",
+    0 },
+  [STMT_PREVIEW_NOTES] = { "preview_notes",
+    "select notes from reading where id = $1",
+    0 },
+  [STMT_LASTEDIT] = { "lastedit",
+    "update reading set lastedit = now() where id = $1",
+    0 },
+};
+
+/* end the connection when the process exits. */
+static void
+close_conn()
+{
+  if (conn != NULL && getpid() == conn_pid)
+    PQfinish(conn);
+  conn = NULL;
+}
+
+PGconn*
+db_conn()
+{
+  static int registered = 0;
+  if (conn == NULL) {
+    conn = PQconnectdb(connectioninfo);
+    checkconn(conn);
+    conn_pid = getpid();
+    if (!registered)
+      registered = atexit(close_conn) == 0;
+  }
+  return conn;
+}
+
+/* if the connection has been lost (e.g. closed by the server while
+ * the user was in the editor), reset it. the statements will have
+ * to be prepared again. returns 1 if the connection is back. */
+static int
+reset_lost_conn()
+{
+  if (conn == NULL || PQstatus(conn) != CONNECTION_BAD)
+    return 0;
+  PQreset(conn);
+  for (int i = 0; i < N_STMT; i++)
+    statements[i].prepared = 0;
+  return PQstatus(conn) == CONNECTION_OK;
+}
+
+/* the daemon is tried first: it's only if it's not running that the
+ * connection is used. */
+PGresult*
+exec_params(const char* query, int npar, const char* const* params)
+{
+  PGresult* res = daemon_exec(query, npar, params);
+  if (res != NULL)
+    return res;
+  res = PQexecParams(
+    db_conn(), query, npar, NULL, params, NULL, NULL, 0);
+  if (PQresultStatus(res) == PGRES_FATAL_ERROR && reset_lost_conn()) {
+    PQclear(res);
+    res =
+      PQexecParams(conn, query, npar, NULL, params, NULL, NULL, 0);
+  }
+  return res;
+}
+
+PGconn*
+exec_single_rows(const char* query,
+  int npar,
+  const char* const* params)
+{
+  PGconn* c = db_conn();
+  if (!PQsendQueryParams(c, query, npar, NULL, params, NULL, NULL, 0))
+    return NULL;
+  PQsetSingleRowMode(c);
+  return c;
+}
+
+PGconn*
+exec_copy_out(const char* query, int npar, const char* const* params)
+{
+  PGconn* c = db_conn();
+  char* buf = NULL;
+  size_t size = 0;
+  FILE* f = open_memstream(&buf, &size);
+  if (!f)
+    return NULL;
+
+  /* replace the placeholders ($1, $2...) by the escaped values. (the
+   * placeholders are only looked for outside quotes.) */
+  int ok = 1;
+  char quote = '\0';
+  fputs("copy (", f);
+  for (const char* p = query; ok && *p != '\0'; p++) {
+    if (quote != '\0') {
+      if (*p == quote)
+        quote = '\0';
+    } else if (*p == '\'' || *p == '"') {
+      quote = *p;
+    } else if (*p == '$' && isdigit((unsigned char)p[1])) {
+      char* end;
+      long n = strtol(p + 1, &end, 10);
+      if (n >= 1 && n <= npar) {
+        const char* value = params[n - 1];
+        char* literal = NULL;
+        if (value == NULL)
+          fputs("null", f);
+        else if ((literal = PQescapeLiteral(c, value, strlen(value))))
+          fputs(literal, f);
+        else
+          ok = 0;
+        PQfreemem(literal);
+        p = end - 1;
+        continue;
+      }
+    }
+    fputc(*p, f);
+  }
+  fputs(") to stdout", f);
+  ok = fclose(f) == 0 && ok && PQsendQuery(c, buf);
+  free(buf);
+  return ok ? c : NULL;
+}
+
+int
+fetch_cursor(const char* query,
+  int npar,
+  const char* const* params,
+  int batch,
+  int (*handle)(PGresult* res, void* data),
+  void* data)
+{
+#define DECLARE "declare _fetch no scroll cursor for\n"
+  char fetch[sizeof("fetch  from _fetch") + 12] = "";
+  snprintf(fetch, sizeof(fetch), "fetch %d from _fetch", batch);
+  char* declare = malloc(sizeof(DECLARE) + strlen(query));
+  if (declare == NULL) {
+    fputs("error allocating memory.\n", stderr);
+    return 0;
+  }
+  strcpy(declare, DECLARE);
+  strcat(declare, query);
+
+  PGconn* c = db_conn();
+  PQclear(PQexec(c, "begin"));
+  PGresult* res =
+    PQexecParams(c, declare, npar, NULL, params, NULL, NULL, 0);
+  free(declare);
   if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-    fprintf(stderr,
-      "error sending query to database:\n%s\n",
-      PQerrorMessage(conn));
+    fprintf(
+      stderr, "query failed:\n %s\n", PQresultErrorMessage(res));
     PQclear(res);
-    PQfinish(conn);
+    PQclear(PQexec(c, "rollback"));
     return 0;
   }
+  PQclear(res);
 
-  /* clear query. */
+  /* the next batch is fetched while the current one is handled. */
+  int code = PQsendQuery(c, fetch);
+  if (!code)
+    fprintf(stderr, "query failed:\n %s\n", PQerrorMessage(c));
+  while (code) {
+    res = PQgetResult(c);
+    PQclear(PQgetResult(c));
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+      fprintf(
+        stderr, "query failed:\n %s\n", PQresultErrorMessage(res));
+      PQclear(res);
+      code = 0;
+      break;
+    }
+    if (PQntuples(res) == 0) {
+      PQclear(res);
+      break;
+    }
+    int sent = PQsendQuery(c, fetch);
+    int handled = handle(res, data);
+    PQclear(res);
+    if (handled != FETCH_NEXT) {
+      code = handled == FETCH_STOP;
+      while ((res = PQgetResult(c)) != NULL)
+        PQclear(res);
+      break;
+    }
+    if (!sent) {
+      fprintf(stderr, "query failed:\n %s\n", PQerrorMessage(c));
+      code = 0;
+    }
+  }
+  PQclear(PQexec(c, code ? "commit" : "rollback"));
+  return code;
+#undef DECLARE
+}
+
+/* prepare a statement (if it's not already prepared). */
+static int
+prepare(enum Prepared stmt)
+{
+  if (statements[stmt].prepared)
+    return 1;
+  PGresult* res = PQprepare(db_conn(),
+    statements[stmt].name,
+    statements[stmt].query,
+    0,
+    NULL);
+  statements[stmt].prepared = PQresultStatus(res) == PGRES_COMMAND_OK;
   PQclear(res);
+  return statements[stmt].prepared;
+}
 
-  /* make the fzf binding and add it to the shell command. then
-   * end the connection and return the pointer to the end of
-   * the shell command. */
-  PQfinish(conn);
+/* forget a prepared statement, so it's prepared again. */
+static void
+unprepare(enum Prepared stmt)
+{
+  char deallocate[sizeof("deallocate ") + PH] = "";
+  snprintf(deallocate,
+    sizeof(deallocate),
+    "deallocate %s",
+    statements[stmt].name);
+  PQclear(PQexec(db_conn(), deallocate));
+  statements[stmt].prepared = 0;
+}
 
-  return 1;
+int
+plan_changed(const PGresult* res)
+{
+  char* state = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+  return state != NULL && strcmp(state, "0A000") == 0;
+}
+
+PGresult*
+exec_prepared(enum Prepared stmt,
+  int npar,
+  const char* const* params)
+{
+  /* the daemon prepares the statements by itself. */
+  PGresult* res = daemon_exec(statements[stmt].query, npar, params);
+  if (res != NULL)
+    return res;
+  if (!prepare(stmt))
+    return exec_params(statements[stmt].query, npar, params);
+  res = PQexecPrepared(
+    conn, statements[stmt].name, npar, params, NULL, NULL, 0);
+  if (PQresultStatus(res) == PGRES_FATAL_ERROR && reset_lost_conn() &&
+      prepare(stmt)) {
+    PQclear(res);
+    res = PQexecPrepared(
+      conn, statements[stmt].name, npar, params, NULL, NULL, 0);
+  }
+
+  /* after an import, the table may have new columns. */
+  if (plan_changed(res)) {
+    PQclear(res);
+    unprepare(stmt);
+    if (!prepare(stmt))
+      return exec_params(statements[stmt].query, npar, params);
+    res = PQexecPrepared(
+      conn, statements[stmt].name, npar, params, NULL, NULL, 0);
+  }
+  return res;
 }
 
 int
-ask_confirmation()
+pipeline_on(PGconn* conn,
+  const struct Query* queries,
+  const char* const* names,
+  int n,
+  PGresult** res)
 {
-  fputs("\nconfirm [y/N]: ", stdout);
-  if (getchar() != 'y') {
-    fputs("cancelled.\n", stdout);
+  /* send the queries, each one followed by a sync, which ends its
+   * transaction. */
+  int sent = 0;
+  if (PQenterPipelineMode(conn)) {
+    for (; sent < n; sent++) {
+      const struct Query* q = &queries[sent];
+      int ok = (names != NULL && names[sent] != NULL)
+                 ? PQsendQueryPrepared(conn,
+                     names[sent],
+                     q->npar,
+                     q->params,
+                     NULL,
+                     NULL,
+                     0)
+                 : PQsendQueryParams(conn,
+                     q->query,
+                     q->npar,
+                     NULL,
+                     q->params,
+                     NULL,
+                     NULL,
+                     0);
+      if (!ok || !PQpipelineSync(conn))
+        break;
+    }
+  }
+
+  /* read the results: for each query, its result, a NULL, and then
+   * the result of the sync. */
+  for (int i = 0; i < n; i++) {
+    res[i] = NULL;
+    if (i >= sent)
+      continue;
+    PGresult* r;
+    while ((r = PQgetResult(conn)) != NULL) {
+      if (res[i] == NULL)
+        res[i] = r;
+      else
+        PQclear(r);
+    }
+    PQclear(PQgetResult(conn));
+  }
+  PQexitPipelineMode(conn);
+
+  /* the queries that were not sent (or got no result) get an error
+   * result, with the message of the connection. */
+  for (int i = 0; i < n; i++) {
+    if (res[i] == NULL)
+      res[i] = PQmakeEmptyPGresult(conn, PGRES_FATAL_ERROR);
+  }
+  return sent == n;
+}
+
+int
+exec_pipeline(const struct Query* queries, int n, PGresult** res)
+{
+  if (n > MAX_PIPELINE) {
+    fputs("too many queries in a pipeline.\n", stderr);
     return 0;
   }
+
+  /* the daemon gets the text of the prepared statements. */
+  struct Query q[MAX_PIPELINE] = { 0 };
+  for (int i = 0; i < n; i++) {
+    q[i] = queries[i];
+    if (q[i].query == NULL)
+      q[i].query = statements[q[i].stmt].query;
+  }
+  if (daemon_exec_queries(q, n, res))
+    return 1;
+
+  const char* names[MAX_PIPELINE] = { NULL };
+  for (int i = 0; i < n; i++) {
+    names[i] = (queries[i].query == NULL && prepare(queries[i].stmt))
+                 ? statements[queries[i].stmt].name
+                 : NULL;
+  }
+  pipeline_on(db_conn(), q, names, n, res);
+
+  /* if the connection was lost, send the whole pipeline again. */
+  if (reset_lost_conn()) {
+    for (int i = 0; i < n; i++) {
+      PQclear(res[i]);
+      names[i] =
+        (queries[i].query == NULL && prepare(queries[i].stmt))
+          ? statements[queries[i].stmt].name
+          : NULL;
+    }
+    pipeline_on(conn, q, names, n, res);
+  }
+
+  /* the statements with an outdated plan are sent again (once
+   * prepared again) on their own. */
+  for (int i = 0; i < n; i++) {
+    if (queries[i].query == NULL && plan_changed(res[i])) {
+      PQclear(res[i]);
+      unprepare(queries[i].stmt);
+      res[i] = exec_prepared(
+        queries[i].stmt, queries[i].npar, queries[i].params);
+    }
+  }
   return 1;
 }
 
+/* results rebuilt from the daemon messages have no error message:
+ * it's kept by the daemon client. */
+const char*
+result_error(const PGresult* res)
+{
+  char* msg = PQresultErrorMessage(res);
+  if (msg[0] != '\0')
+    return msg;
+  return daemon_error(res);
+}
+
 int
-update_lastedit(PGconn *conn, char* id)
+buf_cat(struct Buf* b, const char* s, size_t n)
 {
-  const char* params[] = {id, NULL};
-  PGresult *res = PQexecParams(conn,
-    "update reading set lastedit = now() where id = $1",
-    1,
-    NULL,
-    params,
-    NULL,
-    NULL,
-    0);
-  PQclear(res);
+  if (b->len + n + 1 > b->size) {
+    size_t size = b->size ? b->size : 4096;
+    while (b->len + n + 1 > size)
+      size *= 2;
+    char* temp = realloc(b->s, size);
+    if (!temp) {
+      fputs("error reallocating memory.\n", stderr);
+      return 0;
+    }
+    b->s = temp;
+    b->size = size;
+  }
+  memcpy(b->s + b->len, s, n);
+  b->len += n;
+  b->s[b->len] = '\0';
   return 1;
 }
+
+int
+json_string(struct Buf* b, const char* s, size_t n)
+{
+  static const char hex[] = "0123456789abcdef";
+  if (!buf_cat(b, "\"", 1))
+    return 0;
+  size_t i, from = 0;
+  for (i = 0; i < n; i++) {
+    unsigned char c = (unsigned char)s[i];
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
+    if (!buf_cat(b, s + from, i - from))
+      return 0;
+    from = i + 1;
+    char esc[6] = { '\\', (char)c, 0, 0, 0, 0 };
+    size_t len = 2;
+    if (c == '\n')
+      esc[1] = 'n';
+    else if (c == '\t')
+      esc[1] = 't';
+    else if (c == '\r')
+      esc[1] = 'r';
+    else if (c < 0x20) {
+      /* (a NUL can't be stored in a text column.) */
+      if (c == 0)
+        continue;
+      memcpy(esc + 1, "u00", 3);
+      esc[4] = hex[c >> 4];
+      esc[5] = hex[c & 0xf];
+      len = 6;
+    }
+    if (!buf_cat(b, esc, len))
+      return 0;
+  }
+  return buf_cat(b, s + from, n - from) && buf_cat(b, "\"", 1);
+}
@@ -71,17 +71,126 @@ ask_confirmation();
 
 /* update lastedit. */
 int
-update_lastedit(PGconn *conn, char* id);
-
-/* two macros to connect or reconnect to database, because
- * connection is everywhere so it's easier have a macro (for
- * consistency). */
-#define CONNECT \
-  PGconn* conn = PQconnectdb(connectioninfo); \
-  checkconn(conn);
-
-#define RECONNECT \
-  conn = PQconnectdb(connectioninfo); \
-  checkconn(conn);
+update_lastedit(char* id);
+
+/* the hot queries, prepared once per process. */
+enum Prepared
+{
+  STMT_HEAD,
+  STMT_PREVIEW_ENTRY,
+  STMT_PREVIEW_FILES,
+  STMT_PREVIEW_NOTES,
+  STMT_LASTEDIT,
+  N_STMT
+};
+
+/* the connection to the database. it's opened the first time it's
+ * needed, and then kept until the end of the process. */
+PGconn*
+db_conn();
+
+/* send a query, to the daemon if it's running, or else directly to
+ * the database. */
+PGresult*
+exec_params(const char* query, int npar, const char* const* params);
+
+/* send a query in single row mode, on the connection of the process
+ * (the daemon sends whole results). the rows are then read with
+ * PQgetResult. returns NULL if the query couldn't be sent. */
+PGconn*
+exec_single_rows(const char* query,
+  int npar,
+  const char* const* params);
+
+/* send a query as 'copy (query) to stdout', on the connection of the
+ * process. copy doesn't take parameters: they are written in the
+ * query as literals. returns NULL if the query couldn't be sent. */
+PGconn*
+exec_copy_out(const char* query, int npar, const char* const* params);
+
+/* what the handler of a batch of fetch_cursor returns: the next
+ * batch is wanted, or the fetching stops, either because it failed
+ * or because no more rows are needed (e.g. the pager has been
+ * quit). */
+enum Fetch
+{
+  FETCH_ERROR,
+  FETCH_NEXT,
+  FETCH_STOP
+};
+
+/* declare a cursor for a query and fetch its rows by batches. each
+ * batch is passed to 'handle' (with 'data') while the next one is
+ * fetched, and it returns an enum Fetch. the cursor lives in a
+ * transaction, on the connection of the process (not the daemon's).
+ * returns 0 if a query or the handler failed. */
+int
+fetch_cursor(const char* query,
+  int npar,
+  const char* const* params,
+  int batch,
+  int (*handle)(PGresult* res, void* data),
+  void* data);
+
+/* send a query using one of the prepared statements. */
+PGresult*
+exec_prepared(enum Prepared stmt,
+  int npar,
+  const char* const* params);
+
+/* a query sent in a pipeline: a query string, or (if query is NULL)
+ * one of the prepared statements. */
+struct Query
+{
+  const char* query;
+  enum Prepared stmt;
+  int npar;
+  const char* const* params;
+};
+
+/* send queries in a pipeline: they are all sent at once and the
+ * results are read after, so it costs a single round trip. each
+ * query is its own transaction (if one fails, the next ones are
+ * still executed). res gets a result for each query, unless there
+ * are more than MAX_PIPELINE queries (then 0 is returned). */
+int
+exec_pipeline(const struct Query* queries, int n, PGresult** res);
+
+/* send queries in a pipeline on a given connection. names are the
+ * prepared statements to use (or NULL to send the query string).
+ * returns 1 if all queries were sent. */
+int
+pipeline_on(PGconn* conn,
+  const struct Query* queries,
+  const char* const* names,
+  int n,
+  PGresult** res);
+
+/* test if a prepared statement failed because its plan can't be used
+ * anymore (a 'select *' after a column was added to the table). */
+int
+plan_changed(const PGresult* res);
+
+/* get the error message of a result (from the database or from the
+ * daemon). */
+const char*
+result_error(const PGresult* res);
+
+/* a growing string. */
+struct Buf
+{
+  char* s;
+  size_t len;
+  size_t size;
+};
+
+/* append n bytes to a Buf, growing it if needed. returns 0 if it
+ * fails (memory). */
+int
+buf_cat(struct Buf* b, const char* s, size_t n);
+
+/* append a string as a JSON string (with its double quotes). */
+int
+json_string(struct Buf* b, const char* s, size_t n);
 
 #endif
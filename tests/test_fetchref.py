@@ -0,0 +1,307 @@
+"""tests of fetchref, without the network: the DOIs are resolved by
+a local stub server (--resolver), and the isbn services are replaced
+by functions.
+
+    python3 -m unittest tests.test_fetchref
+"""
+
+from contextlib import redirect_stdout, redirect_stderr
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from unittest import mock
+import threading
+import tempfile
+import unittest
+import types
+import time
+import sys
+import io
+import os
+
+try:
+    import isbnlib  # noqa: F401
+except ImportError:
+    # a stand-in, so that fetchref can be imported: the tests replace
+    # the lookups of isbnlib anyway.
+    isbnlib = types.ModuleType("isbnlib")
+    isbnlib.ISBNLibException = type(
+        "ISBNLibException", (Exception,), {}
+    )
+    isbnlib.NotValidISBNError = type(
+        "NotValidISBNError", (isbnlib.ISBNLibException,), {}
+    )
+    isbnlib.meta = None
+    isbnlib.registry = types.SimpleNamespace(bibformatters={})
+    sys.modules["isbnlib"] = isbnlib
+
+from fetchref import cli  # noqa: E402
+
+
+def bibtex(key) -> bytes:
+    """the reference served for a key."""
+
+    return f"@article{{{key},\n  title = {{{key}}}\n}}\n".encode()
+
+
+# the paths of the stub resolver: a reference, a redirection, or
+# another status (with the delay before answering, in seconds).
+ROUTES = {
+    "/10.1000/a": (302, "/bib/a", 0),
+    "/bib/a": (200, bibtex("a"), 0),
+    "/10.1000/b": (301, "http://{host}/moved/b", 0),
+    "/moved/b": (307, "/bib/b", 0),
+    "/bib/b": (200, bibtex("b"), 0),
+    "/10.1000/slow": (200, bibtex("slow"), 0.3),
+    "/10.1000/html": (200, b"<html>not bibtex</html>", 0),
+    "/10.1000/loop": (302, "/10.1000/loop", 0),
+}
+
+
+class Resolver(BaseHTTPRequestHandler):
+    """a DOI resolver, which keeps the connections alive and counts
+    them."""
+
+    protocol_version = "HTTP/1.1"
+
+    def setup(self):
+        super().setup()
+        with self.server.lock:
+            self.server.connections += 1
+
+    def do_GET(self):
+        with self.server.lock:
+            self.server.requests += 1
+        status, value, delay = ROUTES.get(self.path, (404, b"", 0))
+        time.sleep(delay)
+        self.send_response(status)
+        if status in (301, 302, 307):
+            host = self.headers["Host"]
+            self.send_header("Location", value.format(host=host))
+            value = b""
+        self.send_header("Content-Length", str(len(value)))
+        self.end_headers()
+        self.wfile.write(value)
+
+    def log_message(self, *args):
+        pass
+
+
+class StubTest(unittest.TestCase):
+    """run fetchref with its cache and its statistics in a temporary
+    directory."""
+
+    def setUp(self):
+        tmp = tempfile.TemporaryDirectory()
+        self.addCleanup(tmp.cleanup)
+        self.tmp = tmp.name
+        for name, value in (
+            ("REFS_DIR", os.path.join(tmp.name, "refs")),
+            ("STATS_PATH", os.path.join(tmp.name, "stats.json")),
+        ):
+            patch = mock.patch.object(cli, name, value)
+            patch.start()
+            self.addCleanup(patch.stop)
+
+    def run_fetchref(self, *args):
+        """run fetchref. returns its exit code, stdout and stderr."""
+
+        out, err = io.StringIO(), io.StringIO()
+        argv = ["fetchref", *args]
+        with mock.patch.object(sys, "argv", argv):
+            with redirect_stdout(out), redirect_stderr(err):
+                try:
+                    cli.main()
+                    code = 0
+                except SystemExit as e:
+                    code = e.code
+        return code, out.getvalue(), err.getvalue()
+
+
+class TestDoi(StubTest):
+    def setUp(self):
+        super().setUp()
+        self.server = ThreadingHTTPServer(("127.0.0.1", 0), Resolver)
+        self.server.daemon_threads = True
+        self.server.lock = threading.Lock()
+        self.server.connections = 0
+        self.server.requests = 0
+        threading.Thread(
+            target=self.server.serve_forever, daemon=True
+        ).start()
+        self.addCleanup(self.server.server_close)
+        self.addCleanup(self.server.shutdown)
+        host, port = self.server.server_address
+        self.resolver = f"http://{host}:{port}"
+
+    def fetch(self, *dois, opts=()):
+        return self.run_fetchref(
+            "--resolver", self.resolver, *opts, "doi", *dois
+        )
+
+    def test_order_and_misses(self):
+        # the slow one is answered last, but written first.
+        code, out, err = self.fetch(
+            "10.1000/slow",
+            "10.1000/a",
+            "10.1000/missing",
+            "10.1000/b",
+            "10.1000/html",
+            "10.1000/loop",
+            opts=("-j", "4"),
+        )
+        self.assertEqual(code, 0)
+        refs = [bibtex(k).decode() for k in ("slow", "a", "b")]
+        self.assertEqual(out, "\n".join(refs))
+        for doi in ("missing", "html", "loop"):
+            self.assertIn("10.1000/" + doi, err)
+        self.assertNotIn("10.1000/a\n", err)
+
+    def test_all_missing(self):
+        code, out, err = self.fetch("10.1000/missing", "10.1000/html")
+        self.assertEqual(code, 1)
+        self.assertEqual(out, "")
+
+    def test_output_file(self):
+        path = os.path.join(self.tmp, "refs.bib")
+        code, out, _ = self.fetch(
+            "10.1000/b", "10.1000/a", opts=("-o", path)
+        )
+        self.assertEqual(code, 0)
+        self.assertEqual(out, "")
+        refs = [bibtex(k).decode() for k in ("b", "a")]
+        with open(path) as f:
+            self.assertEqual(f.read(), "\n".join(refs))
+
+    def test_keep_alive(self):
+        # each thread keeps its connection between the requests and
+        # the redirections.
+        ids = ["10.1000/a", "10.1000/b", "10.1000/slow"] * 4
+        code, out, _ = self.fetch(*ids, opts=("--no-cache", "-j", "3"))
+        self.assertEqual(code, 0)
+        self.assertEqual(out.count("@article"), len(ids))
+        self.assertGreaterEqual(self.server.requests, 20)
+        self.assertLessEqual(self.server.connections, 3)
+
+    def test_cache(self):
+        self.fetch("10.1000/a")
+        requests = self.server.requests
+        code, out, _ = self.fetch("doi:10.1000/A")
+        self.assertEqual(code, 0)
+        self.assertEqual(out, bibtex("a").decode())
+        self.assertEqual(self.server.requests, requests)
+
+
+class TestRefCache(unittest.TestCase):
+    def test_prune(self):
+        tmp = tempfile.TemporaryDirectory()
+        self.addCleanup(tmp.cleanup)
+        # a day, and 1 KiB.
+        cache = cli.RefCache(tmp.name, 1, 1 / 1024)
+        now = time.time()
+        for key, age in (("old", 2 * 86400), ("a", 100), ("b", 0)):
+            cache.put(key, key * 600)
+            os.utime(cache.file(key), (now - age, now - age))
+        remove = os.remove
+
+        def removed_by_another_run(f):
+            remove(f)
+            raise FileNotFoundError(f)
+
+        with mock.patch.object(os, "remove", removed_by_another_run):
+            cache.prune()
+        self.assertFalse(os.path.exists(cache.file("old")))
+        self.assertIsNone(cache.get("a"))
+        self.assertEqual(cache.get("b"), "b" * 600)
+
+
+ISBN = "9782070360024"
+
+
+def fake_meta(isbn, service):
+    """the isbn services of the tests: their latency and what they
+    answer."""
+
+    if service == "broken":
+        raise RuntimeError("unexpected answer")
+    if service == "down":
+        raise OSError("unreachable")
+    delay = {"slow": 1.0, "medium": 0.1}.get(service, 0.01)
+    time.sleep(delay)
+    if service == "empty":
+        return {}
+    return {"ISBN-13": isbn, "Title": service}
+
+
+class TestIsbn(StubTest):
+    def setUp(self):
+        super().setUp()
+        formatters = {"bibtex": lambda m: f"@book{{{m['Title']}}}"}
+        registry = types.SimpleNamespace(bibformatters=formatters)
+        for name, value in (
+            ("meta", fake_meta),
+            ("registry", registry),
+        ):
+            patch = mock.patch.object(cli, name, value)
+            patch.start()
+            self.addCleanup(patch.stop)
+
+    def lookup(self, services, latency=()):
+        """look an isbn up, failing if it doesn't end in time. returns
+        the reference, the time taken, the statistics and stderr."""
+
+        stats = cli.ServiceStats(cli.STATS_PATH)
+        stats.latency.update(latency)
+        result, err = [], io.StringIO()
+
+        def run():
+            result.append(cli.from_isbn(ISBN, services, stats))
+
+        start = time.monotonic()
+        with redirect_stderr(err):
+            t = threading.Thread(target=run, daemon=True)
+            t.start()
+            t.join(5)
+        self.assertFalse(t.is_alive(), "from_isbn doesn't return")
+        elapsed = time.monotonic() - start
+        return result[0], elapsed, stats, err.getvalue()
+
+    def test_unexpected_error(self):
+        ref, _, stats, err = self.lookup(["broken"])
+        self.assertIsNone(ref)
+        self.assertIn("broken failed", err)
+        self.assertGreaterEqual(
+            stats.expected("broken"), cli.FAILURE_LATENCY
+        )
+
+    def test_unexpected_error_then_answer(self):
+        ref, _, _, _ = self.lookup(["broken", "fast"])
+        self.assertEqual(ref, "@book{fast}")
+
+    def test_hedge(self):
+        # the slow service is expected to be fast: once its expected
+        # latency has passed, the next one is queried too.
+        latency = {"slow": 0.05, "medium": 0.2}
+        ref, elapsed, stats, _ = self.lookup(
+            ["medium", "slow"], latency
+        )
+        self.assertEqual(ref, "@book{medium}")
+        self.assertLess(elapsed, 0.8)
+        # the slow one is known to be slower now.
+        self.assertGreater(stats.expected("slow"), 0.05)
+
+    def test_abandoned_recorded_once(self):
+        # the slow lookup goes on after it's abandoned: once it ends,
+        # its latency is not recorded again.
+        latency = {"slow": 0.05, "medium": 0.2}
+        ref, _, stats, _ = self.lookup(["medium", "slow"], latency)
+        self.assertEqual(ref, "@book{medium}")
+        after = stats.expected("slow")
+        time.sleep(1.1)
+        self.assertEqual(stats.expected("slow"), after)
+
+    def test_all_fail(self):
+        ref, _, _, _ = self.lookup(["down", "empty", "broken"])
+        self.assertIsNone(ref)
+
+
+if __name__ == "__main__":
+    unittest.main()